@@ -0,0 +1,96 @@
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/ops/mongodb/batch_writer.h"
+#include "bench.h"
+
+namespace
+{
+    using bsoncxx::builder::basic::kvp;
+    using bsoncxx::builder::basic::make_document;
+
+    // Stands in for a local mongod: network latency, which overlaps between
+    // connections, and a per-operation and per-document cost, which does
+    // not (every event used to be a write to the same session document)
+    constexpr auto Latency      = std::chrono::microseconds{200};
+    constexpr auto PerOperation = std::chrono::microseconds{50};
+    constexpr auto PerDocument  = std::chrono::microseconds{2};
+
+    std::mutex server{};
+
+    void insert(ops::mongodb::batch_writer::documents& docs)
+    {
+        std::this_thread::sleep_for(Latency / 2);
+        {
+            std::lock_guard<std::mutex> lock{server};
+            std::this_thread::sleep_for(PerOperation + PerDocument * docs.size());
+        }
+        std::this_thread::sleep_for(Latency / 2);
+    }
+
+    bsoncxx::document::value make_event(std::size_t i)
+    {
+        return make_document(
+            kvp("conversation_uuid", "CON-f972836a-550f-45fa-956c-12a2ab5b7d22"),
+            kvp("status", "answered"),
+            kvp("seq", static_cast<std::int64_t>(i)));
+    }
+
+    ///
+    /// Each of \a producers webhook threads posts events and waits for the
+    /// acknowledgement, as post_event does.
+    ///
+    template <typename Write>
+    void post_events(std::size_t producers, std::size_t iterations, Write write)
+    {
+        std::vector<std::thread> threads{};
+
+        const std::size_t per_thread = (iterations + producers - 1) / producers;
+
+        for (std::size_t t = 0; t < producers; ++t) {
+            threads.emplace_back([&write, per_thread, t]() {
+                for (std::size_t i = 0; i < per_thread; ++i) {
+                    write(make_event(t * per_thread + i));
+                }
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    struct registrations
+    {
+        registrations()
+        {
+            for (std::size_t producers : {1, 16, 64}) {
+                const std::string suffix = "/" + std::to_string(producers);
+
+                // The previous behaviour: one round trip per event
+                bench::registry::instance().add("nexmo.event.single" + suffix,
+                    [producers](std::size_t iterations) {
+                        post_events(producers, iterations, [](bsoncxx::document::value doc) {
+                            ops::mongodb::batch_writer::documents docs{};
+                            docs.emplace_back(std::move(doc));
+                            insert(docs);
+                        });
+                    });
+
+                bench::registry::instance().add("nexmo.event.batched" + suffix,
+                    [producers](std::size_t iterations) {
+                        ops::mongodb::batch_writer writer{insert};
+                        post_events(producers, iterations, [&writer](bsoncxx::document::value doc) {
+                            writer.write(std::move(doc));
+                        });
+                    });
+            }
+        }
+    };
+
+    registrations event_cases{};
+}
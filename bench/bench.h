@@ -0,0 +1,205 @@
+///
+/// \file bench.h
+///
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace bench
+{
+    using clock = std::chrono::steady_clock;
+
+    ///
+    /// A benchmark body receives the number of iterations to run.
+    ///
+    using function = std::function<void(std::size_t iterations)>;
+
+    struct result
+    {
+        std::string name;
+        std::size_t iterations;
+        double      ns_per_op;
+    };
+
+    class registry
+    {
+    public:
+        static registry& instance();
+
+        void add(const std::string& name, function fn);
+
+        std::vector<result> run(const std::string& filter) const;
+
+    private:
+        static result measure(const std::string& name, const function& fn);
+
+        std::vector<std::pair<std::string, function>> _cases;
+    };
+
+    void write_json(std::ostream& out, const std::vector<result>& results);
+    std::vector<result> read_json(std::istream& in);
+    void compare(const std::vector<result>& baseline, const std::vector<result>& results);
+
+    struct registration
+    {
+        registration(const std::string& name, function fn)
+        {
+            registry::instance().add(name, std::move(fn));
+        }
+    };
+
+    ///
+    /// Prevent the compiler from discarding a value computed in a benchmark.
+    ///
+    template <typename T>
+    inline void do_not_optimize(const T& value)
+    {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+    inline registry& registry::instance()
+    {
+        static registry instance{};
+        return instance;
+    }
+
+    inline void registry::add(const std::string& name, function fn)
+    {
+        _cases.emplace_back(name, std::move(fn));
+    }
+
+    inline std::vector<result> registry::run(const std::string& filter) const
+    {
+        std::vector<result> results{};
+
+        for (const auto& entry : _cases) {
+            if (std::string::npos == entry.first.find(filter)) {
+                continue;
+            }
+            results.emplace_back(measure(entry.first, entry.second));
+
+            const auto& res = results.back();
+            std::cout << std::left << std::setw(48) << res.name
+                      << std::right << std::setw(12) << res.iterations
+                      << std::setw(14) << std::fixed << std::setprecision(1)
+                      << res.ns_per_op << " ns/op" << std::endl;
+        }
+
+        return results;
+    }
+
+    ///
+    /// Run the body with an increasing number of iterations until a single
+    /// run takes long enough to give a stable per-operation figure.
+    ///
+    inline result registry::measure(const std::string& name, const function& fn)
+    {
+        using namespace std::chrono;
+
+        constexpr auto MinDuration = milliseconds{250};
+
+        std::size_t iterations = 1;
+
+        while (true)
+        {
+            const auto start = clock::now();
+            fn(iterations);
+            const auto elapsed = clock::now() - start;
+
+            if (elapsed >= MinDuration || iterations >= (std::size_t{1} << 30)) {
+                const double ns = duration_cast<nanoseconds>(elapsed).count();
+                return result{name, iterations, ns / iterations};
+            }
+
+            iterations *= 2;
+        }
+    }
+
+    ///
+    /// Write results, and what they were measured with, as a JSON document
+    /// which read_json accepts as a baseline.
+    ///
+    inline void write_json(std::ostream& out, const std::vector<result>& results)
+    {
+        char date[32];
+        const auto now = std::time(nullptr);
+        std::tm tm{};
+        ::gmtime_r(&now, &tm);
+        std::strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+        nlohmann::json j{
+            {"date", date},
+            {"compiler", __VERSION__},
+#ifdef NDEBUG
+            {"assertions", false},
+#else
+            {"assertions", true},
+#endif
+            {"threads", std::thread::hardware_concurrency()},
+            {"benchmarks", nlohmann::json::array()}
+        };
+
+        for (const auto& res : results) {
+            j["benchmarks"].push_back({
+                {"name", res.name},
+                {"iterations", res.iterations},
+                {"ns_per_op", res.ns_per_op}
+            });
+        }
+
+        out << j.dump(2) << std::endl;
+    }
+
+    inline std::vector<result> read_json(std::istream& in)
+    {
+        nlohmann::json j{};
+        in >> j;
+
+        std::vector<result> results{};
+
+        for (const auto& b : j.at("benchmarks")) {
+            results.push_back(result{b.at("name").get<std::string>(),
+                                     b.at("iterations").get<std::size_t>(),
+                                     b.at("ns_per_op").get<double>()});
+        }
+
+        return results;
+    }
+
+    ///
+    /// Print the change of every benchmark which was also run for the
+    /// baseline. Negative changes are improvements.
+    ///
+    inline void compare(const std::vector<result>& baseline, const std::vector<result>& results)
+    {
+        std::cout << std::endl;
+
+        for (const auto& res : results) {
+            for (const auto& base : baseline) {
+                if (base.name != res.name || base.ns_per_op <= 0) {
+                    continue;
+                }
+
+                const double change = 100 * (res.ns_per_op - base.ns_per_op) / base.ns_per_op;
+
+                std::cout << std::left << std::setw(48) << res.name
+                          << std::right << std::fixed << std::setprecision(1)
+                          << std::setw(14) << base.ns_per_op
+                          << std::setw(14) << res.ns_per_op << " ns/op"
+                          << std::setw(10) << std::showpos << change << std::noshowpos
+                          << " %" << std::endl;
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/ops/mongodb/counter.h"
+#include "bench.h"
+
+namespace
+{
+    constexpr std::uint64_t Increment   = ops::mongodb::counter::Increment;
+    constexpr std::uint64_t ThreadBlock = ops::mongodb::counter::ThreadBlock;
+
+    // Reservation size of the allocator previously used by counter::next
+    constexpr std::uint64_t MutexIncrement = 500;
+
+    // Stands in for the find_one_and_update on the counter collection
+    constexpr auto RoundTrip = std::chrono::microseconds{50};
+
+    std::atomic<std::uint64_t> database_count{0};
+
+    std::uint64_t reserve(std::uint64_t count)
+    {
+        std::this_thread::sleep_for(RoundTrip);
+        return database_count.fetch_add(count);
+    }
+
+    ///
+    /// The allocator previously used by counter::next: one mutex, with the
+    /// round trip made while holding it.
+    ///
+    class mutex_allocator
+    {
+    public:
+        std::uint64_t next()
+        {
+            std::lock_guard<std::mutex> guard{_mutex};
+
+            if (0 == _available--) {
+                _counter = reserve(MutexIncrement);
+                _available = MutexIncrement - 1;
+            }
+
+            return ++_counter;
+        }
+
+    private:
+        std::mutex    _mutex;
+        std::uint64_t _counter   = 0;
+        std::uint64_t _available = 0;
+    };
+
+    template <typename Allocator>
+    void contend(Allocator& allocator, std::size_t threads, std::size_t iterations)
+    {
+        std::vector<std::thread> pool{};
+
+        const std::size_t per_thread = (iterations + threads - 1) / threads;
+
+        for (std::size_t t = 0; t < threads; ++t) {
+            pool.emplace_back([&allocator, per_thread]() {
+                for (std::size_t i = 0; i < per_thread; ++i) {
+                    auto id = allocator.next();
+                    bench::do_not_optimize(id);
+                }
+            });
+        }
+
+        for (auto& thread : pool) {
+            thread.join();
+        }
+    }
+
+    struct registrations
+    {
+        registrations()
+        {
+            for (std::size_t threads : {1, 2, 4, 8, 16, 32, 64}) {
+                const std::string suffix = "/" + std::to_string(threads);
+
+                bench::registry::instance().add("mongodb.counter.mutex" + suffix,
+                    [threads](std::size_t iterations) {
+                        mutex_allocator allocator{};
+                        contend(allocator, threads, iterations);
+                    });
+
+                bench::registry::instance().add("mongodb.counter.blocks" + suffix,
+                    [threads](std::size_t iterations) {
+                        ops::mongodb::id_allocator allocator{reserve, Increment, ThreadBlock};
+                        contend(allocator, threads, iterations);
+                    });
+            }
+        }
+    };
+
+    registrations counter_cases{};
+
+    void generate_id(std::size_t iterations)
+    {
+        static ops::mongodb::id_allocator allocator{reserve, Increment, ThreadBlock};
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto id = ops::mongodb::counter::format_id(allocator.next());
+            bench::do_not_optimize(id);
+        }
+    }
+
+    bench::registration generate_id_case{"mongodb.counter.generate_id", generate_id};
+}
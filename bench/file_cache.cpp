@@ -0,0 +1,75 @@
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "../src/ops/util/file_cache.h"
+#include "../src/ops/util/mapped_file.h"
+#include "bench.h"
+
+namespace
+{
+    ///
+    /// A handful of prompts, as played by one campaign, of about 40 kB each
+    /// (10 seconds at 32 kbps).
+    ///
+    const std::vector<std::string>& prompts()
+    {
+        static const std::vector<std::string> paths = []() {
+            std::vector<std::string> p{};
+            const std::string dir = "/tmp/opsbench-media-" + std::to_string(::getpid());
+            ::mkdir(dir.c_str(), 0755);
+            const std::string bytes(40 * 1024, '\xff');
+            for (int i = 0; i < 8; ++i) {
+                p.emplace_back(dir + "/" + std::to_string(i) + ".mp3");
+                std::ofstream{p.back(), std::ios::binary} << bytes;
+            }
+            return p;
+        }();
+
+        return paths;
+    }
+
+    ///
+    /// The path previously taken by media_controller::get_item, which opened
+    /// the file on every request.
+    ///
+    void get_uncached(std::size_t iterations)
+    {
+        const auto& paths = prompts();
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            ops::util::mapped_file file{paths[i % paths.size()]};
+            bench::do_not_optimize(file.data()[file.size() - 1]);
+        }
+    }
+
+    void get_cached(std::size_t iterations)
+    {
+        const auto& paths = prompts();
+        static ops::util::file_cache cache{1024 * 1024};
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto file = cache.get(paths[i % paths.size()]);
+            bench::do_not_optimize(file->data()[file->size() - 1]);
+        }
+    }
+
+    ///
+    /// A budget smaller than the working set, so that every request misses.
+    ///
+    void get_thrashing(std::size_t iterations)
+    {
+        const auto& paths = prompts();
+        static ops::util::file_cache cache{100 * 1024};
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto file = cache.get(paths[i % paths.size()]);
+            bench::do_not_optimize(file->data()[file->size() - 1]);
+        }
+    }
+
+    bench::registration get_uncached_case{"media.get.uncached", get_uncached};
+    bench::registration get_cached_case{"media.get.cached", get_cached};
+    bench::registration get_thrashing_case{"media.get.thrashing", get_thrashing};
+}
@@ -0,0 +1,155 @@
+#include <string>
+#include "../src/core/models/content_media.h"
+#include "../src/nexmo/ivr.h"
+#include "bench.h"
+
+namespace
+{
+    using namespace nexmo;
+
+    ///
+    /// The IVR graph from script.json.
+    ///
+    const nlohmann::json& script_graph()
+    {
+        static const nlohmann::json j = nlohmann::json::parse(R"({
+          "nodes": {
+            "1": { "type": "transmit", "content": "26b4187f515e" },
+            "2": { "type": "select", "keys": ["1", "2", "3"] },
+            "3": { "type": "transmit", "content": "438fe7326a89" },
+            "4": { "type": "transmit", "content": "853da748b835" },
+            "5": { "type": "transmit", "content": "58375fa385ee" },
+            "6": { "type": "receive" }
+          },
+          "root": "1",
+          "edges": [
+            { "source": "1", "dest": "2" },
+            { "source": "2", "dest": "3" },
+            { "source": "2", "dest": "4" },
+            { "source": "2", "dest": "5" },
+            { "source": "3", "dest": "5" },
+            { "source": "4", "dest": "6" },
+            { "source": "6", "dest": "5" }
+          ]
+        })");
+
+        return j;
+    }
+
+    ///
+    /// What every IVR callback paid before graphs were cached.
+    ///
+    void compile(std::size_t iterations)
+    {
+        for (std::size_t i = 0; i < iterations; ++i) {
+            ivr::graph g{script_graph()};
+            bench::do_not_optimize(g);
+        }
+    }
+
+    void cached(std::size_t iterations)
+    {
+        auto& cache = ivr::graph_cache::instance();
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto g = cache.get("bench/0d41a7c3e9b2/1", script_graph());
+            bench::do_not_optimize(g);
+        }
+    }
+
+    ///
+    /// Walk a call from the root through the menu, as post_answer and
+    /// post_ivr do between them.
+    ///
+    void traverse(std::size_t iterations)
+    {
+        const auto g = ivr::graph_cache::instance().get("bench/0d41a7c3e9b2/1", script_graph());
+        const std::string keys[] = {"1", "2", "3"};
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            ivr::script s{g, g->root()};
+            while (ivr::t_select != s.current_node().type && s.traverse_edge(0)) {
+            }
+            s.select(keys[i % 3]);
+            while (s.traverse_edge(0)) {
+            }
+            bench::do_not_optimize(s);
+        }
+    }
+
+    ///
+    /// A graph of the given number of nodes: a chain of prompts, as in a
+    /// long message, which ends with a menu. The media of every prompt is
+    /// put in the content_media cache, so that build_ncco makes no query.
+    ///
+    nlohmann::json chain_graph(std::size_t size)
+    {
+        auto j = nlohmann::json{
+            {"nodes", nlohmann::json::object()},
+            {"root", "1"},
+            {"edges", nlohmann::json::array()}
+        };
+
+        for (std::size_t n = 1; n < size; ++n) {
+            const auto key = std::to_string(n);
+            const auto content_id = "c" + key;
+
+            j["nodes"][key] = {{"type", "transmit"}, {"content", content_id}};
+            j["edges"].push_back({{"source", key}, {"dest", std::to_string(n + 1)}});
+
+            core::content_media::instance().update({
+                {"id", content_id},
+                {"reps", {{"audio/mpeg", {{"en", {{"media", {{"id", "m" + key}}}}}}}}}
+            });
+        }
+
+        j["nodes"][std::to_string(size)] = {{"type", "select"}, {"keys", {"1", "2", "3"}}};
+
+        return j;
+    }
+
+    struct registrations
+    {
+        registrations()
+        {
+            for (std::size_t size : {4, 16, 64, 256}) {
+                const std::string suffix = "/" + std::to_string(size);
+                // Built on first use rather than during static initialization
+                const auto j = std::make_shared<nlohmann::json>();
+
+                bench::registry::instance().add("ivr.script.construct" + suffix,
+                    [j, size](std::size_t iterations) {
+                        if (j->is_null()) {
+                            *j = chain_graph(size);
+                        }
+
+                        for (std::size_t i = 0; i < iterations; ++i) {
+                            ivr::script s{*j, "1"};
+                            bench::do_not_optimize(s);
+                        }
+                    });
+
+                bench::registry::instance().add("ivr.build_ncco" + suffix,
+                    [j, size](std::size_t iterations) {
+                        if (j->is_null()) {
+                            *j = chain_graph(size);
+                        }
+
+                        const auto g = std::make_shared<const ivr::graph>(*j);
+
+                        for (std::size_t i = 0; i < iterations; ++i) {
+                            ivr::script s{g, g->root()};
+                            auto ncco = s.build_ncco("5e3c71a0b2f4");
+                            bench::do_not_optimize(ncco);
+                        }
+                    });
+            }
+        }
+    };
+
+    registrations graph_cases{};
+
+    bench::registration compile_case{"ivr.graph.compile", compile};
+    bench::registration cached_case{"ivr.graph.cached", cached};
+    bench::registration traverse_case{"ivr.script.traverse", traverse};
+}
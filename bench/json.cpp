@@ -0,0 +1,160 @@
+#include <bsoncxx/json.hpp>
+#include <sstream>
+#include "../src/ops/util/json.h"
+#include "bench.h"
+
+namespace
+{
+    ///
+    /// A campaign document as stored by campaigns_controller, with an IVR
+    /// feature built from the graph in script.json.
+    ///
+    const nlohmann::json& campaign()
+    {
+        static const nlohmann::json j = nlohmann::json::parse(R"({
+          "name": "Farmer radio call-in",
+          "id": "5e3c71a0b2f4",
+          "alias": "call-in",
+          "features": {
+            "0d41a7c3e9b2": {
+              "type": "ivr",
+              "id": "0d41a7c3e9b2",
+              "version": 3,
+              "data": {
+                "graph": {
+                  "nodes": {
+                    "1": { "type": "transmit", "content": "26b4187f515e" },
+                    "2": { "type": "select", "keys": ["1", "2", "3"] },
+                    "3": { "type": "transmit", "content": "438fe7326a89" },
+                    "4": { "type": "transmit", "content": "853da748b835" },
+                    "5": { "type": "transmit", "content": "58375fa385ee" },
+                    "6": { "type": "receive" }
+                  },
+                  "root": "1",
+                  "edges": [
+                    { "source": "1", "dest": "2" },
+                    { "source": "2", "dest": "3" },
+                    { "source": "2", "dest": "4" },
+                    { "source": "2", "dest": "5" },
+                    { "source": "3", "dest": "5" },
+                    { "source": "4", "dest": "6" },
+                    { "source": "6", "dest": "5" }
+                  ]
+                }
+              },
+              "adapters": {
+                "nexmo": { "module": "nexmo", "data": { "number": "256784224203", "timeout": 4 } }
+              }
+            }
+          },
+          "languages": {
+            "en": { "name": "English", "tag": "en", "id": "9a0e11b2c3d4" },
+            "lg": { "name": "Luganda", "tag": "lg", "id": "9a0e11b2c3d5" }
+          }
+        })");
+
+        return j;
+    }
+
+    const bsoncxx::document::value& campaign_bson()
+    {
+        static const bsoncxx::document::value value = bsoncxx::from_json(campaign().dump());
+        return value;
+    }
+
+    ///
+    /// The path previously taken by util::json::extract.
+    ///
+    void from_bson_legacy(std::size_t iterations)
+    {
+        const auto view = campaign_bson().view();
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            std::istringstream stream;
+            stream.str(bsoncxx::to_json(view));
+            nlohmann::json j;
+            stream >> j;
+            bench::do_not_optimize(j);
+        }
+    }
+
+    void from_bson_direct(std::size_t iterations)
+    {
+        const auto view = campaign_bson().view();
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto j = ops::util::json::from_bson(view);
+            bench::do_not_optimize(j);
+        }
+    }
+
+    ///
+    /// The path previously taken by the model get_builder() functions.
+    ///
+    void to_bson_legacy(std::size_t iterations)
+    {
+        const auto& j = campaign();
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto value = bsoncxx::from_json(j.dump());
+            bench::do_not_optimize(value);
+        }
+    }
+
+    void to_bson_direct(std::size_t iterations)
+    {
+        const auto& j = campaign();
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto value = ops::util::json::to_bson(j);
+            bench::do_not_optimize(value);
+        }
+    }
+
+    ///
+    /// What the controllers return for a stored document, which carries an
+    /// _id that is left out.
+    ///
+    void extract(std::size_t iterations)
+    {
+        static const bsoncxx::document::value stored = []() {
+            auto j = campaign();
+            j["_id"] = {{"$oid", "5e3c71a0b2f4c8d1e0a9b7c6"}};
+            return bsoncxx::from_json(j.dump());
+        }();
+
+        const auto view = stored.view();
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto j = ops::util::json::extract(view);
+            bench::do_not_optimize(j);
+        }
+    }
+
+    ///
+    /// The body of a Twilio voice webhook.
+    ///
+    void from_urlencoded(std::size_t iterations)
+    {
+        const std::string body =
+            "AccountSid=AC3f0e2d5c8b7a69f4e1d2c3b4a5968778&ApiVersion=2010-04-01"
+            "&CallSid=CA9b8c7d6e5f4a3b2c1d0e9f8a7b6c5d4e&CallStatus=ringing"
+            "&Called=%2B256784224203&CalledCity=&CalledCountry=UG&CalledState="
+            "&CalledZip=&Caller=%2B256772123456&CallerCity=&CallerCountry=UG"
+            "&CallerState=&CallerZip=&Direction=inbound&From=%2B256772123456"
+            "&FromCity=&FromCountry=UG&FromState=&FromZip=&To=%2B256784224203"
+            "&ToCity=&ToCountry=UG&ToState=&ToZip=";
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto j = ops::util::json::from_urlencoded(body);
+            bench::do_not_optimize(j);
+        }
+    }
+
+    bench::registration from_bson_legacy_case{"json.from_bson.legacy", from_bson_legacy};
+    bench::registration from_bson_direct_case{"json.from_bson", from_bson_direct};
+    bench::registration to_bson_legacy_case{"json.to_bson.legacy", to_bson_legacy};
+    bench::registration to_bson_direct_case{"json.to_bson", to_bson_direct};
+    bench::registration extract_case{"json.extract", extract};
+    bench::registration from_urlencoded_case{"json.from_urlencoded", from_urlencoded};
+}
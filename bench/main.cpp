@@ -0,0 +1,52 @@
+#include <fstream>
+#include "bench.h"
+
+///
+/// opsbench [--json FILE] [--baseline FILE] [FILTER]
+///
+/// Runs the benchmarks whose name contains FILTER. --json writes the results
+/// to FILE, and --baseline compares them with a file written by an earlier
+/// run, e.g., of another build.
+///
+int main(int argc, char* argv[])
+{
+    std::string filter{};
+    std::string json_file{};
+    std::string baseline_file{};
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg{argv[i]};
+
+        if ("--json" == arg && i + 1 < argc) {
+            json_file = argv[++i];
+        } else if ("--baseline" == arg && i + 1 < argc) {
+            baseline_file = argv[++i];
+        } else {
+            filter = arg;
+        }
+    }
+
+    std::vector<bench::result> baseline{};
+
+    if (!baseline_file.empty()) {
+        std::ifstream in{baseline_file};
+        if (!in) {
+            std::cerr << "can not read " << baseline_file << std::endl;
+            return 1;
+        }
+        baseline = bench::read_json(in);
+    }
+
+    const auto results = bench::registry::instance().run(filter);
+
+    if (!json_file.empty()) {
+        std::ofstream out{json_file};
+        bench::write_json(out, results);
+    }
+
+    if (!baseline.empty()) {
+        bench::compare(baseline, results);
+    }
+
+    return 0;
+}
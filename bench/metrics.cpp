@@ -0,0 +1,61 @@
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/ops/http/metrics.h"
+#include "bench.h"
+
+namespace
+{
+    using ops::http::metrics;
+
+    ///
+    /// What server::handle_request adds to every request: two clock reads
+    /// and the start and finish of a route.
+    ///
+    void record(std::size_t iterations)
+    {
+        static metrics m{};
+        static const std::size_t route = [&]() {
+            for (int i = 0; i < 30; ++i) {
+                m.add_route("GET", "^/route/" + std::to_string(i) + "/([0-9a-f]+)$");
+            }
+            return m.add_route("POST", "^/nexmo/event$");
+        }();
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            const auto started = metrics::clock::now();
+            m.start(route);
+            m.finish(route, 200, metrics::clock::now() - started);
+        }
+
+        bench::do_not_optimize(m);
+    }
+
+    void expose(std::size_t iterations)
+    {
+        static metrics m{};
+        static const bool ready = [&]() {
+            // Routes must all be added before the first request is recorded
+            std::vector<std::size_t> routes{};
+            for (int i = 0; i < 30; ++i) {
+                routes.push_back(m.add_route("GET", "^/route/" + std::to_string(i) + "$"));
+            }
+            for (int i = 0; i < 30; ++i) {
+                m.start(routes[i]);
+                m.finish(routes[i], 200, std::chrono::milliseconds{i});
+            }
+            return true;
+        }();
+
+        bench::do_not_optimize(ready);
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            std::ostringstream out{};
+            m.expose(out);
+            bench::do_not_optimize(out);
+        }
+    }
+
+    bench::registration record_case{"http.metrics.record", record};
+    bench::registration expose_case{"http.metrics.expose", expose};
+}
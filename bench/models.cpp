@@ -0,0 +1,114 @@
+#include "../src/core/models/campaign.h"
+#include "../src/nexmo/models/session.h"
+#include "bench.h"
+
+namespace
+{
+    ///
+    /// A campaign as posted to campaigns_controller, with an IVR feature
+    /// built from the graph in script.json.
+    ///
+    const nlohmann::json& campaign()
+    {
+        static const nlohmann::json j = nlohmann::json::parse(R"({
+          "name": "Farmer radio call-in",
+          "id": "5e3c71a0b2f4",
+          "alias": "call-in",
+          "version": 7,
+          "features": [
+            {
+              "type": "ivr",
+              "id": "0d41a7c3e9b2",
+              "version": 3,
+              "data": {
+                "graph": {
+                  "nodes": {
+                    "1": { "type": "transmit", "content": "26b4187f515e" },
+                    "2": { "type": "select", "keys": ["1", "2", "3"] },
+                    "3": { "type": "transmit", "content": "438fe7326a89" },
+                    "4": { "type": "transmit", "content": "853da748b835" },
+                    "5": { "type": "transmit", "content": "58375fa385ee" },
+                    "6": { "type": "receive" }
+                  },
+                  "root": "1",
+                  "edges": [
+                    { "source": "1", "dest": "2" },
+                    { "source": "2", "dest": "3" },
+                    { "source": "2", "dest": "4" },
+                    { "source": "2", "dest": "5" },
+                    { "source": "3", "dest": "5" },
+                    { "source": "4", "dest": "6" },
+                    { "source": "6", "dest": "5" }
+                  ]
+                }
+              },
+              "adapters": [
+                { "module": "nexmo", "data": { "number": "256784224203", "timeout": 4 } }
+              ]
+            }
+          ],
+          "languages": [
+            { "name": "English", "tag": "en", "id": "9a0e11b2c3d4" },
+            { "name": "Luganda", "tag": "lg", "id": "9a0e11b2c3d5" }
+          ]
+        })");
+
+        return j;
+    }
+
+    ///
+    /// A session as upserted by nexmo_controller when a call is answered.
+    ///
+    const nlohmann::json& session()
+    {
+        static const nlohmann::json j = {
+            {"id", "6f1a2b3c4d5e"},
+            {"campaign", {{"id", "5e3c71a0b2f4"}}},
+            {"feature", campaign()["features"][0]},
+            {"conversation", {
+                {"conversation_uuid", "CON-f972836a-550f-45fa-956c-12a2ab5b7d22"},
+                {"from", "256772123456"},
+                {"to", "256784224203"},
+                {"uuid", "aaaaaaaa-bbbb-cccc-dddd-0123456789ab"}
+            }}
+        };
+
+        return j;
+    }
+
+    void campaign_builder(std::size_t iterations)
+    {
+        const core::campaign c{campaign()};
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto value = c.builder().extract();
+            bench::do_not_optimize(value);
+        }
+    }
+
+    ///
+    /// Parsing the request body into a model as well, as the controllers do
+    /// on every write.
+    ///
+    void campaign_document(std::size_t iterations)
+    {
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto document = core::campaign{campaign()}.document();
+            bench::do_not_optimize(document);
+        }
+    }
+
+    void session_builder(std::size_t iterations)
+    {
+        const nexmo::session s{session()};
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto value = s.builder().extract();
+            bench::do_not_optimize(value);
+        }
+    }
+
+    bench::registration campaign_builder_case{"model.campaign.builder", campaign_builder};
+    bench::registration campaign_document_case{"model.campaign.document", campaign_document};
+    bench::registration session_builder_case{"model.session.builder", session_builder};
+}
@@ -0,0 +1,108 @@
+#include <boost/regex.hpp>
+#include "../src/ops/http/router.h"
+#include "bench.h"
+
+namespace
+{
+    using route_entry = std::pair<std::string, std::string>;
+
+    ///
+    /// The route table registered by main(), in registration order.
+    ///
+    std::vector<route_entry> route_table()
+    {
+        std::vector<route_entry> routes{};
+
+        for (const std::string resource : {"campaigns", "languages", "content", "media", "audience", "country"}) {
+            const std::string collection{"^/" + resource + "$"};
+            const std::string item{"^/" + resource + "/([0-9a-f]+)$"};
+
+            routes.emplace_back("GET", collection);
+            routes.emplace_back("POST", collection);
+            routes.emplace_back("GET", item);
+            routes.emplace_back("PUT", item);
+            routes.emplace_back("PATCH", item);
+            routes.emplace_back("DELETE", item);
+
+            if ("campaigns" == resource) {
+                routes.emplace_back("POST", "^/campaigns/([0-9a-f]+)/features$");
+                routes.emplace_back("PATCH", "^/campaigns/([0-9a-f]+)/features/([0-9a-f]+)$");
+                routes.emplace_back("POST", "^/campaigns/([0-9a-f]+)/features/([0-9a-f]+)/adapters$");
+                routes.emplace_back("POST", "^/campaigns/([0-9a-f]+)/languages$");
+            } else if ("content" == resource) {
+                routes.emplace_back("POST", "^/content/([0-9a-f]+)/reps$");
+            }
+        }
+
+        routes.emplace_back("POST", "^/nexmo/ivr/s/([0-9a-f]+)/n/([0-9]+)$");
+        routes.emplace_back("POST", "^/nexmo/event$");
+        routes.emplace_back("POST", "^/nexmo/answer/c/([0-9a-f]+)/f/([0-9a-f]+)$");
+        routes.emplace_back("POST", "^/twilio/voice$");
+        routes.emplace_back("POST", "^/twilio/event$");
+
+        return routes;
+    }
+
+    const std::vector<route_entry> requests{
+        {"POST", "/nexmo/ivr/s/4f0a9c2b11de/n/2"},
+        {"POST", "/nexmo/answer/c/5e3c71a0b2f4/f/0d41a7c3e9b2"},
+        {"POST", "/nexmo/event"},
+        {"GET",  "/campaigns/5e3c71a0b2f4"},
+        {"GET",  "/media/9b1f00c2d3e4"},
+        {"GET",  "/no/such/path"}
+    };
+
+    void dispatch_router(std::size_t iterations)
+    {
+        static ops::http::router router{};
+        static bool initialized = false;
+
+        if (!initialized) {
+            const auto routes = route_table();
+            for (std::size_t i = 0; i < routes.size(); ++i) {
+                router.add(routes[i].first, routes[i].second, i);
+            }
+            initialized = true;
+        }
+
+        ops::http::router::params params{};
+        std::size_t route = 0;
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            const auto& req = requests[i % requests.size()];
+            const bool found = router.find(req.first, req.second, route, params);
+            bench::do_not_optimize(found);
+        }
+    }
+
+    ///
+    /// The linear regex scan which the router replaced, for comparison.
+    ///
+    void dispatch_regex(std::size_t iterations)
+    {
+        static std::vector<std::pair<std::string, boost::regex>> routes{};
+
+        if (routes.empty()) {
+            for (const auto& entry : route_table()) {
+                routes.emplace_back(entry.first, boost::regex{entry.second});
+            }
+        }
+
+        boost::smatch match{};
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            const auto& req = requests[i % requests.size()];
+            bool found = false;
+            for (const auto& route : routes) {
+                if (req.first == route.first && boost::regex_search(req.second, match, route.second)) {
+                    found = true;
+                    break;
+                }
+            }
+            bench::do_not_optimize(found);
+        }
+    }
+
+    bench::registration router_dispatch{"http.router.dispatch", dispatch_router};
+    bench::registration regex_dispatch{"http.regex.dispatch", dispatch_regex};
+}
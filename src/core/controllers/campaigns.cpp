@@ -1,10 +1,18 @@
 #include "campaigns.h"
+#include <cstdint>
 #include <nlohmann/json.hpp>
+#include <optional>
+#include <stdexcept>
+#include <vector>
 #include "../../ops/mongodb/counter.h"
 #include "../../ops/mongodb/document.h"
 #include "../../ops/mongodb/page.h"
+#include "../../ops/mongodb/update.h"
 #include "../../ops/util/json.h"
+#include "../../ops/util/logger.h"
+#include "../models/adapter.h"
 #include "../models/campaign.h"
+#include "../models/content_media.h"
 #include "../models/language.h"
 
 namespace core
@@ -14,6 +22,79 @@ using bsoncxx::builder::basic::kvp;
 using bsoncxx::builder::basic::make_document;
 using web::http::methods;
 
+namespace
+{
+    ///
+    /// The campaign version in the If-Match request header, if present.
+    /// Both `3` and the entity tag form `"3"` are accepted.
+    ///
+    std::optional<std::int64_t> if_match(const ops::http::request& request)
+    {
+        std::string tag = request.get_header("If-Match");
+
+        if (0 == tag.compare(0, 2, "W/")) {
+            tag.erase(0, 2);
+        }
+
+        if (tag.size() >= 2 && '"' == tag.front() && '"' == tag.back()) {
+            tag = tag.substr(1, tag.size() - 2);
+        }
+
+        if (tag.empty() || "*" == tag) {
+            return std::nullopt;
+        }
+
+        if (tag.size() > 18 || std::string::npos != tag.find_first_not_of("0123456789")) {
+            throw std::invalid_argument{"bad If-Match version"};
+        }
+
+        return std::stoll(tag);
+    }
+
+    ///
+    /// Load the prompts of an IVR feature into the media cache, so that the
+    /// first calls after the feature is activated are served from memory.
+    ///
+    void prewarm(const nlohmann::json& j_feature)
+    {
+        if (j_feature.value("type", "") != "ivr") {
+            return;
+        }
+
+        const auto& j_data = j_feature.find("data");
+
+        if (j_feature.end() == j_data || j_data->end() == j_data->find("graph")) {
+            return;
+        }
+
+        const auto& j_nodes = j_data->at("graph").find("nodes");
+
+        if (j_data->at("graph").end() == j_nodes || !j_nodes->is_object()) {
+            return;
+        }
+
+        std::vector<std::string> content_ids{};
+
+        for (const auto& j_node : *j_nodes) {
+            const auto& j_content = j_node.find("content");
+            if (j_node.end() == j_content) {
+                continue;
+            }
+            if (j_content->is_string()) {
+                content_ids.emplace_back(*j_content);
+            } else if (j_content->is_object() && j_content->end() != j_content->find("id")) {
+                content_ids.emplace_back(j_content->at("id"));
+            }
+        }
+
+        try {
+            content_media::instance().prewarm(content_ids);
+        } catch (const std::exception& error) {
+            ops::util::log::notice("media prewarm failed", {{"error", error.what()}});
+        }
+    }
+}
+
 campaigns_controller::campaigns_controller()
   : ops::http::rest::controller{}
 {
@@ -22,23 +103,49 @@ campaigns_controller::campaigns_controller()
 void campaigns_controller::get_item(ops::http::request& request)
 {
     const auto id = request.get_uri_param(1);
-    const auto doc = ops::mongodb::document<campaign>::find("id", id);
+    const auto fields = ops::mongodb::projection_from(
+        request.get_query_param<std::string>("fields", ""));
+    const auto doc = ops::mongodb::document<campaign>::find("id", id, fields.view());
 
     request.send_response({ {"campaign", ops::util::json::extract(doc)} });
 }
 
 void campaigns_controller::get(ops::http::request& request)
 {
-    const auto skip  = request.get_query_param<int64_t>("skip", 0);
-    const auto limit = request.get_query_param<int64_t>("limit", 10);
+    const auto skip   = request.get_query_param<int64_t>("skip", 0);
+    const auto limit  = request.get_query_param<int64_t>("limit", 10);
+    const auto after  = request.get_query_param<std::string>("after", "");
+    const auto totals = ops::mongodb::page_total_from(
+        request.get_query_param<std::string>("total", "none"));
+    const auto fields = ops::mongodb::projection_from(
+        request.get_query_param<std::string>("fields", ""));
+
+    auto cursor = skip > 0
+        ? ops::mongodb::page_cursor<campaign>::get(skip, limit, totals, fields.view())
+        : ops::mongodb::page_cursor<campaign>::after(after, limit, totals, fields.view());
+
+    auto stream = request.stream_response();
+
+    stream.begin_object();
+    stream.key("campaigns");
+    stream.begin_array();
+    cursor.for_each([&stream](bsoncxx::document::view view) {
+        stream.value(ops::util::json::extract(view));
+    });
+    stream.end_array();
 
-    auto page = ops::mongodb::page<campaign>::get(skip, limit);
+    if (!cursor.next().empty()) {
+        stream.key("next");
+        stream.value(cursor.next());
+    }
 
-    auto j_campaigns = nlohmann::json::array();
-    for (const auto& doc : page)
-        j_campaigns.emplace_back(ops::util::json::extract(doc));
+    if (cursor.total().has_value()) {
+        stream.key("total");
+        stream.value(cursor.total().value());
+    }
 
-    request.send_response({ {"campaigns", j_campaigns} });
+    stream.end_object();
+    stream.close();
 }
 
 void campaigns_controller::post(ops::http::request& request)
@@ -47,6 +154,7 @@ void campaigns_controller::post(ops::http::request& request)
     {
         auto j_campaign = nlohmann::json::parse(body);
         j_campaign["id"] = ops::mongodb::counter::generate_id();
+        j_campaign["version"] = 1;
 
         campaign model(j_campaign);
 
@@ -61,26 +169,29 @@ void campaigns_controller::post_feature(ops::http::request& request)
     request.with_body([&request](const std::string& body)
     {
         const auto id = request.get_uri_param(1);
-        auto doc = ops::mongodb::document<campaign>::find("id", id);
 
-        auto j_campaign = ops::util::json::extract(doc);
-        auto j_feature  = nlohmann::json::parse(body);
+        auto j_feature = nlohmann::json::parse(body);
 
         const std::string feature_id = ops::mongodb::counter::generate_id();
 
         j_feature["id"] = feature_id;
-        j_campaign["features"][feature_id] = j_feature;
+        j_feature["version"] = 1;
 
-        campaign model(j_campaign);
+        feature model(j_feature);
+
+        ops::mongodb::update changes{};
+        changes.set("features." + feature_id, model.builder().extract());
 
-        doc.inject(model.builder().extract());
-        doc.save();
+        const auto doc = ops::mongodb::document<campaign>::update(
+            make_document(kvp("id", id)), std::move(changes), if_match(request));
 
         nlohmann::json res;
-        res["campaign"] = j_campaign;
+        res["campaign"] = ops::util::json::extract(doc);
         res["feature"] = j_feature;
 
         request.send_response(res);
+
+        prewarm(j_feature);
     });
 }
 
@@ -90,25 +201,62 @@ void campaigns_controller::patch_feature(ops::http::request& request)
     {
         const auto campaign_id = request.get_uri_param(1);
         const auto feature_id  = request.get_uri_param(2);
-        auto doc = ops::mongodb::document<campaign>::find("id", campaign_id);
 
-        auto j_campaign = ops::util::json::extract(doc);
-        auto j_request  = nlohmann::json::parse(body);
-        auto j_feature = j_campaign["features"][feature_id];
+        auto j_request = nlohmann::json::parse(body);
+
+        if (!j_request.is_object()) {
+            throw std::invalid_argument{"expected a JSON object"};
+        }
+
+        // The id is fixed, and the version is bumped below. Compiled IVR
+        // graphs are cached per feature version.
+        j_request.erase("id");
+        j_request.erase("version");
 
+        const std::string path = "features." + ops::mongodb::field_name(feature_id);
+
+        const auto fields = make_document(kvp("version", 1), kvp(path, 1));
+        auto j_current = ops::util::json::extract(
+            ops::mongodb::document<campaign>::find("id", campaign_id, fields.view()));
+
+        const std::int64_t version = j_current.at("version");
+        const auto expected = if_match(request);
+
+        if (expected && version != *expected) {
+            throw ops::mongodb::version_conflict{"document has been modified"};
+        }
+
+        const auto& j_features = j_current["features"];
+
+        if (!j_features.is_object() || !j_features.contains(feature_id)) {
+            throw std::runtime_error{"not found"};
+        }
+
+        // The merged feature is validated as a whole, the same as a new one
+        auto j_feature = j_features.at(feature_id);
         j_feature.merge_patch(j_request);
+        j_feature["id"] = feature_id;
+        j_feature["version"] = j_feature.value("version", std::int64_t{0}) + 1;
 
-        campaign model(j_campaign);
+        feature model(j_feature);
+
+        ops::mongodb::update changes{};
+        changes.set(path, model.builder().extract());
 
-        doc.inject(model.builder().extract());
-        doc.save();
+        // The whole feature is replaced, so the campaign must still be the
+        // version it was read at
+        const auto doc = ops::mongodb::document<campaign>::update(
+            make_document(kvp("id", campaign_id)), std::move(changes), version);
+
+        auto j_campaign = ops::util::json::extract(doc);
 
         nlohmann::json res;
-        res["campaign"] = j_campaign;
-        res["feature"] = j_feature;
-        res["feature"]["id"] = feature_id;
+        res["feature"] = j_campaign["features"][feature_id];
+        res["campaign"] = std::move(j_campaign);
 
         request.send_response(res);
+
+        prewarm(res["feature"]);
     });
 }
 
@@ -117,25 +265,24 @@ void campaigns_controller::post_language(ops::http::request& request)
     request.with_body([&request](const std::string& body)
     {
         const auto id = request.get_uri_param(1);
-        auto doc = ops::mongodb::document<campaign>::find("id", id);
 
-        auto j_campaign = ops::util::json::extract(doc);
-        auto j_request  = nlohmann::json::parse(body);
+        auto j_request = nlohmann::json::parse(body);
 
         const std::string& tag = j_request["tag"];
         auto language_doc = ops::mongodb::document<language>::find("tag", tag);
 
         auto j_language = ops::util::json::extract(language_doc);
 
-        j_campaign["languages"][tag] = j_language;
+        language model(j_language);
 
-        campaign model(j_campaign);
+        ops::mongodb::update changes{};
+        changes.set("languages." + ops::mongodb::field_name(tag), model.builder().extract());
 
-        doc.inject(model.builder().extract());
-        doc.save();
+        const auto doc = ops::mongodb::document<campaign>::update(
+            make_document(kvp("id", id)), std::move(changes), if_match(request));
 
         request.send_response({
-            {"campaign", j_campaign},
+            {"campaign", ops::util::json::extract(doc)},
             {"language", j_language}
         });
     });
@@ -147,22 +294,26 @@ void campaigns_controller::post_adapter(ops::http::request& request)
     {
         const auto campaign_id = request.get_uri_param(1);
         const auto feature_id  = request.get_uri_param(2);
-        auto doc = ops::mongodb::document<campaign>::find("id", campaign_id);
 
-        auto j_campaign = ops::util::json::extract(doc);
-        auto j_adapter  = nlohmann::json::parse(body);
+        auto j_adapter = nlohmann::json::parse(body);
 
-        const std::string module = j_adapter["module"];
+        adapter model(j_adapter);
 
-        j_campaign["features"][feature_id]["adapters"][module] = j_adapter;
+        const std::string path = "features." + feature_id;
 
-        campaign model(j_campaign);
+        ops::mongodb::update changes{};
+        changes.set(path + ".adapters." + ops::mongodb::field_name(model.module()),
+                    model.builder().extract());
+
+        const auto filter = make_document(
+            kvp("id", campaign_id),
+            kvp(path, make_document(kvp("$exists", true))));
 
-        doc.inject(model.builder().extract());
-        doc.save();
+        const auto doc = ops::mongodb::document<campaign>::update(
+            filter.view(), std::move(changes), if_match(request));
 
         request.send_response({
-            {"campaign", j_campaign},
+            {"campaign", ops::util::json::extract(doc)},
             {"adapter", j_adapter}
         });
     });
@@ -1,12 +1,17 @@
 #include "content.h"
 #include <fstream>
+#include <stdexcept>
 #include <nlohmann/json.hpp>
 #include "../../ops/mongodb/counter.h"
 #include "../../ops/mongodb/document.h"
 #include "../../ops/mongodb/page.h"
+#include "../../ops/mongodb/update.h"
 #include "../../ops/util/json.h"
 #include "../models/content.h"
+#include "../models/content_media.h"
 #include "../models/language.h"
+#include "../models/media.h"
+#include "../models/rep.h"
 
 namespace core
 {
@@ -23,23 +28,49 @@ content_controller::content_controller()
 void content_controller::get_item(ops::http::request& request)
 {
     const auto id = request.get_uri_param(1);
-    const auto doc = ops::mongodb::document<content>::find("id", id);
+    const auto fields = ops::mongodb::projection_from(
+        request.get_query_param<std::string>("fields", ""));
+    const auto doc = ops::mongodb::document<content>::find("id", id, fields.view());
 
     request.send_response({ {"content", ops::util::json::extract(doc)} });
 }
 
 void content_controller::get(ops::http::request& request)
 {
-    const auto skip = request.get_query_param<int64_t>("skip", 0);
-    const auto limit = request.get_query_param<int64_t>("limit", 10);
+    const auto skip   = request.get_query_param<int64_t>("skip", 0);
+    const auto limit  = request.get_query_param<int64_t>("limit", 10);
+    const auto after  = request.get_query_param<std::string>("after", "");
+    const auto totals = ops::mongodb::page_total_from(
+        request.get_query_param<std::string>("total", "none"));
+    const auto fields = ops::mongodb::projection_from(
+        request.get_query_param<std::string>("fields", ""));
+
+    auto cursor = skip > 0
+        ? ops::mongodb::page_cursor<content>::get(skip, limit, totals, fields.view())
+        : ops::mongodb::page_cursor<content>::after(after, limit, totals, fields.view());
+
+    auto stream = request.stream_response();
+
+    stream.begin_object();
+    stream.key("content");
+    stream.begin_array();
+    cursor.for_each([&stream](bsoncxx::document::view view) {
+        stream.value(ops::util::json::extract(view));
+    });
+    stream.end_array();
 
-    auto page = ops::mongodb::page<content>::get(skip, limit);
+    if (!cursor.next().empty()) {
+        stream.key("next");
+        stream.value(cursor.next());
+    }
 
-    auto j_content = nlohmann::json::array();
-    for (const auto& doc : page)
-        j_content.emplace_back(ops::util::json::extract(doc));
+    if (cursor.total().has_value()) {
+        stream.key("total");
+        stream.value(cursor.total().value());
+    }
 
-    request.send_response({ {"content", j_content} });
+    stream.end_object();
+    stream.close();
 }
 
 void content_controller::post(ops::http::request& request)
@@ -48,6 +79,7 @@ void content_controller::post(ops::http::request& request)
     {
         auto j_content = nlohmann::json::parse(body);
         j_content["id"] = ops::mongodb::counter::generate_id();
+        j_content["version"] = 1;
 
         content model(j_content);
 
@@ -62,23 +94,45 @@ void content_controller::post_rep(ops::http::request& request)
     request.with_body([&request](const std::string& body)
     {
         const auto id = request.get_uri_param(1);
-        auto doc = ops::mongodb::document<content>::find("id", id);
 
-        auto j_content = ops::util::json::extract(doc);
         auto j_rep = nlohmann::json::parse(body);
 
         const std::string tag = j_rep["language"];
         const std::string format = j_rep["format"];
 
+        ops::mongodb::field_name(format);
+        ops::mongodb::field_name(tag);
+
         // Check that language exists
-        ops::mongodb::document<language>::find("tag", tag);
+        ops::mongodb::document<language>::find("tag", tag, make_document(kvp("_id", 1)));
 
-        j_content["reps"][format][tag] = j_rep;
+        // The file and URL of the rep are derived from the stored media, not
+        // from what the client sent
+        if (j_rep.end() != j_rep.find("media")) {
+            const auto& j_media = j_rep.at("media");
 
-        content model(j_content);
+            if (!j_media.is_object() || !j_media.contains("id") || !j_media.at("id").is_string()) {
+                throw std::invalid_argument{"expected a media id"};
+            }
+
+            const auto media_doc = ops::mongodb::document<media>::find(
+                "id", j_media.at("id").get<std::string>(),
+                make_document(kvp("id", 1), kvp("file", 1), kvp("sha256", 1), kvp("size", 1)));
+
+            j_rep["media"] = ops::util::json::extract(media_doc);
+        }
+
+        rep model(j_rep);
+
+        ops::mongodb::update changes{};
+        changes.set("reps." + format + "." + tag, model.builder().extract());
+
+        const auto doc = ops::mongodb::document<content>::update(
+            make_document(kvp("id", id)), std::move(changes));
+
+        const auto j_content = ops::util::json::extract(doc);
 
-        doc.inject(model.builder().extract());
-        doc.save();
+        content_media::instance().update(j_content);
 
         request.send_response({ 
             {"content", j_content},
@@ -19,23 +19,49 @@ languages_controller::languages_controller() : ops::http::rest::controller{}
 void languages_controller::get_item(ops::http::request& request)
 {
     const auto id = request.get_uri_param(1);
-    const auto doc = ops::mongodb::document<language>::find("id", id);
+    const auto fields = ops::mongodb::projection_from(
+        request.get_query_param<std::string>("fields", ""));
+    const auto doc = ops::mongodb::document<language>::find("id", id, fields.view());
 
     request.send_response({ {"language", ops::util::json::extract(doc)} });
 }
 
 void languages_controller::get(ops::http::request& request)
 {
-    const auto skip  = request.get_query_param<int64_t>("skip", 0);
-    const auto limit = request.get_query_param<int64_t>("limit", 10);
+    const auto skip   = request.get_query_param<int64_t>("skip", 0);
+    const auto limit  = request.get_query_param<int64_t>("limit", 10);
+    const auto after  = request.get_query_param<std::string>("after", "");
+    const auto totals = ops::mongodb::page_total_from(
+        request.get_query_param<std::string>("total", "none"));
+    const auto fields = ops::mongodb::projection_from(
+        request.get_query_param<std::string>("fields", ""));
 
-    auto page = ops::mongodb::page<language>::get(skip, limit);
+    auto cursor = skip > 0
+        ? ops::mongodb::page_cursor<language>::get(skip, limit, totals, fields.view())
+        : ops::mongodb::page_cursor<language>::after(after, limit, totals, fields.view());
 
-    auto j_languages = nlohmann::json::array();
-    for (const auto& doc : page)
-        j_languages.emplace_back(ops::util::json::extract(doc));
+    auto stream = request.stream_response();
 
-    request.send_response({ {"languages", j_languages} });
+    stream.begin_object();
+    stream.key("languages");
+    stream.begin_array();
+    cursor.for_each([&stream](bsoncxx::document::view view) {
+        stream.value(ops::util::json::extract(view));
+    });
+    stream.end_array();
+
+    if (!cursor.next().empty()) {
+        stream.key("next");
+        stream.value(cursor.next());
+    }
+
+    if (cursor.total().has_value()) {
+        stream.key("total");
+        stream.value(cursor.total().value());
+    }
+
+    stream.end_object();
+    stream.close();
 }
 
 void languages_controller::post(ops::http::request& request)
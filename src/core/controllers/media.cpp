@@ -1,11 +1,21 @@
 #include "media.h"
-#include <fstream>
+#include <cerrno>
 #include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <system_error>
+#include "../../dotenv/dotenv.h"
 #include "../../ops/mongodb/counter.h"
 #include "../../ops/mongodb/document.h"
 #include "../../ops/mongodb/page.h"
+#include "../../ops/util/atomic_file.h"
 #include "../../ops/util/json.h"
+#include "../../ops/util/mp3_scanner.h"
+#include "../../ops/util/setting.h"
+#include "../../ops/util/sha256.h"
+#include "../models/content_media.h"
+#include "../models/media_concat.h"
 #include "../models/media.h"
+#include "../models/media_blob.h"
 
 namespace core
 {
@@ -18,31 +28,189 @@ media_controller::media_controller()
 {
 }
 
+namespace
+{
+    ///
+    /// Send a media file from the cache, or a 404 response if it is missing.
+    ///
+    void send_file(ops::http::request& request,
+                   const std::string& path,
+                   std::size_t offset = 0)
+    {
+        std::shared_ptr<const ops::util::mapped_file> file{};
+
+        try {
+            file = media::cache().get(path);
+        } catch (const std::system_error& error) {
+            if (ENOENT == error.code().value()) {
+                request.send_error_response(404, "NOT_FOUND", "Not found");
+                return;
+            }
+            throw;
+        }
+
+        // Neither a media id nor a digest ever refers to different contents
+        request.send_media_response(std::move(file), "audio/mpeg", true, offset);
+    }
+}
+
+///
+/// \brief Serve media by id.
+///
+/// With `?t=<seconds>`, the response starts at the audio frame found for
+/// that time in the seek index of the media document, so the file is not
+/// scanned.
+///
 void media_controller::get_item(ops::http::request& request)
 {
     const auto media_id = request.get_uri_param(1);
-    const std::string file = std::string{media_id} + ".mp3";
 
-    request.send_media_response(file, "audio/mpeg");
+    const auto t = request.get_query_param<std::string>("t", "");
+
+    const auto fields = make_document(
+        kvp("id", 1), kvp("file", 1), kvp("sha256", 1), kvp("audio.index", 1));
+    const auto doc = ops::mongodb::document<media>::find("id", media_id, fields.view());
+    const auto j_media = ops::util::json::extract(doc);
+
+    std::size_t offset = 0;
+
+    if (!t.empty()) {
+        try {
+            offset = media::seek(j_media, std::stod(t));
+        } catch (const std::logic_error& error) {
+            // std::stod throws std::invalid_argument or std::out_of_range
+            throw std::invalid_argument{error.what()};
+        }
+    }
+
+    send_file(request, media::file(j_media), offset);
 }
 
+///
+/// \brief Serve media by digest, without a database lookup. These are the
+///        URLs used in call scripts.
+///
+void media_controller::get_blob(ops::http::request& request)
+{
+    const auto sha256 = request.get_uri_param(1);
+
+    if (64 != sha256.size()) {
+        request.send_error_response(404, "NOT_FOUND", "Not found");
+        return;
+    }
+
+    send_file(request, media_blob::path(sha256));
+}
+
+///
+/// \brief Send the concatenation of several prompts, as referred to by the
+///        NCCO of an IVR.
+///
+/// \sa media_concat
+///
+void media_controller::get_concat(ops::http::request& request)
+{
+    const auto key = request.get_uri_param(1);
+
+    if (64 != key.size()) {
+        request.send_error_response(404, "NOT_FOUND", "Not found");
+        return;
+    }
+
+    send_file(request, media_concat::path(key));
+}
+
+///
+/// \brief Store an uploaded media file.
+///
+/// The body is streamed to a temporary file in the media directory, and
+/// hashed on the way, so memory use does not depend on the size of the
+/// upload. Bodies over MEDIA_MAX_UPLOAD_BYTES (50 MiB by default) get a 413
+/// response. The file is then stored by digest, so uploads with the same
+/// contents share one file. The MP3 frame headers are parsed on the way as
+/// well, for the duration and seek index in the media document.
+///
+/// \sa media_blob
+///
 void media_controller::post(ops::http::request& request)
 {
-    request.with_body([&request](const std::vector<unsigned char>& bytes)
-    {
-        nlohmann::json j_media;
-        j_media["id"] = ops::mongodb::counter::generate_id();
-        j_media["file"] = std::string{j_media["id"]} + ".mp3";
+    static const auto max_size = ops::util::setting<std::size_t>(
+        "MEDIA_MAX_UPLOAD_BYTES", dotenv::getenv("MEDIA_MAX_UPLOAD_BYTES"), 52428800, 1);
 
-        std::ofstream outfile(j_media["file"], std::ios::out | std::ios::binary); 
-        outfile.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    ops::util::atomic_file file{media::directory()};
+    ops::util::sha256 hash{};
+    ops::util::mp3_scanner scanner{};
 
-        media model(j_media);
+    request.read_body([&file, &hash, &scanner](const unsigned char* data, std::size_t size) {
+        hash.update(data, size);
+        scanner.feed(data, size);
+        file.write(data, size);
+    }, max_size);
+
+    const std::string sha256 = hash.hex_digest();
+
+    nlohmann::json j_media;
+    j_media["id"] = ops::mongodb::counter::generate_id();
+    j_media["sha256"] = sha256;
+    j_media["size"] = file.size();
+
+    auto j_audio = media::audio(scanner);
+
+    if (!j_audio.is_null()) {
+        j_media["audio"] = std::move(j_audio);
+    }
+
+    media_blob::store(file, sha256);
 
+    try {
+        media model(j_media);
         ops::mongodb::document<media>::create(model.builder().extract());
+    } catch (...) {
+        media_blob::release(sha256);
+        throw;
+    }
+
+    j_media["url"] = media::url(j_media);
 
-        request.send_response({ {"media", j_media} });
-    });
+    request.send_response({ {"media", j_media} });
+}
+
+///
+/// \brief Delete a media document, and its file if no other media has the
+///        same contents.
+///
+/// \throws ops::http::conflict if a content rep plays the media
+///
+void media_controller::del(ops::http::request& request)
+{
+    const auto media_id = request.get_uri_param(1);
+
+    auto doc = ops::mongodb::document<media>::find("id", media_id);
+    const auto j_media = ops::util::json::extract(doc);
+
+    // The streamUrl of the rep would point at nothing
+    if (content_media::references(media_id)) {
+        throw ops::http::conflict{"media is used by a content rep"};
+    }
+
+    doc.remove();
+
+    const auto& sha256 = j_media.find("sha256");
+
+    if (j_media.end() != sha256) {
+        media_blob::release(*sha256);
+    }
+
+    request.set_status_code(web::http::status_codes::NoContent);
+    request.send_response();
+}
+
+void media_controller::do_install(ops::http::rest::server* server)
+{
+    server->on(web::http::methods::GET, "^/media/blobs/([0-9a-f]+)$",
+        bind_handler<core::media_controller>(&core::media_controller::get_blob));
+    server->on(web::http::methods::GET, "^/media/concat/([0-9a-f]+)$",
+        bind_handler<core::media_controller>(&core::media_controller::get_concat));
 }
 
 } // namespace core
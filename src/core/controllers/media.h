@@ -14,5 +14,12 @@ namespace core
 
         void get_item(ops::http::request& request) override;
         void post(ops::http::request& request) override;
+        void del(ops::http::request& request) override;
+
+        void get_blob(ops::http::request& request);
+        void get_concat(ops::http::request& request);
+
+    private:
+        void do_install(ops::http::rest::server* server) override;
     };
 }
@@ -25,7 +25,7 @@ bsoncxx::builder::basic::document adapter::get_builder() const
     builder.append(kvp("module", _module));
 
     if (_data.has_value()) {
-        builder.append(kvp("data", bsoncxx::from_json(_data.value().dump())));
+        builder.append(kvp("data", ops::util::json::to_bson(_data.value())));
     }
 
     return builder;
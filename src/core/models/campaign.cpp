@@ -25,6 +25,10 @@ campaign::campaign(const nlohmann::json& j)
         _id = j.at("id");
     }
 
+    if (j.end() != j.find("version")) {
+        _version = j.at("version").get<std::int64_t>();
+    }
+
     const auto& features = j.find("features");
 
     if (j.end() != features) {
@@ -56,6 +60,10 @@ bsoncxx::builder::basic::document campaign::get_builder() const
         builder.append(kvp("alias", _alias.value()));
     }
 
+    if (_version.has_value()) {
+        builder.append(kvp("version", _version.value()));
+    }
+
     builder.append(kvp("features", [this](bsoncxx::builder::basic::sub_document sub_builder) {
         for (const auto& feature : _features) {
             sub_builder.append(kvp(feature.id().value(), feature.builder().extract()));
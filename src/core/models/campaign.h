@@ -3,9 +3,11 @@
 ///
 #pragma once
 
+#include <cstdint>
 #include <list>
 #include <nlohmann/json.hpp>
 #include <optional>
+#include "../../ops/mongodb/index.h"
 #include "../../ops/mongodb/model.h"
 #include "feature.h"
 #include "language.h"
@@ -17,15 +19,20 @@ namespace core
     public:
         static auto constexpr collection = "campaigns";
 
+        static constexpr ops::mongodb::index indexes[] = {
+            {"id_1", R"({"id": 1})", true}
+        };
+
         explicit campaign(const nlohmann::json& j);
 
     private:
         bsoncxx::builder::basic::document get_builder() const;
 
-        std::string                _name;
-        std::optional<std::string> _id;
-        std::optional<std::string> _alias;
-        std::list<feature>         _features;
-        std::list<language>        _languages;
+        std::string                 _name;
+        std::optional<std::string>  _id;
+        std::optional<std::string>  _alias;
+        std::optional<std::int64_t> _version;
+        std::list<feature>          _features;
+        std::list<language>         _languages;
     };
 }
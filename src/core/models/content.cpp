@@ -17,6 +17,10 @@ content::content(const nlohmann::json& j)
         _id = j.at("id");
     }
 
+    if (j.end() != j.find("version")) {
+        _version = j.at("version").get<std::int64_t>();
+    }
+
     const auto& reps = j.find("reps");
 
     if (j.end() != reps) {
@@ -38,6 +42,10 @@ bsoncxx::builder::basic::document content::get_builder() const
         builder.append(kvp("id", _id.value()));
     }
 
+    if (_version.has_value()) {
+        builder.append(kvp("version", _version.value()));
+    }
+
     builder.append(kvp("reps", [this](bsoncxx::builder::basic::sub_document sub_builder) {
         for (const auto& rep : _reps) {
             sub_builder.append(kvp(rep.format(), [this, &rep](bsoncxx::builder::basic::sub_document sub_sub_builder) {
@@ -3,8 +3,10 @@
 ///
 #pragma once
 
+#include <cstdint>
 #include <nlohmann/json.hpp>
 #include <list>
+#include "../../ops/mongodb/index.h"
 #include "../../ops/mongodb/model.h"
 #include "rep.h"
 
@@ -15,13 +17,18 @@ namespace core
     public:
         static auto constexpr collection = "content";
 
+        static constexpr ops::mongodb::index indexes[] = {
+            {"id_1", R"({"id": 1})", true}
+        };
+
         explicit content(const nlohmann::json& j);
 
     private:
         bsoncxx::builder::basic::document get_builder() const;
 
-        std::string                _title;
-        std::optional<std::string> _id;
-        std::list<rep>             _reps;
+        std::string                 _title;
+        std::optional<std::string>  _id;
+        std::optional<std::int64_t> _version;
+        std::list<rep>              _reps;
     };
 }
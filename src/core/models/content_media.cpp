@@ -0,0 +1,236 @@
+#include "content_media.h"
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <mongocxx/pipeline.hpp>
+#include <mutex>
+#include <unordered_set>
+#include "../../ops/mongodb/pool.h"
+#include "../../ops/util/json.h"
+#include "content.h"
+#include "media.h"
+
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::builder::basic::make_document;
+
+namespace core
+{
+
+///
+/// \class content_media
+///
+/// \brief Process-wide map from content id to the media file played for
+///        that content
+///
+/// Entries are tagged with the version of the content document they were
+/// read from, and an entry is only ever replaced by one of the same or a
+/// later version, so a slow lookup can not overwrite the result of a
+/// concurrent content_controller::post_rep.
+///
+/// A rep may be added or replaced through another process, so an entry is
+/// read again once it is content_media::Ttl old, and content without media
+/// is not cached at all.
+///
+
+///
+/// \returns the content media singleton instance
+///
+content_media& content_media::instance()
+{
+    static content_media instance{};
+    return instance;
+}
+
+///
+/// \brief Look up the media URLs of a set of content items.
+///
+/// Content which is not cached, or was cached more than content_media::Ttl
+/// ago, is fetched with a single query.
+///
+/// \param content_ids the content to resolve, duplicates are allowed
+///
+/// \returns a map from content id to the media file and the path of its
+///          URL, e.g., `/media/blobs/<sha256>`, without the content which has
+///          no media in the current format and language
+///
+content_media::media_map content_media::resolve(const std::vector<std::string>& content_ids)
+{
+    media_map result{};
+    std::vector<std::string> missing{};
+
+    const auto now = std::chrono::steady_clock::now();
+
+    const auto lookup = [this, now, &result, &missing](const std::string& id, bool load_missing) {
+        const auto i = _entries.find(id);
+        if (_entries.end() != i && (!load_missing || now < i->second.expires)) {
+            result.emplace(id, i->second.media);
+        } else if (load_missing) {
+            missing.push_back(id);
+        }
+    };
+
+    {
+        std::shared_lock<std::shared_mutex> lock{_mutex};
+        for (const auto& id : content_ids) {
+            lookup(id, true);
+        }
+    }
+
+    if (!missing.empty()) {
+        load(missing);
+
+        std::shared_lock<std::shared_mutex> lock{_mutex};
+        for (const auto& id : missing) {
+            lookup(id, false);
+        }
+    }
+
+    return result;
+}
+
+///
+/// \brief Record the media of a content item, or forget it if the content
+///        has no media, unless a later version of it is already cached.
+///
+/// \param j_content the content, as stored in the content collection
+///
+void content_media::update(const nlohmann::json& j_content)
+{
+    const std::string id = j_content.at("id");
+    const std::int64_t version = j_content.value("version", std::int64_t{0});
+
+    std::string url{};
+    std::string file{};
+
+    const auto& reps = j_content.find("reps");
+
+    if (j_content.end() != reps) {
+        const auto& format = reps->find(Format);
+        if (reps->end() != format) {
+            const auto& rep = format->find(Language);
+            if (format->end() != rep) {
+                const auto& media = rep->find("media");
+                if (rep->end() != media && media->end() != media->find("id")) {
+                    url = media::url(*media);
+                    file = media::file(*media);
+                }
+            }
+        }
+    }
+
+    const auto expires = std::chrono::steady_clock::now() + Ttl;
+
+    std::unique_lock<std::shared_mutex> lock{_mutex};
+
+    const auto i = _entries.find(id);
+
+    if (_entries.end() != i && version < i->second.version) {
+        return;
+    }
+
+    if (url.empty()) {
+        if (_entries.end() != i) {
+            _entries.erase(i);
+        }
+        return;
+    }
+
+    _entries[id] = entry{version, {std::move(url), std::move(file)}, expires};
+}
+
+///
+/// \brief Map the media files of the given content into the media cache
+///        ahead of their first request.
+///
+/// \param content_ids the content expected to be played soon, e.g., all
+///                    prompts in an IVR graph
+///
+/// \returns the number of files that were newly mapped
+///
+std::size_t content_media::prewarm(const std::vector<std::string>& content_ids)
+{
+    const auto media = resolve(content_ids);
+
+    std::vector<std::string> paths{};
+    paths.reserve(media.size());
+
+    for (const auto& m : media) {
+        paths.push_back(m.second.file);
+    }
+
+    return media::cache().prewarm(paths);
+}
+
+///
+/// \returns true if a rep of any content, in any format and language,
+///          plays the given media
+///
+/// Reps are keyed by format and language, so the media ids can not be
+/// indexed; this scans the content collection, and is meant for rare
+/// operations such as deleting media.
+///
+bool content_media::references(const std::string& media_id)
+{
+    mongocxx::pipeline pipeline{};
+    pipeline.match(make_document(kvp("reps", make_document(kvp("$type", "object")))));
+    pipeline.project(make_document(
+        kvp("_id", 0),
+        kvp("rep", make_document(kvp("$objectToArray", "$reps")))));
+    pipeline.unwind("$rep");
+    pipeline.project(make_document(
+        kvp("rep", make_document(kvp("$objectToArray", "$rep.v")))));
+    pipeline.unwind("$rep");
+    pipeline.match(make_document(kvp("rep.v.media.id", media_id)));
+    pipeline.limit(1);
+
+    auto lease = ops::mongodb::pool::instance().acquire();
+    auto cursor = lease.collection(content::collection).aggregate(pipeline);
+
+    return cursor.begin() != cursor.end();
+}
+
+///
+/// \brief Fetch the reps in the current format of the given content with
+///        one `$in` query.
+///
+void content_media::load(const std::vector<std::string>& content_ids)
+{
+    const std::unordered_set<std::string> unique{content_ids.begin(), content_ids.end()};
+
+    bsoncxx::builder::basic::array ids{};
+
+    for (const auto& id : unique) {
+        ids.append(id);
+    }
+
+    const auto filter = make_document(kvp("id", make_document(kvp("$in", ids.extract()))));
+
+    mongocxx::options::find opts{};
+    opts.projection(make_document(
+        kvp("_id", 0),
+        kvp("id", 1),
+        kvp("version", 1),
+        kvp(std::string{"reps."} + Format, 1)));
+
+    auto lease = ops::mongodb::pool::instance().acquire();
+    auto collection = lease.collection(content::collection);
+
+    std::unordered_set<std::string> found{};
+
+    for (const bsoncxx::document::view& bson : collection.find(filter.view(), opts)) {
+        const auto j_content = ops::util::json::from_bson(bson);
+        update(j_content);
+        found.insert(j_content.at("id").get<std::string>());
+    }
+
+    // Content which has been deleted plays nothing
+    std::unique_lock<std::shared_mutex> lock{_mutex};
+
+    for (const auto& id : unique) {
+        if (0 == found.count(id)) {
+            _entries.erase(id);
+        }
+    }
+}
+
+} // namespace core
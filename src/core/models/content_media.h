@@ -0,0 +1,59 @@
+///
+/// \file content_media.h
+///
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace core
+{
+    class content_media
+    {
+    public:
+        static constexpr auto Format   = "audio/mpeg";
+        static constexpr auto Language = "en"; // todo
+
+        // How long a media file is played for a content item before the
+        // content is read again
+        static constexpr std::chrono::seconds Ttl{5};
+
+        struct media_ref
+        {
+            std::string url;
+            std::string file;
+        };
+
+        using media_map = std::unordered_map<std::string, media_ref>;
+
+        static content_media& instance();
+
+        media_map resolve(const std::vector<std::string>& content_ids);
+
+        void update(const nlohmann::json& j_content);
+
+        std::size_t prewarm(const std::vector<std::string>& content_ids);
+
+        static bool references(const std::string& media_id);
+
+    private:
+        struct entry
+        {
+            std::int64_t                          version;
+            media_ref                             media;
+            std::chrono::steady_clock::time_point expires;
+        };
+
+        content_media() = default;
+
+        void load(const std::vector<std::string>& content_ids);
+
+        std::shared_mutex                      _mutex;
+        std::unordered_map<std::string, entry> _entries;
+    };
+}
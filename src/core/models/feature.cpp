@@ -1,8 +1,8 @@
 #include "feature.h"
 #include <bsoncxx/builder/basic/array.hpp>
 #include <bsoncxx/builder/basic/kvp.hpp>
-#include <bsoncxx/json.hpp>
 #include "adapter.h"
+#include "../../ops/util/json.h"
 
 using bsoncxx::builder::basic::kvp;
 using bsoncxx::builder::basic::make_document;
@@ -18,6 +18,10 @@ feature::feature(const nlohmann::json& j) : ops::mongodb::model<feature>{}
         _id = j.at("id");
     }
 
+    if (j.end() != j.find("version")) {
+        _version = j.at("version").get<std::int64_t>();
+    }
+
     if (j.end() != j.find("data")) {
         _data = j.at("data");
     }
@@ -41,8 +45,12 @@ bsoncxx::builder::basic::document feature::get_builder() const
         builder.append(kvp("id", _id.value()));
     }
 
+    if (_version.has_value()) {
+        builder.append(kvp("version", _version.value()));
+    }
+
     if (_data.has_value()) {
-        builder.append(kvp("data", bsoncxx::from_json(_data.value().dump())));
+        builder.append(kvp("data", ops::util::json::to_bson(_data.value())));
     }
 
     builder.append(kvp("adapters", [this](bsoncxx::builder::basic::sub_document sub_builder) {
@@ -3,6 +3,7 @@
 ///
 #pragma once
 
+#include <cstdint>
 #include <list>
 #include <nlohmann/json.hpp>
 #include <optional>
@@ -17,6 +18,7 @@ namespace core
         explicit feature(const nlohmann::json& j);
 
         std::optional<std::string> id() const;
+        std::optional<std::int64_t> version() const;
 
     private:
         bsoncxx::builder::basic::document get_builder() const;
@@ -24,6 +26,7 @@ namespace core
         std::list<adapter>            _adapters;
         std::optional<nlohmann::json> _data;
         std::optional<std::string>    _id;
+        std::optional<std::int64_t>   _version;
         std::string                   _type;
     };
 
@@ -31,4 +34,9 @@ namespace core
     {
         return _id;
     }
+
+    inline std::optional<std::int64_t> feature::version() const
+    {
+        return _version;
+    }
 }
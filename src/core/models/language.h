@@ -5,6 +5,7 @@
 
 #include <nlohmann/json.hpp>
 #include <optional>
+#include "../../ops/mongodb/index.h"
 #include "../../ops/mongodb/model.h"
 
 namespace core
@@ -14,6 +15,11 @@ namespace core
     public:
         static auto constexpr collection = "languages";
 
+        static constexpr ops::mongodb::index indexes[] = {
+            {"id_1", R"({"id": 1})", true},
+            {"tag_1", R"({"tag": 1})", true}
+        };
+
         explicit language(const nlohmann::json& j);
 
         std::optional<std::string> id() const;
@@ -1,5 +1,11 @@
 #include "media.h"
 #include <bsoncxx/builder/basic/kvp.hpp>
+#include <stdexcept>
+#include <sys/stat.h>
+#include "../../dotenv/dotenv.h"
+#include "../../ops/util/json.h"
+#include "../../ops/util/setting.h"
+#include "media_blob.h"
 
 using bsoncxx::builder::basic::kvp;
 using bsoncxx::builder::basic::make_document;
@@ -10,7 +16,10 @@ namespace core
 media::media(const nlohmann::json& j)
   : ops::mongodb::model<media>{},
     _id{std::nullopt},
-    _file{std::nullopt}
+    _file{std::nullopt},
+    _sha256{std::nullopt},
+    _size{std::nullopt},
+    _audio{std::nullopt}
 {
     if (j.end() != j.find("id")) {
         _id = j.at("id");
@@ -19,6 +28,160 @@ media::media(const nlohmann::json& j)
     if (j.end() != j.find("file")) {
         _file = j.at("file");
     }
+
+    if (j.end() != j.find("sha256")) {
+        _sha256 = j.at("sha256");
+    }
+
+    if (j.end() != j.find("size")) {
+        _size = j.at("size");
+    }
+
+    if (j.end() != j.find("audio")) {
+        _audio = j.at("audio");
+    }
+}
+
+///
+/// \returns the directory which holds the media files, set with MEDIA_DIR
+///          (the working directory by default)
+///
+const std::string& media::directory()
+{
+    static const std::string dir = [] {
+        const std::string d = dotenv::getenv("MEDIA_DIR", ".");
+        ::mkdir(d.c_str(), 0755);
+        return d;
+    }();
+
+    return dir;
+}
+
+///
+/// \returns the path of the file which held the given media before media
+///          was stored by digest
+///
+std::string media::path(const std::string& media_id)
+{
+    return directory() + "/" + media_id + ".mp3";
+}
+
+///
+/// \param j_media a media document
+///
+/// \returns the path of the file which holds the media
+///
+std::string media::file(const nlohmann::json& j_media)
+{
+    const auto& sha256 = j_media.find("sha256");
+
+    if (j_media.end() != sha256) {
+        return media_blob::path(*sha256);
+    }
+
+    const auto& file = j_media.find("file");
+
+    return j_media.end() != file ? file->get<std::string>() : path(j_media.at("id"));
+}
+
+///
+/// \param j_media a media document
+///
+/// \returns the path part of the URL at which the media is served. Media
+///          stored by digest has a URL which never changes contents.
+///
+std::string media::url(const nlohmann::json& j_media)
+{
+    const auto& sha256 = j_media.find("sha256");
+
+    if (j_media.end() != sha256) {
+        return "/media/blobs/" + sha256->get<std::string>();
+    }
+
+    return "/media/" + j_media.at("id").get<std::string>();
+}
+
+///
+/// \brief The media files served recently, or expected to be served soon.
+///
+/// The cache is shared by all threads in the process. Its size is set with
+/// MEDIA_CACHE_BYTES (256 MiB by default).
+///
+/// \sa content_media::prewarm
+///
+ops::util::file_cache& media::cache()
+{
+    static ops::util::file_cache instance{ops::util::setting<std::size_t>(
+        "MEDIA_CACHE_BYTES", dotenv::getenv("MEDIA_CACHE_BYTES"), 268435456)};
+
+    return instance;
+}
+
+///
+/// \brief Describe an MP3 stream for the media document.
+///
+/// \param scanner a scanner which has been fed the whole file
+///
+/// \returns the duration (ms), average bit rate (kbit/s), sample rate,
+///          channels, number of frames, and the seek index, which holds the
+///          offset of a frame every `index.interval` milliseconds; or null if
+///          the file is not an MPEG audio stream
+///
+nlohmann::json media::audio(const ops::util::mp3_scanner& scanner)
+{
+    if (!scanner.valid()) {
+        return nullptr;
+    }
+
+    return {
+        {"duration",    scanner.duration()},
+        {"bitrate",     scanner.bitrate()},
+        {"sample_rate", scanner.sample_rate()},
+        {"channels",    scanner.channels()},
+        {"frames",      scanner.frames()},
+        {"index", {
+            {"interval", ops::util::mp3_scanner::IndexInterval},
+            {"offsets",  scanner.index()}
+        }}
+    };
+}
+
+///
+/// \brief Find where to start playing a media file to skip the given time,
+///        from the seek index in its media document.
+///
+/// \param j_media a media document with an `audio.index` field
+/// \param seconds the time to skip
+///
+/// \returns the offset of the first frame at or before \a seconds, rounded
+///          down to the index interval
+///
+/// \throws std::invalid_argument if the media has no seek index, or if
+///         \a seconds is negative or beyond the end of the media
+///
+std::size_t media::seek(const nlohmann::json& j_media, double seconds)
+{
+    const auto& audio = j_media.find("audio");
+
+    if (j_media.end() == audio || !audio->is_object() || audio->end() == audio->find("index")) {
+        throw std::invalid_argument{"media has no seek index"};
+    }
+
+    const auto& index = audio->at("index");
+    const auto& offsets = index.at("offsets");
+    const double interval = index.at("interval").get<double>() / 1000.0;
+
+    if (!(seconds >= 0) || offsets.empty()) {
+        throw std::invalid_argument{"bad seek position"};
+    }
+
+    const auto k = static_cast<std::size_t>(seconds / interval);
+
+    if (k >= offsets.size()) {
+        throw std::invalid_argument{"seek position beyond the end of the media"};
+    }
+
+    return offsets[k].get<std::size_t>();
 }
 
 bsoncxx::builder::basic::document media::get_builder() const
@@ -33,6 +196,18 @@ bsoncxx::builder::basic::document media::get_builder() const
         builder.append(kvp("file", _file.value()));
     }
 
+    if (_sha256.has_value()) {
+        builder.append(kvp("sha256", _sha256.value()));
+    }
+
+    if (_size.has_value()) {
+        builder.append(kvp("size", _size.value()));
+    }
+
+    if (_audio.has_value()) {
+        builder.append(kvp("audio", ops::util::json::to_bson(_audio.value())));
+    }
+
     return builder;
 }
 
@@ -3,8 +3,14 @@
 ///
 #pragma once
 
+#include <cstdint>
 #include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include "../../ops/mongodb/index.h"
 #include "../../ops/mongodb/model.h"
+#include "../../ops/util/file_cache.h"
+#include "../../ops/util/mp3_scanner.h"
 
 namespace core
 {
@@ -13,12 +19,30 @@ namespace core
     public:
         static auto constexpr collection = "media";
 
+        static constexpr ops::mongodb::index indexes[] = {
+            {"id_1", R"({"id": 1})", true}
+        };
+
         explicit media(const nlohmann::json& j);
 
+        static const std::string& directory();
+        static std::string path(const std::string& media_id);
+
+        static std::string file(const nlohmann::json& j_media);
+        static std::string url(const nlohmann::json& j_media);
+
+        static nlohmann::json audio(const ops::util::mp3_scanner& scanner);
+        static std::size_t seek(const nlohmann::json& j_media, double seconds);
+
+        static ops::util::file_cache& cache();
+
     private:
         bsoncxx::builder::basic::document get_builder() const;
 
-        std::optional<std::string> _id;
-        std::optional<std::string> _file;
+        std::optional<std::string>    _id;
+        std::optional<std::string>    _file;
+        std::optional<std::string>    _sha256;
+        std::optional<std::int64_t>   _size;
+        std::optional<nlohmann::json> _audio;
     };
 }
@@ -0,0 +1,137 @@
+#include "media_blob.h"
+#include <atomic>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../../ops/mongodb/pool.h"
+#include "../../ops/util/logger.h"
+#include "media.h"
+
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::builder::basic::make_document;
+
+namespace core
+{
+
+///
+/// \class media_blob
+///
+/// \brief Media file contents, stored once per distinct SHA-256 digest
+///
+/// Files live at `<MEDIA_DIR>/ab/cd/abcd...ef.mp3`, where the two levels of
+/// subdirectories are the first four hex digits of the digest, so no
+/// directory grows beyond a few thousand entries. A file never changes once
+/// stored, so it can be cached indefinitely.
+///
+/// The mediaBlob collection counts the media documents which refer to each
+/// file. media_blob::store adds a reference and media_blob::release drops
+/// one; the file is deleted when the last reference goes. To stay safe
+/// against an upload of the same contents racing with the deletion, an
+/// upload always counts its reference before it renames its copy into
+/// place, and the deletion moves the file aside before it removes the
+/// count, and moves it back if a reference appeared in the meantime.
+///
+
+///
+/// \returns the path of the file with the given digest
+///
+/// \throws std::invalid_argument if \a sha256 is not a hex SHA-256 digest
+///
+std::string media_blob::path(const std::string& sha256)
+{
+    if (64 != sha256.size() || std::string::npos != sha256.find_first_not_of("0123456789abcdef")) {
+        throw std::invalid_argument{"bad media digest"};
+    }
+
+    return media::directory() + "/" + sha256.substr(0, 2) + "/" + sha256.substr(2, 2)
+        + "/" + sha256 + ".mp3";
+}
+
+///
+/// \brief Store an uploaded file under its digest, or replace an identical
+///        copy, and add a reference to it.
+///
+/// \param file   the complete upload, which is committed by this call
+/// \param sha256 the digest of the upload
+///
+void media_blob::store(ops::util::atomic_file& file, const std::string& sha256)
+{
+    {
+        auto lease = ops::mongodb::pool::instance().acquire();
+        auto collection = lease.collection(media_blob::collection);
+
+        mongocxx::options::update options{};
+        options.upsert(true);
+
+        collection.update_one(
+            make_document(kvp("sha256", sha256)),
+            make_document(
+                kvp("$inc", make_document(kvp("refs", 1))),
+                kvp("$setOnInsert", make_document(
+                    kvp("size", static_cast<std::int64_t>(file.size()))))),
+            options);
+    }
+
+    const auto dir = media::directory() + "/" + sha256.substr(0, 2);
+
+    ::mkdir(dir.c_str(), 0755);
+    ::mkdir((dir + "/" + sha256.substr(2, 2)).c_str(), 0755);
+
+    file.commit(path(sha256));
+}
+
+///
+/// \brief Drop a reference to a file, and delete the file if it was the
+///        last one.
+///
+void media_blob::release(const std::string& sha256)
+{
+    auto lease = ops::mongodb::pool::instance().acquire();
+    auto collection = lease.collection(media_blob::collection);
+
+    mongocxx::options::find_one_and_update options{};
+    options.return_document(mongocxx::options::return_document::k_after);
+
+    const auto result = collection.find_one_and_update(
+        make_document(kvp("sha256", sha256)),
+        make_document(kvp("$inc", make_document(kvp("refs", -1)))),
+        options);
+
+    if (result && result.value().view()["refs"].get_int32().value <= 0) {
+        collect(sha256);
+    }
+}
+
+void media_blob::collect(const std::string& sha256)
+{
+    static std::atomic<std::uint64_t> sequence{0};
+
+    const auto file = path(sha256);
+    const auto trash = file + ".deleted-" + std::to_string(::getpid()) + "-"
+        + std::to_string(++sequence);
+
+    if (0 != std::rename(file.c_str(), trash.c_str())) {
+        // Already collected
+        return;
+    }
+
+    auto lease = ops::mongodb::pool::instance().acquire();
+    auto collection = lease.collection(media_blob::collection);
+
+    const auto deleted = collection.delete_one(make_document(
+        kvp("sha256", sha256),
+        kvp("refs", make_document(kvp("$lte", 0)))));
+
+    if (deleted && deleted.value().deleted_count() > 0) {
+        ::unlink(trash.c_str());
+        media::cache().erase(file);
+    } else if (0 != std::rename(trash.c_str(), file.c_str())) {
+        ops::util::log::warning("can not restore media blob", {{"file", file}});
+    }
+}
+
+} // namespace core
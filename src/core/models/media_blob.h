@@ -0,0 +1,31 @@
+///
+/// \file media_blob.h
+///
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "../../ops/mongodb/index.h"
+#include "../../ops/util/atomic_file.h"
+
+namespace core
+{
+    class media_blob
+    {
+    public:
+        static auto constexpr collection = "mediaBlob";
+
+        static constexpr ops::mongodb::index indexes[] = {
+            {"sha256_1", R"({"sha256": 1})", true}
+        };
+
+        static std::string path(const std::string& sha256);
+
+        static void store(ops::util::atomic_file& file, const std::string& sha256);
+
+        static void release(const std::string& sha256);
+
+    private:
+        static void collect(const std::string& sha256);
+    };
+}
@@ -0,0 +1,386 @@
+#include "media_concat.h"
+#include <algorithm>
+#include <ctime>
+#include <dirent.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "../../dotenv/dotenv.h"
+#include "../../ops/util/atomic_file.h"
+#include "../../ops/util/logger.h"
+#include "../../ops/util/mp3_scanner.h"
+#include "../../ops/util/setting.h"
+#include "../../ops/util/sha256.h"
+#include "media.h"
+
+namespace core
+{
+
+namespace
+{
+    std::chrono::hours retention()
+    {
+        return std::chrono::hours{ops::util::setting<int>(
+            "IVR_CONCAT_RETENTION_HOURS", dotenv::getenv("IVR_CONCAT_RETENTION_HOURS"), 168, 1)};
+    }
+
+    std::string concat_directory()
+    {
+        return media::directory() + "/concat";
+    }
+
+    ///
+    /// Call \a fn with the path of every file in \a dir, and in its
+    /// subdirectories down to \a depth levels.
+    ///
+    template <typename F>
+    void for_each_file(const std::string& dir, int depth, F&& fn)
+    {
+        DIR* d = ::opendir(dir.c_str());
+
+        if (nullptr == d) {
+            return;
+        }
+
+        while (const auto* entry = ::readdir(d)) {
+            const std::string name{entry->d_name};
+
+            if ("." == name || ".." == name) {
+                continue;
+            }
+
+            const auto path = dir + "/" + name;
+
+            struct stat st{};
+            if (0 != ::stat(path.c_str(), &st)) {
+                continue;
+            }
+
+            if (S_ISDIR(st.st_mode) && depth > 0) {
+                for_each_file(path, depth - 1, fn);
+            } else if (S_ISREG(st.st_mode)) {
+                fn(path, st);
+            }
+        }
+
+        ::closedir(d);
+    }
+}
+
+///
+/// \class media_concat
+///
+/// \brief Single media files made of the audio of several prompts played
+///        back to back
+///
+/// A chain of prompts is identified by the SHA-256 digest of the paths of
+/// its media files. Since those paths are content addressed, a new version
+/// of any prompt, or a prompt in another language, gives a new chain. The
+/// concatenation is stored at media_concat::path and served from
+/// `/media/concat/<digest>`, so it is written once and cached by the media
+/// file cache and by clients like any other media file.
+///
+/// Concatenations are generated on a background thread. Until a chain's
+/// file exists, media_concat::url returns an empty string and the prompts
+/// are played one by one, so no call waits for a file to be written.
+///
+/// The audio frames of each prompt are copied without any tags, and without
+/// the Xing, Info or VBRI frame which describes the prompt as a whole, so
+/// the result is a valid MPEG audio stream as long as all the prompts share
+/// the layer, the sample rate and the number of channels; chains which do
+/// not are refused.
+///
+/// The modification time of a file is refreshed while it is in use, at most
+/// every TouchInterval, and files which were not used for the retention
+/// period, `IVR_CONCAT_RETENTION_HOURS` (a week by default), are deleted.
+///
+
+///
+/// \returns the media concatenation singleton instance
+///
+media_concat& media_concat::instance()
+{
+    static media_concat instance{};
+    return instance;
+}
+
+media_concat::media_concat()
+  : _retention{retention()},
+    _stopping{false}
+{
+}
+
+media_concat::~media_concat()
+{
+    stop();
+}
+
+///
+/// \returns true if consecutive prompts should be merged, as set by the
+///          `IVR_CONCAT_PROMPTS` environment variable
+///
+bool media_concat::enabled()
+{
+    static const bool enabled = "1" == dotenv::getenv("IVR_CONCAT_PROMPTS", "0");
+
+    return enabled;
+}
+
+///
+/// \returns the path of the concatenation with the given digest
+///
+/// \throws std::invalid_argument if \a key is not a hex SHA-256 digest
+///
+std::string media_concat::path(const std::string& key)
+{
+    if (64 != key.size() || std::string::npos != key.find_first_not_of("0123456789abcdef")) {
+        throw std::invalid_argument{"bad media digest"};
+    }
+
+    return concat_directory() + "/" + key.substr(0, 2) + "/" + key.substr(2, 2)
+        + "/" + key + ".mp3";
+}
+
+///
+/// \brief Get the URL of the concatenation of some media files, or have it
+///        generated if it does not exist yet.
+///
+/// \param files the media files, in the order in which they are played
+///
+/// \returns the path of the URL, e.g., `/media/concat/<digest>`, or an empty
+///          string if the files are not, or can not be, concatenated yet
+///
+std::string media_concat::url(const std::vector<std::string>& files)
+{
+    const auto k = key(files);
+    const auto now = clock::now();
+
+    bool touch = false;
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        const auto i = _available.find(k);
+
+        if (_available.end() != i) {
+            if (now - i->second >= TouchInterval) {
+                i->second = now;
+                touch = true;
+            }
+        } else if (_queued.count(k) || _failed.count(k) || _stopping) {
+            return {};
+        } else {
+            struct stat st{};
+            if (0 == ::stat(path(k).c_str(), &st)) {
+                // Generated before a restart
+                remember(k, now);
+                touch = true;
+            } else {
+                if (_jobs.size() >= MaxPending) {
+                    return {};
+                }
+
+                _queued.insert(k);
+                _jobs.push_back(job{k, files});
+
+                if (!_thread.joinable()) {
+                    _thread = std::thread{&media_concat::run, this};
+                }
+
+                _wake.notify_one();
+                return {};
+            }
+        }
+    }
+
+    if (touch) {
+        ::utimes(path(k).c_str(), nullptr);
+    }
+
+    return "/media/concat/" + k;
+}
+
+///
+/// \brief Stop generating and sweeping. Chains which were not generated
+///        yet are played prompt by prompt.
+///
+void media_concat::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _stopping = true;
+        _jobs.clear();
+    }
+
+    _wake.notify_all();
+
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+std::string media_concat::key(const std::vector<std::string>& files)
+{
+    ops::util::sha256 digest{};
+
+    for (const auto& file : files) {
+        digest.update(file.data(), file.size());
+        digest.update("\n", 1);
+    }
+
+    return digest.hex_digest();
+}
+
+void media_concat::generate(const std::vector<std::string>& files,
+                            const std::string& key)
+{
+    ops::util::atomic_file out{media::directory()};
+    ops::util::mp3_scanner first{};
+
+    for (const auto& file : files) {
+        const auto mapped = media::cache().get(file);
+        const auto data = mapped->data();
+
+        ops::util::mp3_scanner scanner{};
+        scanner.feed(data, mapped->size());
+
+        if (!scanner.valid()) {
+            throw std::runtime_error{"no audio in " + file};
+        } else if (!first.valid()) {
+            first = scanner;
+        } else if (first.sample_rate() != scanner.sample_rate()
+                   || first.layer() != scanner.layer()
+                   || first.channels() != scanner.channels())
+        {
+            throw std::runtime_error{"audio format mismatch in " + file};
+        }
+
+        // The last frame may be cut short
+        auto begin = scanner.first_frame();
+        const auto end = std::min<std::uint64_t>(scanner.end(), mapped->size());
+
+        begin += ops::util::mp3_scanner::info_frame(
+            data + begin, static_cast<std::size_t>(end - begin));
+
+        out.write(data + begin, static_cast<std::size_t>(end - begin));
+    }
+
+    const auto dir = concat_directory();
+
+    ::mkdir(dir.c_str(), 0755);
+    ::mkdir((dir + "/" + key.substr(0, 2)).c_str(), 0755);
+    ::mkdir((dir + "/" + key.substr(0, 2) + "/" + key.substr(2, 2)).c_str(), 0755);
+
+    out.commit(path(key));
+}
+
+void media_concat::run()
+{
+    auto next_sweep = clock::now();
+
+    std::unique_lock<std::mutex> lock{_mutex};
+
+    while (!_stopping) {
+        _wake.wait_until(lock, next_sweep, [this]() {
+            return _stopping || !_jobs.empty();
+        });
+
+        if (_stopping) {
+            return;
+        }
+
+        if (!_jobs.empty()) {
+            auto j = std::move(_jobs.front());
+            _jobs.pop_front();
+
+            lock.unlock();
+
+            bool generated = false;
+
+            try {
+                generate(j.files, j.key);
+                generated = true;
+            } catch (const std::exception& e) {
+                ops::util::log::notice("can not merge prompts", {{"error", e.what()}});
+            }
+
+            lock.lock();
+
+            _queued.erase(j.key);
+
+            if (generated) {
+                remember(j.key, clock::now());
+            } else {
+                if (_failed.size() >= Capacity) {
+                    _failed.clear();
+                }
+                _failed.insert(j.key);
+            }
+        }
+
+        if (clock::now() >= next_sweep) {
+            lock.unlock();
+            sweep();
+            lock.lock();
+
+            next_sweep = clock::now() + SweepInterval;
+        }
+    }
+}
+
+///
+/// \brief Delete the files which were not used during the retention period.
+///
+void media_concat::sweep()
+{
+    const auto cutoff = std::time(nullptr)
+        - std::chrono::duration_cast<std::chrono::seconds>(_retention).count();
+    const auto recent = clock::now() - _retention;
+
+    std::size_t deleted = 0;
+
+    for_each_file(concat_directory(), 2, [&](const std::string& file, const struct stat& st) {
+        if (st.st_mtime >= cutoff) {
+            return;
+        }
+
+        const auto slash = file.rfind('/');
+        if (file.size() < slash + 1 + 4) {
+            return;
+        }
+
+        const auto key = file.substr(slash + 1, file.size() - slash - 1 - 4);
+
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        // url() updates the map before the file
+        const auto i = _available.find(key);
+        if (_available.end() != i && i->second >= recent) {
+            return;
+        }
+
+        _available.erase(key);
+
+        if (0 == ::unlink(file.c_str())) {
+            ++deleted;
+        }
+    });
+
+    if (deleted > 0) {
+        ops::util::log::info("deleted unused prompt concatenations", {{"count", deleted}});
+    }
+}
+
+///
+/// \brief Record that the file of a chain exists. Call with the mutex held.
+///
+void media_concat::remember(const std::string& key, clock::time_point touched)
+{
+    if (_available.size() >= Capacity) {
+        _available.clear();
+    }
+
+    _available[key] = touched;
+}
+
+} // namespace core
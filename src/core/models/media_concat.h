@@ -0,0 +1,77 @@
+///
+/// \file media_concat.h
+///
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace core
+{
+    class media_concat
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        // Upper bound on the number of chains remembered in memory
+        static constexpr std::size_t Capacity = 4096;
+
+        // Chains which may wait to be generated
+        static constexpr std::size_t MaxPending = 64;
+
+        // How often the modification time of a file in use is refreshed, and
+        // how often files which were not used are looked for
+        static constexpr auto TouchInterval = std::chrono::hours{1};
+        static constexpr auto SweepInterval = std::chrono::hours{1};
+
+        static media_concat& instance();
+
+        ~media_concat();
+
+        media_concat(const media_concat&) = delete;
+        media_concat& operator=(const media_concat&) = delete;
+
+        static bool enabled();
+
+        static std::string path(const std::string& key);
+
+        std::string url(const std::vector<std::string>& files);
+
+        void stop();
+
+    private:
+        struct job
+        {
+            std::string              key;
+            std::vector<std::string> files;
+        };
+
+        media_concat();
+
+        static std::string key(const std::vector<std::string>& files);
+        static void generate(const std::vector<std::string>& files,
+                             const std::string& key);
+
+        void run();
+        void sweep();
+        void remember(const std::string& key, clock::time_point touched);
+
+        const std::chrono::hours                           _retention;
+        std::mutex                                         _mutex;
+        std::condition_variable                            _wake;
+        std::unordered_map<std::string, clock::time_point> _available;
+        std::unordered_set<std::string>                    _queued;
+        std::unordered_set<std::string>                    _failed;
+        std::deque<job>                                    _jobs;
+        bool                                               _stopping;
+        std::thread                                        _thread;
+    };
+}
@@ -1,23 +1,93 @@
-#include <iostream>
+#include <chrono>
+#include <cstdlib>
 #include "core/controllers/audience.h"
 #include "core/controllers/campaigns.h"
 #include "core/controllers/content.h"
 #include "core/controllers/countries.h"
 #include "core/controllers/languages.h"
 #include "core/controllers/media.h"
+#include "core/models/campaign.h"
+#include "core/models/content.h"
+#include "core/models/language.h"
+#include "core/models/media.h"
+#include "core/models/media_blob.h"
+#include "core/models/media_concat.h"
 #include "dotenv/dotenv.h"
 #include "nexmo/adapters/nexmo_voice.h"
+#include "nexmo/models/event.h"
+#include "nexmo/models/session.h"
 #include "twilio/adapters/twilio_voice.h"
+#include "twilio/models/session.h"
 #include "ops/http/rest/server.h"
+#include "ops/mongodb/index.h"
+#include "ops/mongodb/monitor.h"
 #include "ops/mongodb/pool.h"
+#include "ops/util/logger.h"
+#include "ops/util/setting.h"
 
 int main()
 {
+    using ops::util::setting;
+
     dotenv::init();
-    ops::mongodb::pool::init("ops");
+
+    ops::util::log_options log_options{};
+    log_options.level = ops::util::logger::level(dotenv::getenv("LOG_LEVEL", "info"));
+    log_options.file = dotenv::getenv("LOG_FILE", "");
+
+    ops::util::logger::instance().configure(log_options);
+
+    ops::mongodb::monitor::options monitor_options{};
+    monitor_options.slow = std::chrono::milliseconds{
+        setting<int>("MONGODB_SLOW_MS", dotenv::getenv("MONGODB_SLOW_MS"), 0, 0)};
+    monitor_options.explain = "1" == dotenv::getenv("MONGODB_EXPLAIN_SLOW", "0");
+
+    ops::mongodb::monitor::instance().configure(monitor_options);
+
+    ops::mongodb::pool::options pool_options{};
+    pool_options.min_size = setting<std::size_t>(
+        "MONGODB_MIN_POOL_SIZE", dotenv::getenv("MONGODB_MIN_POOL_SIZE"), 0);
+    pool_options.max_size = setting<std::size_t>(
+        "MONGODB_MAX_POOL_SIZE", dotenv::getenv("MONGODB_MAX_POOL_SIZE"), 100, 1);
+    pool_options.wait_timeout = std::chrono::milliseconds{setting<int>(
+        "MONGODB_WAIT_QUEUE_TIMEOUT_MS", dotenv::getenv("MONGODB_WAIT_QUEUE_TIMEOUT_MS"), 5000, 0)};
+    pool_options.warm_up = pool_options.min_size > 0;
+
+    ops::mongodb::pool::init("ops",
+        dotenv::getenv("MONGODB_URI", "mongodb://localhost:27017"), pool_options);
+
+    ops::mongodb::index_set{}
+        .add<core::campaign>()
+        .add<core::content>()
+        .add<core::language>()
+        .add<core::media>()
+        .add<core::media_blob>()
+        .add<nexmo::session>()
+        .add<nexmo::event>()
+        .add<twilio::session>()
+        .ensure();
 
     ops::http::rest::server server;
 
+    server.set_shutdown_timeout(std::chrono::seconds{
+        setting<int>("SHUTDOWN_TIMEOUT", dotenv::getenv("SHUTDOWN_TIMEOUT"), 30, 0)});
+
+    ops::http::trace_options trace_options{};
+    trace_options.sample_rate = setting<double>(
+        "TRACE_SAMPLE_RATE", dotenv::getenv("TRACE_SAMPLE_RATE"), 0, 0, 1);
+    trace_options.slow = std::chrono::milliseconds{
+        setting<int>("TRACE_SLOW_MS", dotenv::getenv("TRACE_SLOW_MS"), 0, 0)};
+    trace_options.file = dotenv::getenv("TRACE_FILE", "");
+
+    server.set_trace_options(trace_options);
+
+    server.on_scrape([](std::ostream& out) {
+        ops::mongodb::pool::instance().collect(out);
+        ops::mongodb::monitor::instance().collect(out);
+        core::media::cache().collect(out, "media_cache");
+        ops::util::logger::instance().collect(out);
+    });
+
     //
 
     auto campaigns = std::make_unique<core::campaigns_controller>();
@@ -46,7 +116,19 @@ int main()
 
     //
 
-    server.run();
+    // Returns after SIGINT/SIGTERM, once in-flight requests have drained and
+    // the shutdown hooks have run, or the shutdown timeout has expired
+    const bool drained = server.run();
+
+    core::media_concat::instance().stop();
+    ops::mongodb::monitor::instance().stop();
+    ops::util::logger::instance().stop();
+
+    if (!drained) {
+        // Handlers are still running on the listener's threads: leave the
+        // controllers, the adapters and the server alive
+        std::quick_exit(EXIT_FAILURE);
+    }
 
     return 0;
 }
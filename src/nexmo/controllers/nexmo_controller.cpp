@@ -6,8 +6,12 @@
 #include "../../ops/mongodb/counter.h"
 #include "../../ops/mongodb/document.h"
 #include "../../ops/util/json.h"
+#include "../../ops/util/logger.h"
+#include "../../ops/util/setting.h"
 #include "../ivr.h"
+#include "../models/event.h"
 #include "../models/session.h"
+#include "../session_store.h"
 
 namespace nexmo
 {
@@ -16,42 +20,92 @@ using bsoncxx::builder::basic::kvp;
 using bsoncxx::builder::basic::make_document;
 using web::http::methods;
 
+namespace
+{
+    ///
+    /// Rebuild a call which is not in the session store from its session
+    /// document.
+    ///
+    nexmo::call load_call(const std::string& session_id)
+    {
+        const auto fields = make_document(
+            kvp("campaign.id", 1),
+            kvp("feature", 1),
+            kvp("conversation.conversation_uuid", 1));
+
+        auto session_doc = ops::mongodb::document<nexmo::session>::find(
+            "id", session_id, fields.view());
+        auto j_session = ops::util::json::extract(session_doc);
+
+        const auto& j_feature = j_session["feature"];
+        const auto& j_uuid = j_session["conversation"]["conversation_uuid"];
+
+        nexmo::call c{};
+        c.session_id = session_id;
+        c.campaign_id = j_session["campaign"]["id"].get<std::string>();
+        c.graph = ivr::graph_cache::instance().get(
+            ivr::graph_cache::key(c.campaign_id, j_feature), j_feature["data"]["graph"]);
+
+        if (j_uuid.is_string()) {
+            c.uuid = j_uuid.get<std::string>();
+        }
+
+        return c;
+    }
+}
+
 controller::controller()
   : ops::http::rest::controller{}
 {
+    ops::mongodb::batch_writer::options opts{};
+    opts.max_batch = ops::util::setting<std::size_t>(
+        "NEXMO_EVENT_BATCH_SIZE", dotenv::getenv("NEXMO_EVENT_BATCH_SIZE"), 1000, 1);
+    opts.max_delay = std::chrono::milliseconds{ops::util::setting<int>(
+        "NEXMO_EVENT_BATCH_DELAY_MS", dotenv::getenv("NEXMO_EVENT_BATCH_DELAY_MS"), 0, 0)};
+
+    _events = std::make_unique<ops::mongodb::batch_writer>(nexmo::event::collection, opts);
 }
 
 void controller::post_ivr(ops::http::request& request)
 {
     request.with_body([this, &request](const std::string& body)
     {
-        std::cout << "controller::post_ivr" << std::endl;
+        auto* trace = request.trace();
 
         const auto session_id = request.get_uri_param(1);
         const auto node_key   = request.get_uri_param(2);
 
-        auto j_body = nlohmann::json::parse(body);
+        nlohmann::json j_body{};
+        {
+            ops::http::trace::scope span{trace, "json.parse"};
+            j_body = nlohmann::json::parse(body);
+        }
 
-        auto session_doc = ops::mongodb::document<nexmo::session>::find("id", session_id);
-        auto j_session = ops::util::json::extract(session_doc);
+        auto& store = session_store::instance();
+        auto c = store.find(session_id);
+
+        if (!c) {
+            ops::http::trace::scope span{trace, "session.load"};
+            c = load_call(session_id);
+            store.put(*c);
+        }
+
+        const auto& compiled = c->graph;
 
-        nexmo::ivr::script graph(j_session["feature"]["data"]["graph"], node_key);
+        const ivr::node_id node = compiled->find(node_key);
 
-        std::shared_ptr<ivr::node> n = graph.current_node();
+        if (ivr::NoNode == node) {
+            request.send_error_response(404, "NOT_FOUND", "No such IVR node");
+            return;
+        }
 
-        if (ivr::t_select == n->type) {
+        nexmo::ivr::script graph(compiled, node);
 
-            const ivr::node_select* node = static_cast<ivr::node_select*>(n.get());
-            size_t p = 0;
-            for (auto i = node->keys.begin(); i != node->keys.end(); ++i) {
-                if (j_body["dtmf"] == *i)
-                    break;
-                ++p;
-            }
-            if (p < node->keys.size()) {
-                graph.traverse_edge(p);
-            } 
-        } else if (ivr::t_receive == n->type) {
+        const ivr::node_type type = graph.current_node().type;
+
+        if (ivr::t_select == type) {
+            graph.select(j_body.value("dtmf", ""));
+        } else if (ivr::t_receive == type) {
 
             // todo: process audio and create media
 
@@ -59,7 +113,17 @@ void controller::post_ivr(ops::http::request& request)
             return;
         }
 
-        request.send_response(graph.build_ncco(session_id).dump());
+        const auto j_ncco = graph.build_ncco(session_id, trace);
+
+        store.touch(session_id);
+
+        std::string response{};
+        {
+            ops::http::trace::scope span{trace, "serialize"};
+            response = j_ncco.dump();
+        }
+
+        request.send_response(response);
     });
 }
 
@@ -67,25 +131,18 @@ void controller::post_event(ops::http::request& request)
 {
     request.with_body([this, &request](const std::string& body)
     {
-        std::cout << "controller::post_event" << std::endl;
-
         auto j_body = nlohmann::json::parse(body);
 
         const std::string uuid = j_body["conversation_uuid"];
 
-        auto collection = ops::mongodb::pool::instance().database().collection(nexmo::session::collection);
-
-        const auto filter = make_document(kvp("conversation.conversation_uuid", uuid));
-
-        mongocxx::options::find_one_and_update options{};
-        options.upsert(true);
+        if ("completed" == j_body.value("status", "")) {
+            session_store::instance().end(uuid);
+        }
 
-        bsoncxx::builder::basic::document builder{};
-        builder.append(kvp("$push", [this, body](bsoncxx::builder::basic::sub_document sub_builder) {
-            sub_builder.append(kvp("events", bsoncxx::from_json(body)));
-        }));
+        nexmo::event model(j_body);
 
-        collection.find_one_and_update(filter.view(), builder.extract(), options);
+        // Acknowledge once the batch holding the event has been written
+        _events->write(model.builder().extract());
 
         request.send_response();
     });
@@ -95,62 +152,117 @@ void controller::post_answer(ops::http::request& request)
 {
     request.with_body([this, &request](const std::string& body)
     {
-        std::cout << "controller::post_answer" << std::endl;
+        auto* trace = request.trace();
 
-        auto j_body = nlohmann::json::parse(body);
+        nlohmann::json j_body{};
+        {
+            ops::http::trace::scope span{trace, "json.parse"};
+            j_body = nlohmann::json::parse(body);
+        }
 
         const std::string campaign_id = request.get_uri_param(1);
         const std::string feature_id  = request.get_uri_param(2);
 
-        auto campaign_doc = ops::mongodb::document<core::campaign>::find("id", campaign_id);
-        auto j_campaign = ops::util::json::extract(campaign_doc);
+        nlohmann::json j_campaign{};
+        {
+            ops::http::trace::scope span{trace, "campaign.find"};
+
+            // Only the feature answering the call is needed
+            const auto fields = make_document(kvp("features." + feature_id, 1));
 
-        const std::string session_id = ops::mongodb::counter::generate_id();
+            auto campaign_doc = ops::mongodb::document<core::campaign>::find(
+                "id", campaign_id, fields.view());
+            j_campaign = ops::util::json::extract(campaign_doc);
+        }
+
+        std::string session_id{};
+        {
+            ops::http::trace::scope span{trace, "counter.generate_id"};
+            session_id = ops::mongodb::counter::generate_id();
+        }
 
         const std::string uuid = j_body["conversation_uuid"];
 
-        auto collection = ops::mongodb::pool::instance().database().collection(nexmo::session::collection);
+        ops::util::log::debug("nexmo answer", {{"session", session_id}, {"uuid", uuid}});
 
-        std::cout << "uuid: " << uuid << std::endl;
+        {
+            ops::http::trace::scope span{trace, "session.upsert"};
 
-        const auto filter = make_document(kvp("conversation.conversation_uuid", uuid));
+            auto lease = ops::mongodb::pool::instance().acquire();
+            auto collection = lease.collection(nexmo::session::collection);
 
-        mongocxx::options::find_one_and_update options{};
-        options.upsert(true);
+            const auto filter = make_document(kvp("conversation.conversation_uuid", uuid));
 
-        bsoncxx::builder::basic::document builder{};
+            mongocxx::options::find_one_and_update options{};
+            options.upsert(true);
 
-        builder.append(kvp("$set", [this, campaign_id, session_id, feature_id, body, 
-              j_campaign](bsoncxx::builder::basic::sub_document update_builder) 
-        {
-            update_builder.append(kvp("id", session_id));
+            bsoncxx::builder::basic::document builder{};
 
-            update_builder.append(kvp("campaign", [this, campaign_id](bsoncxx::builder::basic::sub_document sub_builder) {
-                sub_builder.append(kvp("id", campaign_id));
-            }));
+            builder.append(kvp("$set", [this, campaign_id, session_id, feature_id, &j_body,
+                  &j_campaign](bsoncxx::builder::basic::sub_document update_builder) 
+            {
+                update_builder.append(kvp("id", session_id));
+
+                update_builder.append(kvp("campaign", [this, campaign_id](bsoncxx::builder::basic::sub_document sub_builder) {
+                    sub_builder.append(kvp("id", campaign_id));
+                }));
 
-            update_builder.append(kvp("conversation", bsoncxx::from_json(body)));
+                update_builder.append(kvp("conversation", ops::util::json::to_bson(j_body)));
 
-            core::feature feature(j_campaign["features"][feature_id]);
+                core::feature feature(j_campaign["features"][feature_id]);
 
-            update_builder.append(kvp("feature", feature.builder().extract()));
-        }));
+                update_builder.append(kvp("feature", feature.builder().extract()));
+            }));
 
-        collection.find_one_and_update(filter.view(), builder.extract(), options);
+            collection.find_one_and_update(filter.view(), builder.extract(), options);
+        }
 
         //session model(j_session);
 
-        const auto j_graph = j_campaign["features"][feature_id]["data"]["graph"];
-        nexmo::ivr::script graph(j_graph, j_graph["root"]);
+        const auto& j_feature = j_campaign["features"][feature_id];
+
+        std::shared_ptr<const ivr::graph> compiled{};
+        {
+            ops::http::trace::scope span{trace, "ivr.graph"};
+            compiled = ivr::graph_cache::instance().get(
+                ivr::graph_cache::key(campaign_id, j_feature), j_feature["data"]["graph"]);
+        }
+
+        nexmo::ivr::script graph(compiled, compiled->root());
+
+        const auto j_resp = graph.build_ncco(session_id, trace);
 
-        const auto j_resp = graph.build_ncco(session_id);
+        session_store::instance().put({session_id, uuid, campaign_id, compiled});
 
-        request.send_response(j_resp.dump());
+        std::string response{};
+        {
+            ops::http::trace::scope span{trace, "serialize"};
+            response = j_resp.dump();
+        }
+
+        request.send_response(response);
     });
 }
 
 void controller::do_install(ops::http::rest::server* server)
 {
+    server->on_shutdown([this]() {
+        _events->stop();
+    });
+
+    server->on_scrape([this](std::ostream& out) {
+        using ops::http::metrics;
+
+        const auto stats = _events->stats();
+
+        metrics::counter(out, "nexmo_events_written_total",
+            "Nexmo events written to the database.", stats.documents);
+        metrics::counter(out, "nexmo_event_batches_total",
+            "Batches of Nexmo events written.", stats.batches);
+        metrics::counter(out, "nexmo_event_batch_failures_total",
+            "Batches of Nexmo events which failed to be written.", stats.failures);
+    });
+
     server->on(methods::POST, "^/nexmo/ivr/s/([0-9a-f]+)/n/([0-9]+)$",
         bind_handler<controller>(&controller::post_ivr));
 
@@ -3,7 +3,9 @@
 ///
 #pragma once
 
+#include <memory>
 #include "../../ops/http/rest/controller.h"
+#include "../../ops/mongodb/batch_writer.h"
 #include "../ivr.h"
 
 namespace nexmo
@@ -21,5 +23,7 @@ namespace nexmo
 
     private:
         void do_install(ops::http::rest::server* server) override;
+
+        std::unique_ptr<ops::mongodb::batch_writer> _events;
     };
 }
@@ -1,85 +1,322 @@
 #include "ivr.h"
-#include "../core/models/content.h"
-#include "../core/models/media.h"
-#include "../ops/mongodb/document.h"
-#include "../ops/util/json.h"
+#include "../core/models/content_media.h"
+#include "../core/models/media_concat.h"
 #include "../dotenv/dotenv.h"
+#include <mutex>
+#include <stdexcept>
 
 namespace nexmo
 {
 
-using bsoncxx::builder::basic::kvp;
-using bsoncxx::builder::basic::make_document;
+namespace
+{
+    using media_chain = std::vector<const core::content_media::media_ref*>;
 
-ivr::script::script(const nlohmann::json& j, const std::string& node_key)
-  : _node_key{node_key}
+    // Play a chain of prompts, as a single stream if they can be merged
+    void stream(nlohmann::json& ncco, const std::string& host, const media_chain& chain,
+                ops::http::trace* trace)
+    {
+        if (chain.size() > 1) {
+            ops::http::trace::scope span{trace, "media_concat"};
+
+            std::vector<std::string> files{};
+            files.reserve(chain.size());
+
+            for (const auto* m : chain) {
+                files.push_back(m->file);
+            }
+
+            // Empty until the concatenation has been generated
+            const auto url = core::media_concat::instance().url(files);
+
+            if (!url.empty()) {
+                ncco.push_back({
+                    {"action", "stream"},
+                    {"streamUrl", { host + url }}
+                });
+                return;
+            }
+        }
+
+        for (const auto* m : chain) {
+            ncco.push_back({
+                {"action", "stream"},
+                {"streamUrl", { host + m->url }}
+            });
+        }
+    }
+}
+
+///
+/// \class ivr::graph
+///
+/// \brief Compiled form of an IVR graph
+///
+/// Nodes are numbered in the order of their keys and stored in a contiguous
+/// array. The edges leaving each node are stored in compressed sparse row
+/// form (edge \a n of node \a i is at `_edges[_edge_offsets[i] + n]`), and
+/// every select node has a table which maps a DTMF key to the index of the
+/// edge to follow. Edges which point to an unknown node are kept, so that
+/// edge indices match the order of the edges in the JSON graph, but they
+/// end the script when traversed.
+///
+/// \param j the graph, as stored under `feature.data.graph`
+///
+ivr::graph::graph(const nlohmann::json& j) : _root{NoNode}
 {
     const auto& nodes = j.find("nodes");
     const auto& edges = j.find("edges");
+    const auto& root  = j.find("root");
 
     if (j.end() != nodes) {
         for (nlohmann::json::const_iterator i = nodes->begin(); i != nodes->end(); ++i) {
-            const auto& key = i.key();
             const auto& j_node = i.value();
-            const auto& type = j_node["type"];
+            const auto& type = j_node.at("type");
+
+            ivr::node n{t_receive, 0, 0};
+
             if ("transmit" == type) {
-                node_transmit node;
-                node.type = t_transmit;
-                node.content = j_node["content"]["id"];
-                _nodes.insert({key, std::make_shared<node_transmit>(node)});
+                const auto& j_content = j_node.at("content");
+                n.type = t_transmit;
+                n.content = static_cast<std::uint32_t>(_content.size());
+                _content.emplace_back(j_content.is_string() ? j_content : j_content.at("id"));
             } else if ("select" == type) {
-                node_select node;
-                node.type = t_select;
-                for (const auto& key : j_node["keys"]) 
-                    node.keys.push_back(key);
-                _nodes.insert({key, std::make_shared<node_select>(node)});
-            } else if ("receive" == type) {
-                ivr::node node;
-                node.type = t_receive;
-                _nodes.insert({key, std::make_shared<ivr::node>(node)});
+                n.type = t_select;
+                n.dtmf = static_cast<std::uint32_t>(_dtmf.size());
+                _dtmf.resize(_dtmf.size() + DtmfKeys, -1);
+                int p = 0;
+                for (const auto& j_key : j_node.at("keys")) {
+                    const std::string& key = j_key;
+                    const int slot = 1 == key.size() ? dtmf_slot(key.front()) : -1;
+                    if (slot >= 0 && _dtmf[n.dtmf + slot] < 0 && p <= INT8_MAX) {
+                        _dtmf[n.dtmf + slot] = static_cast<std::int8_t>(p);
+                    }
+                    ++p;
+                }
+            } else if ("receive" != type) {
+                continue;
             }
+
+            _index.emplace(i.key(), static_cast<node_id>(_nodes.size()));
+            _keys.emplace_back(i.key());
+            _nodes.push_back(n);
         }
     }
 
+    std::vector<std::pair<node_id, node_id>> pairs{};
+
     if (j.end() != edges) {
         for (const auto& edge : *edges) {
-            const std::string& src = edge.at("source");
-            const std::string& dest = edge.at("dest");
-            if (_edges.count(src)) {
-                _edges.at(src).push_back(dest);
-            } else {
-                _edges.insert({src, {dest}});
+            const node_id src = find(edge.at("source"));
+            if (NoNode != src) {
+                pairs.emplace_back(src, find(edge.at("dest")));
             }
         }
     }
+
+    _edge_offsets.assign(_nodes.size() + 1, 0);
+
+    for (const auto& pair : pairs) {
+        ++_edge_offsets[pair.first + 1];
+    }
+
+    for (std::size_t i = 1; i < _edge_offsets.size(); ++i) {
+        _edge_offsets[i] += _edge_offsets[i - 1];
+    }
+
+    std::vector<std::uint32_t> fill(_edge_offsets.begin(), _edge_offsets.end() - 1);
+
+    _edges.resize(pairs.size());
+
+    for (const auto& pair : pairs) {
+        _edges[fill[pair.first]++] = pair.second;
+    }
+
+    if (j.end() != root && root->is_string()) {
+        _root = find(*root);
+    }
 }
 
-nlohmann::json ivr::script::build_ncco(const std::string& session_id)
+///
+/// \returns the id of the node with the given key, or \a NoNode
+///
+ivr::node_id ivr::graph::find(const std::string& key) const
 {
+    const auto i = _index.find(key);
+
+    return _index.end() != i ? i->second : NoNode;
+}
+
+///
+/// \class ivr::graph_cache
+///
+/// \brief Process-wide cache of compiled IVR graphs
+///
+/// Graphs are keyed by campaign, feature and feature version (see
+/// graph_cache::key), so a graph is compiled once per feature version. When
+/// the cache is full, the graph which was compiled first is dropped.
+///
+
+///
+/// \returns the graph cache singleton instance
+///
+ivr::graph_cache& ivr::graph_cache::instance()
+{
+    static graph_cache instance{};
+    return instance;
+}
+
+///
+/// \brief Build the cache key for the graph of a campaign feature.
+///
+/// \param campaign_id the campaign which the feature belongs to
+/// \param j_feature   the feature
+///
+std::string ivr::graph_cache::key(const std::string& campaign_id,
+                                  const nlohmann::json& j_feature)
+{
+    const std::string feature_id = j_feature.value("id", "");
+    const auto version = j_feature.value("version", 0);
+
+    return campaign_id + "/" + feature_id + "/" + std::to_string(version);
+}
+
+///
+/// \brief Look up a compiled graph, compiling and caching it on a miss.
+///
+/// \param key     the cache key
+/// \param j_graph the graph to compile if the key is not in the cache
+///
+std::shared_ptr<const ivr::graph> ivr::graph_cache::get(const std::string& key,
+                                                        const nlohmann::json& j_graph)
+{
+    if (auto g = find(key)) {
+        return g;
+    }
+
+    auto compiled = std::make_shared<const graph>(j_graph);
+
+    {
+        std::unique_lock<std::shared_mutex> lock{_mutex};
+
+        const auto result = _graphs.emplace(key, compiled);
+
+        if (!result.second) {
+            return result.first->second;
+        }
+
+        _order.push_back(key);
+        if (_order.size() > Capacity) {
+            _graphs.erase(_order.front());
+            _order.pop_front();
+        }
+    }
+
+    return compiled;
+}
+
+///
+/// \returns the compiled graph for the given key, or nullptr on a miss
+///
+std::shared_ptr<const ivr::graph> ivr::graph_cache::find(const std::string& key) const
+{
+    std::shared_lock<std::shared_mutex> lock{_mutex};
+
+    const auto i = _graphs.find(key);
+
+    return _graphs.end() != i ? i->second : nullptr;
+}
+
+///
+/// \class ivr::script
+///
+/// \brief Position of a call in an IVR graph
+///
+
+///
+/// \param g       a compiled graph
+/// \param current the node that the call is currently at
+///
+ivr::script::script(std::shared_ptr<const graph> g, node_id current)
+  : _graph{std::move(g)},
+    _node{current}
+{
+    if (NoNode == _node || _node >= _graph->size()) {
+        throw std::runtime_error{"no such node in IVR graph"};
+    }
+}
+
+///
+/// \brief Compile a graph (without caching it) and start at the given node.
+///
+/// \param j        the graph
+/// \param node_key key of the node that the call is currently at
+///
+ivr::script::script(const nlohmann::json& j, const std::string& node_key)
+  : _graph{std::make_shared<const graph>(j)},
+    _node{_graph->find(node_key)}
+{
+    if (NoNode == _node) {
+        throw std::runtime_error{"no such node in IVR graph: " + node_key};
+    }
+}
+
+///
+/// \brief Build the NCCO for the part of the script which runs before the
+///        caller's next input.
+///
+/// The media of all the prompts played is resolved up front, with at most
+/// one database query. If media_concat is enabled, every run of consecutive
+/// prompts is played as one stream, which saves the provider a request, and
+/// the caller a gap, per prompt.
+///
+/// \param session_id the call
+/// \param trace      the trace of the request, if any, to time the stages in
+///
+nlohmann::json ivr::script::build_ncco(const std::string& session_id,
+                                       ops::http::trace* trace)
+{
+    ops::http::trace::scope span{trace, "ivr.build_ncco"};
+
     auto ncco = nlohmann::json::array();
 
     const std::string host = dotenv::getenv("HOST", "http://localhost:9080");
 
+    core::content_media::media_map media{};
+    {
+        ops::http::trace::scope resolve_span{trace, "content_media.resolve"};
+        media = core::content_media::instance().resolve(reachable_content());
+    }
+    const bool concat = core::media_concat::enabled();
+
     bool has_content = true;
     int i = 0;
 
-    while (has_content && i++ < 300)
+    while (has_content && i++ < MaxSteps)
     {
-        std::shared_ptr<ivr::node> n = current_node();
+        const ivr::node& n = current_node();
 
-        if (ivr::t_transmit == n->type) {
-            const ivr::node_transmit* node = static_cast<ivr::node_transmit*>(n.get());
-            ncco.push_back({
-                {"action", "stream"},
-                {"streamUrl", { get_media_url(host, node->content) }}
-            });
-            has_content = traverse_edge(0);
-        } else if (ivr::t_select == n->type) {
+        if (ivr::t_transmit == n.type) {
+            media_chain chain{};
+
+            do {
+                const auto& content_id = _graph->content(current_node());
+                const auto m = media.find(content_id);
+                if (media.end() == m) {
+                    throw std::runtime_error{"no media for content " + content_id};
+                }
+                chain.push_back(&m->second);
+                has_content = traverse_edge(0);
+            } while (concat && has_content && ivr::t_transmit == current_node().type
+                     && i++ < MaxSteps);
+
+            stream(ncco, host, chain, trace);
+        } else if (ivr::t_select == n.type) {
             ncco.push_back({
                 {"action", "input"},
                 {"maxDigits", 1},
                 {"timeOut", 4},
-                {"eventUrl", { host + "/nexmo/ivr/s/" + session_id + "/n/" + _node_key }}
+                {"eventUrl", { host + "/nexmo/ivr/s/" + session_id + "/n/" + _graph->key(_node) }}
             });
             has_content = false;
         } else {
@@ -88,7 +325,7 @@ nlohmann::json ivr::script::build_ncco(const std::string& session_id)
                 {"endOnKey", "#"},
                 {"beepStart", true},
                 {"endOnSilence", 10},
-                {"eventUrl", { host + "/nexmo/ivr/s/" + session_id + "/n/" + _node_key }}
+                {"eventUrl", { host + "/nexmo/ivr/s/" + session_id + "/n/" + _graph->key(_node) }}
             });
             has_content = traverse_edge(0);
         }
@@ -97,15 +334,31 @@ nlohmann::json ivr::script::build_ncco(const std::string& session_id)
     return ncco;
 }
 
-std::string ivr::script::get_media_url(const std::string& host, 
-                                       const std::string& content_id) const
+///
+/// \returns the content of the transmit nodes which build_ncco visits from
+///          the current node
+///
+std::vector<std::string> ivr::script::reachable_content() const
 {
-    auto content_doc = ops::mongodb::document<core::content>::find("id", content_id);
-    auto j_content = ops::util::json::extract(content_doc);
+    std::vector<std::string> content_ids{};
+
+    node_id id = _node;
+    int i = 0;
 
-    const auto& j_audio = j_content["reps"]["audio/mpeg"]["en"]; // todo
+    while (NoNode != id && i++ < MaxSteps)
+    {
+        const ivr::node& n = _graph->at(id);
+
+        if (ivr::t_select == n.type) {
+            break;
+        } else if (ivr::t_transmit == n.type) {
+            content_ids.push_back(_graph->content(n));
+        }
+
+        id = _graph->edge(id, 0);
+    }
 
-    return host + "/media/" + std::string{j_audio["media"]["id"]};
+    return content_ids;
 }
 
 } // namespace nexmo
@@ -4,10 +4,17 @@
 #pragma once
 
 #include <cassert>
-#include <map>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
 #include <nlohmann/json.hpp>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
+#include "../ops/http/trace.h"
 
 namespace nexmo
 {
@@ -20,58 +27,190 @@ namespace ivr
         t_receive
     };
 
+    using node_id = std::uint32_t;
+
+    static constexpr node_id NoNode = std::numeric_limits<node_id>::max();
+
     struct node
     {
-        node_type type;
+        node_type     type;
+        std::uint32_t content; // transmit nodes: index into the content id table
+        std::uint32_t dtmf;    // select nodes: offset into the DTMF table
     };
 
-    struct node_transmit : public node
+    class graph
     {
-        std::string content;
+    public:
+        static constexpr std::size_t DtmfKeys = 12;
+
+        explicit graph(const nlohmann::json& j);
+
+        graph(const graph&) = delete;
+        graph& operator=(const graph&) = delete;
+
+        node_id root() const;
+        node_id find(const std::string& key) const;
+
+        const node& at(node_id id) const;
+        const std::string& key(node_id id) const;
+        const std::string& content(const node& n) const;
+        const std::vector<std::string>& contents() const;
+
+        node_id edge(node_id id, std::size_t n) const;
+        int dtmf_edge(node_id id, char digit) const;
+
+        std::size_t size() const;
+
+    private:
+        static int dtmf_slot(char digit);
+
+        std::vector<node>                        _nodes;
+        std::vector<std::string>                 _keys;
+        std::unordered_map<std::string, node_id> _index;
+        std::vector<std::uint32_t>               _edge_offsets;
+        std::vector<node_id>                     _edges;
+        std::vector<std::int8_t>                 _dtmf;
+        std::vector<std::string>                 _content;
+        node_id                                  _root;
     };
 
-    struct node_select : public node
+    class graph_cache
     {
-        std::vector<std::string> keys;
+    public:
+        static constexpr std::size_t Capacity = 1024;
+
+        static graph_cache& instance();
+
+        static std::string key(const std::string& campaign_id,
+                               const nlohmann::json& j_feature);
+
+        std::shared_ptr<const graph> get(const std::string& key,
+                                         const nlohmann::json& j_graph);
+
+        std::shared_ptr<const graph> find(const std::string& key) const;
+
+    private:
+        graph_cache() = default;
+
+        mutable std::shared_mutex                                      _mutex;
+        std::unordered_map<std::string, std::shared_ptr<const graph>> _graphs;
+        std::deque<std::string>                                        _order;
     };
 
     class script
     {
     public:
-        using node_map = std::map<std::string, std::shared_ptr<node>>;
-        using edge_map = std::map<std::string, std::vector<std::string>>;
+        // Upper bound on the number of nodes visited by one build_ncco call
+        static constexpr int MaxSteps = 300;
 
+        script(std::shared_ptr<const graph> g, node_id current);
         script(const nlohmann::json& j, const std::string& node_key);
 
-        std::shared_ptr<node> current_node() const;
-        bool traverse_edge(int n);
+        const node& current_node() const;
+        bool traverse_edge(std::size_t n);
+        bool select(const std::string& dtmf);
 
-        nlohmann::json build_ncco(const std::string& session_id);
+        nlohmann::json build_ncco(const std::string& session_id,
+                                  ops::http::trace* trace = nullptr);
 
     private:
-        std::string get_media_url(const std::string& host, 
-                                  const std::string& content_id) const;
+        std::vector<std::string> reachable_content() const;
 
-        std::string _node_key;
-        node_map    _nodes;
-        edge_map    _edges;
+        std::shared_ptr<const graph> _graph;
+        node_id                      _node;
     };
 
-    inline std::shared_ptr<node> script::current_node() const
+    inline node_id graph::root() const
     {
-        assert(_nodes.count(_node_key));
+        return _root;
+    }
+
+    inline const node& graph::at(node_id id) const
+    {
+        assert(id < _nodes.size());
 
-        return _nodes.at(_node_key);
+        return _nodes[id];
     }
 
-    inline bool script::traverse_edge(int n)
+    inline const std::string& graph::key(node_id id) const
     {
-        if (!_edges.count(_node_key)) {
+        return _keys.at(id);
+    }
+
+    inline const std::string& graph::content(const node& n) const
+    {
+        return _content.at(n.content);
+    }
+
+    inline const std::vector<std::string>& graph::contents() const
+    {
+        return _content;
+    }
+
+    inline node_id graph::edge(node_id id, std::size_t n) const
+    {
+        const auto first = _edge_offsets[id];
+        const auto last  = _edge_offsets[id + 1];
+
+        return n < last - first ? _edges[first + n] : NoNode;
+    }
+
+    inline int graph::dtmf_edge(node_id id, char digit) const
+    {
+        const auto& n = at(id);
+        const int slot = dtmf_slot(digit);
+
+        if (t_select != n.type || slot < 0) {
+            return -1;
+        }
+
+        return _dtmf[n.dtmf + slot];
+    }
+
+    inline std::size_t graph::size() const
+    {
+        return _nodes.size();
+    }
+
+    inline int graph::dtmf_slot(char digit)
+    {
+        if (digit >= '0' && digit <= '9') {
+            return digit - '0';
+        } else if ('*' == digit) {
+            return 10;
+        } else if ('#' == digit) {
+            return 11;
+        }
+
+        return -1;
+    }
+
+    inline const node& script::current_node() const
+    {
+        return _graph->at(_node);
+    }
+
+    inline bool script::traverse_edge(std::size_t n)
+    {
+        const node_id next = _graph->edge(_node, n);
+
+        if (NoNode == next) {
             return false;
         }
 
-        _node_key = _edges.at(_node_key).at(n);
+        _node = next;
         return true;
     }
+
+    inline bool script::select(const std::string& dtmf)
+    {
+        if (1 != dtmf.size()) {
+            return false;
+        }
+
+        const int edge = _graph->dtmf_edge(_node, dtmf.front());
+
+        return edge >= 0 && traverse_edge(static_cast<std::size_t>(edge));
+    }
 }
 }
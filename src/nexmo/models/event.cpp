@@ -0,0 +1,40 @@
+#include "event.h"
+#include <bsoncxx/types.hpp>
+#include "../../ops/util/json.h"
+
+using bsoncxx::builder::basic::kvp;
+
+namespace nexmo
+{
+
+///
+/// \class event
+///
+/// \brief A call event posted by Nexmo, stored as received in an
+///        append-only collection
+///
+event::event(const nlohmann::json& j)
+  : ops::mongodb::model<event>{},
+    _received{std::chrono::system_clock::now()},
+    _data{j}
+{
+    _conversation_uuid = j.at("conversation_uuid");
+
+    if (j.end() != j.find("status")) {
+        _status = j.at("status");
+    }
+}
+
+bsoncxx::builder::basic::document event::get_builder() const
+{
+    bsoncxx::builder::basic::document builder{};
+
+    builder.append(kvp("conversation_uuid", _conversation_uuid));
+    builder.append(kvp("status", _status));
+    builder.append(kvp("received", bsoncxx::types::b_date{_received}));
+    builder.append(kvp("data", ops::util::json::to_bson(_data)));
+
+    return builder;
+}
+
+} // namespace nexmo
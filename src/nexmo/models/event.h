@@ -0,0 +1,32 @@
+///
+/// \file event.h
+///
+#pragma once
+
+#include <chrono>
+#include <nlohmann/json.hpp>
+#include "../../ops/mongodb/index.h"
+#include "../../ops/mongodb/model.h"
+
+namespace nexmo
+{
+    class event : public ops::mongodb::model<event>
+    {
+    public:
+        static auto constexpr collection = "nexmoEvent";
+
+        static constexpr ops::mongodb::index indexes[] = {
+            {"conversation_uuid_1_received_1", R"({"conversation_uuid": 1, "received": 1})", false}
+        };
+
+        explicit event(const nlohmann::json& j);
+
+    private:
+        bsoncxx::builder::basic::document get_builder() const;
+
+        std::string                           _conversation_uuid;
+        std::string                           _status;
+        std::chrono::system_clock::time_point _received;
+        nlohmann::json                        _data;
+    };
+}
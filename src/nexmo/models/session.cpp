@@ -1,5 +1,6 @@
 #include "session.h"
-#include <bsoncxx/json.hpp>
+#include <bsoncxx/builder/basic/array.hpp>
+#include "../../ops/util/json.h"
 
 using bsoncxx::builder::basic::kvp;
 using bsoncxx::builder::basic::make_document;
@@ -49,12 +50,12 @@ bsoncxx::builder::basic::document session::get_builder() const
         builder.append(kvp("feature", _feature.value().builder().extract()));
     }
 
-    builder.append(kvp("conversation", bsoncxx::from_json(_conversation.dump())));
+    builder.append(kvp("conversation", ops::util::json::to_bson(_conversation)));
 
     if (_events.is_array()) {
         bsoncxx::builder::basic::array array_builder{};
         for (const auto& j_event : _events) {
-            array_builder.append(bsoncxx::from_json(j_event.dump()));
+            array_builder.append(ops::util::json::to_bson(j_event));
         }
         builder.append(kvp("events", array_builder.extract()));
     }
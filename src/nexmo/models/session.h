@@ -5,6 +5,7 @@
 
 #include <nlohmann/json.hpp>
 #include <optional>
+#include "../../ops/mongodb/index.h"
 #include "../../ops/mongodb/model.h"
 #include "../../core/models/campaign.h"
 #include "../../core/models/feature.h"
@@ -16,6 +17,13 @@ namespace nexmo
     public:
         static auto constexpr collection = "nexmoSession";
 
+        // Not unique: sessions used to be created by call events, before
+        // the call was answered and given an id
+        static constexpr ops::mongodb::index indexes[] = {
+            {"id_1", R"({"id": 1})", false},
+            {"conversation.conversation_uuid_1", R"({"conversation.conversation_uuid": 1})", false}
+        };
+
         explicit session(const nlohmann::json& j);
 
     private:
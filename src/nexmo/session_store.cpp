@@ -0,0 +1,186 @@
+#include "session_store.h"
+#include <algorithm>
+
+namespace nexmo
+{
+
+///
+/// \class session_store
+///
+/// \brief In-process cache of the calls in progress
+///
+/// Holds the compiled graph of every call answered by this process, so that
+/// IVR callbacks can be answered without reading the session document. The
+/// caller's node is not kept: each callback names it in its URL.
+///
+/// Calls are dropped from the store by a timer wheel of \a Slots slots, one
+/// per \a Tick: shortly after Nexmo reports that the call has ended, or when
+/// no callback has been received for \a IdleTimeout. The wheel is advanced
+/// by the calls which change the store, so there is no background thread. A
+/// call which is not in the store (because it was answered by another
+/// process, or before a restart) is loaded from the database by the
+/// controller and put back.
+///
+
+///
+/// \returns the session store singleton instance
+///
+session_store& session_store::instance()
+{
+    static session_store instance{};
+    return instance;
+}
+
+session_store::session_store()
+  : _wheel(Slots),
+    _start{std::chrono::steady_clock::now()},
+    _tick{0}
+{
+}
+
+///
+/// \brief Add a call to the store, replacing any call with the same
+///        session id.
+///
+void session_store::put(call c)
+{
+    const std::string session_id = c.session_id;
+
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    expire();
+
+    if (!c.uuid.empty()) {
+        _uuids[c.uuid] = session_id;
+    }
+
+    auto& e = _sessions[session_id];
+    e.c = std::move(c);
+
+    schedule(session_id, e, IdleTimeout);
+}
+
+///
+/// \returns a copy of the call with the given session id, or nothing if
+///          the call is not in the store
+///
+std::optional<call> session_store::find(const std::string& session_id) const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    const auto i = _sessions.find(session_id);
+
+    if (_sessions.end() == i) {
+        return std::nullopt;
+    }
+
+    return i->second.c;
+}
+
+///
+/// \brief Restart the idle timeout of a call, after a callback.
+///
+void session_store::touch(const std::string& session_id)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    expire();
+
+    const auto i = _sessions.find(session_id);
+
+    if (_sessions.end() != i) {
+        schedule(session_id, i->second, IdleTimeout);
+    }
+}
+
+///
+/// \brief Mark the call with the given conversation uuid as ended. It is
+///        dropped from the store after \a EndedTimeout.
+///
+void session_store::end(const std::string& uuid)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    expire();
+
+    const auto i = _uuids.find(uuid);
+
+    if (_uuids.end() == i) {
+        return;
+    }
+
+    const auto s = _sessions.find(i->second);
+
+    if (_sessions.end() != s) {
+        schedule(s->first, s->second, EndedTimeout);
+    }
+}
+
+///
+/// \returns the number of calls in the store
+///
+std::size_t session_store::size() const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    return _sessions.size();
+}
+
+///
+/// \brief Advance the timer wheel to the current tick and drop the calls
+///        whose deadline has passed. Entries left behind by a call's
+///        earlier deadlines are skipped. Called with the store locked.
+///
+void session_store::expire()
+{
+    const std::uint64_t now = (std::chrono::steady_clock::now() - _start) / Tick;
+
+    // Every slot is visited at most once, however long the store was idle
+    const auto first = now - std::min<std::uint64_t>(now - _tick, Slots);
+
+    _tick = now;
+
+    for (auto t = first + 1; t <= now; ++t) {
+        auto& s = _wheel[t % Slots];
+
+        const auto last = std::remove_if(s.begin(), s.end(), [this](const slot::value_type& timer) {
+            if (timer.second > _tick) {
+                return false;
+            }
+
+            const auto i = _sessions.find(timer.first);
+
+            if (_sessions.end() != i && timer.second == i->second.deadline) {
+                _uuids.erase(i->second.c.uuid);
+                _sessions.erase(i);
+            }
+
+            return true;
+        });
+
+        s.erase(last, s.end());
+    }
+}
+
+///
+/// \brief (Re)arm the timer of a call. Called with the store locked.
+///
+void session_store::schedule(const std::string& session_id,
+                             entry& e,
+                             std::chrono::seconds timeout)
+{
+    const auto ticks = std::max<std::uint64_t>(1, timeout / Tick);
+
+    e.deadline = _tick + ticks;
+
+    _wheel[e.deadline % Slots].emplace_back(session_id, e.deadline);
+}
+
+///
+/// \struct call
+///
+/// \brief A call in progress, with the graph of the feature which answered
+///        it
+///
+
+} // namespace nexmo
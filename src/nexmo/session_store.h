@@ -0,0 +1,69 @@
+///
+/// \file session_store.h
+///
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ivr.h"
+
+namespace nexmo
+{
+    struct call
+    {
+        std::string                       session_id;
+        std::string                       uuid;
+        std::string                       campaign_id;
+        std::shared_ptr<const ivr::graph> graph;
+    };
+
+    class session_store
+    {
+    public:
+        static constexpr std::chrono::seconds Tick{1};
+        static constexpr std::size_t          Slots = 64;
+
+        // How long a call may go without a callback before it is dropped
+        static constexpr std::chrono::seconds IdleTimeout{3600};
+
+        // How long a call is kept after Nexmo reports that it has ended
+        static constexpr std::chrono::seconds EndedTimeout{30};
+
+        static session_store& instance();
+
+        void put(call c);
+        std::optional<call> find(const std::string& session_id) const;
+        void touch(const std::string& session_id);
+        void end(const std::string& uuid);
+
+        std::size_t size() const;
+
+    private:
+        struct entry
+        {
+            call          c;
+            std::uint64_t deadline;
+        };
+
+        using slot = std::vector<std::pair<std::string, std::uint64_t>>;
+
+        session_store();
+
+        void expire();
+        void schedule(const std::string& session_id, entry& e, std::chrono::seconds timeout);
+
+        mutable std::mutex                           _mutex;
+        std::unordered_map<std::string, entry>       _sessions;
+        std::unordered_map<std::string, std::string> _uuids;
+        std::vector<slot>                            _wheel;
+        std::chrono::steady_clock::time_point        _start;
+        std::uint64_t                                _tick;
+    };
+}
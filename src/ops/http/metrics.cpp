@@ -0,0 +1,290 @@
+#include "metrics.h"
+#include <algorithm>
+#include <iomanip>
+#include <unordered_map>
+
+namespace ops
+{
+namespace http
+{
+
+namespace
+{
+    std::atomic<std::uint64_t> next_id{0};
+
+    ///
+    /// Escape a label value for the Prometheus text format.
+    ///
+    std::string escape(const std::string& value)
+    {
+        std::string result{};
+        result.reserve(value.size());
+
+        for (const char c : value) {
+            if ('\\' == c || '"' == c) {
+                result += '\\';
+                result += c;
+            } else if ('\n' == c) {
+                result += "\\n";
+            } else {
+                result += c;
+            }
+        }
+
+        return result;
+    }
+}
+
+///
+/// \class metrics
+///
+/// \brief Request counts, status codes, in-flight requests and latency
+///        histograms per route, in the Prometheus text exposition format
+///
+/// Routes are labelled with the method and the pattern they were registered
+/// with, not with the request path, so the number of series stays fixed.
+///
+/// Every thread which records a request gets a shard of counters of its own
+/// on its first request. Recording touches only that shard, with relaxed
+/// atomic stores and no locks; metrics::expose adds up the shards. A request
+/// is started and finished on the same thread, so the number of requests in
+/// flight is the difference between the started and finished counts.
+///
+/// Routes must all be added before the first request is recorded.
+///
+
+const std::array<double, metrics::Buckets - 1> metrics::bounds{
+    0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5
+};
+
+constexpr std::array<std::uint16_t, 17> metrics::codes;
+
+metrics::metrics() : _id{++next_id}
+{
+    _routes.push_back(route{"", "unmatched"});
+}
+
+///
+/// \brief Add a route to record requests for.
+///
+/// \returns the index to pass to metrics::start and metrics::finish
+///
+std::size_t metrics::add_route(const std::string& method, const std::string& pattern)
+{
+    _routes.push_back(route{method, pattern});
+
+    return _routes.size() - 1;
+}
+
+///
+/// \brief Register a function which writes more metrics, e.g., the state of a
+///        connection pool, to every scrape.
+///
+void metrics::add_collector(collector c)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    _collectors.emplace_back(std::move(c));
+}
+
+///
+/// \brief Write all the metrics, followed by those of the collectors.
+///
+void metrics::expose(std::ostream& out) const
+{
+    std::vector<totals> sums(_routes.size(), totals{});
+    std::vector<collector> collectors{};
+
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        for (const auto& s : _shards) {
+            for (std::size_t r = 0; r < s->routes.size(); ++r) {
+                const auto& c = s->routes[r];
+                auto& t = sums[r];
+
+                t.started += c.started.load(std::memory_order_relaxed);
+                for (std::size_t i = 0; i < t.responses.size(); ++i) {
+                    t.responses[i] += c.responses[i].load(std::memory_order_relaxed);
+                }
+                for (std::size_t i = 0; i < t.latency.size(); ++i) {
+                    t.latency[i] += c.latency[i].load(std::memory_order_relaxed);
+                }
+                t.latency_ns += c.latency_ns.load(std::memory_order_relaxed);
+            }
+        }
+
+        collectors = _collectors;
+    }
+
+    const auto labels = [this](std::size_t r) {
+        return "method=\"" + escape(_routes[r].method) + "\",route=\""
+            + escape(_routes[r].pattern) + "\"";
+    };
+
+    out << std::setprecision(15);
+
+    header(out, "http_requests_total", "Requests handled, by route and status code.", "counter");
+    for (std::size_t r = 0; r < sums.size(); ++r) {
+        const auto& t = sums[r];
+        for (std::size_t i = 0; i < t.responses.size(); ++i) {
+            if (t.responses[i] > 0) {
+                out << "http_requests_total{" << labels(r) << ",code=\""
+                    << (i < codes.size() ? std::to_string(codes[i]) : "other") << "\"} "
+                    << t.responses[i] << '\n';
+            }
+        }
+    }
+
+    header(out, "http_requests_in_flight", "Requests being handled.", "gauge");
+    for (std::size_t r = 0; r < sums.size(); ++r) {
+        const auto& t = sums[r];
+        std::uint64_t finished = 0;
+        for (const auto n : t.responses) {
+            finished += n;
+        }
+        // Shards are read one after another, the difference can be off
+        // briefly
+        out << "http_requests_in_flight{" << labels(r) << "} "
+            << (t.started > finished ? t.started - finished : 0) << '\n';
+    }
+
+    header(out, "http_request_duration_seconds", "Time to handle a request.", "histogram");
+    for (std::size_t r = 0; r < sums.size(); ++r) {
+        const auto& t = sums[r];
+        std::uint64_t count = 0;
+        for (std::size_t i = 0; i < t.latency.size(); ++i) {
+            count += t.latency[i];
+            out << "http_request_duration_seconds_bucket{" << labels(r) << ",le=\"";
+            if (i < bounds.size()) {
+                out << bounds[i];
+            } else {
+                out << "+Inf";
+            }
+            out << "\"} " << count << '\n';
+        }
+        out << "http_request_duration_seconds_sum{" << labels(r) << "} "
+            << static_cast<double>(t.latency_ns) / 1e9 << '\n'
+            << "http_request_duration_seconds_count{" << labels(r) << "} "
+            << count << '\n';
+    }
+
+    for (const auto& c : collectors) {
+        c(out);
+    }
+}
+
+///
+/// \brief Write a single counter, with its help and type lines.
+///
+void metrics::counter(std::ostream& out, const std::string& name,
+                      const std::string& help, double value)
+{
+    header(out, name, help, "counter");
+    out << name << ' ' << value << '\n';
+}
+
+///
+/// \brief Write a single gauge, with its help and type lines.
+///
+void metrics::gauge(std::ostream& out, const std::string& name,
+                    const std::string& help, double value)
+{
+    header(out, name, help, "gauge");
+    out << name << ' ' << value << '\n';
+}
+
+///
+/// \brief Write the help and type lines of a metric.
+///
+void metrics::header(std::ostream& out, const std::string& name,
+                     const std::string& help, const char* type)
+{
+    out << "# HELP " << name << ' ' << help << '\n'
+        << "# TYPE " << name << ' ' << type << '\n';
+}
+
+///
+/// \brief Write the buckets, sum and count of one series of a histogram.
+///        The help and type lines are written once with metrics::header.
+///
+/// \param labels the labels of the series, e.g., from metrics::label, or ""
+/// \param bounds the upper bounds of all the buckets but the last
+/// \param counts the number of observations in each bucket, not cumulative
+/// \param sum    the sum of all the observations
+///
+void metrics::histogram(std::ostream& out, const std::string& name,
+                        const std::string& labels, const std::vector<double>& bounds,
+                        const std::vector<std::uint64_t>& counts, double sum)
+{
+    const auto separator = labels.empty() ? "" : ",";
+    std::uint64_t count = 0;
+
+    out << std::setprecision(15);
+
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        count += counts[i];
+        out << name << "_bucket{" << labels << separator << "le=\"";
+        if (i < bounds.size()) {
+            out << bounds[i];
+        } else {
+            out << "+Inf";
+        }
+        out << "\"} " << count << '\n';
+    }
+
+    const auto braces = labels.empty() ? std::string{} : "{" + labels + "}";
+
+    out << name << "_sum" << braces << ' ' << sum << '\n'
+        << name << "_count" << braces << ' ' << count << '\n';
+}
+
+///
+/// \returns a label with an escaped value, e.g., `collection="campaigns"`
+///
+std::string metrics::label(const std::string& name, const std::string& value)
+{
+    return name + "=\"" + escape(value) + "\"";
+}
+
+metrics::shard& metrics::local()
+{
+    // Threads may outlive a metrics object, so shards are keyed by the id
+    // of their owner rather than its address. The last one used is looked
+    // up first.
+    thread_local std::uint64_t owner = 0;
+    thread_local shard* s = nullptr;
+    thread_local std::unordered_map<std::uint64_t, shard*> shards{};
+
+    if (_id != owner) {
+        auto& found = shards[_id];
+
+        if (!found) {
+            std::lock_guard<std::mutex> lock{_mutex};
+
+            _shards.push_back(std::make_unique<shard>(_routes.size()));
+            found = _shards.back().get();
+        }
+
+        s = found;
+        owner = _id;
+    }
+
+    return *s;
+}
+
+///
+/// \fn metrics::start
+///
+/// \brief Record that a request for a route has started. Call
+///        metrics::finish on the same thread once the request is done.
+///
+
+///
+/// \fn metrics::finish
+///
+/// \brief Record the status code and duration of a request.
+///
+
+} // namespace http
+} // namespace ops
@@ -0,0 +1,162 @@
+///
+/// \file metrics.h
+///
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ops
+{
+namespace http
+{
+    class metrics
+    {
+    public:
+        using clock     = std::chrono::steady_clock;
+        using collector = std::function<void(std::ostream&)>;
+
+        // Upper bounds of the latency histogram buckets, in seconds
+        static constexpr std::size_t Buckets = 14;
+        static const std::array<double, Buckets - 1> bounds;
+
+        // Status codes counted separately, any other code counts as "other"
+        static constexpr std::array<std::uint16_t, 17> codes = {
+            200, 201, 204, 206, 304, 400, 401, 403, 404, 405, 409, 412, 413, 416,
+            500, 502, 503
+        };
+
+        // Route of the requests which match no registered pattern
+        static constexpr std::size_t Unmatched = 0;
+
+        metrics();
+
+        metrics(const metrics&) = delete;
+        metrics& operator=(const metrics&) = delete;
+
+        std::size_t add_route(const std::string& method, const std::string& pattern);
+
+        void add_collector(collector c);
+
+        void start(std::size_t route);
+        void finish(std::size_t route, std::uint16_t status, clock::duration elapsed);
+
+        void expose(std::ostream& out) const;
+
+        static void counter(std::ostream& out, const std::string& name,
+                            const std::string& help, double value);
+        static void gauge(std::ostream& out, const std::string& name,
+                          const std::string& help, double value);
+        static void header(std::ostream& out, const std::string& name,
+                           const std::string& help, const char* type);
+        static void histogram(std::ostream& out, const std::string& name,
+                              const std::string& labels, const std::vector<double>& bounds,
+                              const std::vector<std::uint64_t>& counts, double sum);
+        static std::string label(const std::string& name, const std::string& value);
+
+    private:
+        struct route
+        {
+            std::string method;
+            std::string pattern;
+        };
+
+        // Written by a single thread, read by scrapes
+        struct counters
+        {
+            std::atomic<std::uint64_t>                                 started;
+            std::array<std::atomic<std::uint64_t>, codes.size() + 1>   responses;
+            std::array<std::atomic<std::uint64_t>, Buckets>            latency;
+            std::atomic<std::uint64_t>                                 latency_ns;
+        };
+
+        struct shard
+        {
+            explicit shard(std::size_t routes) : routes(routes) {}
+
+            std::vector<counters> routes;
+        };
+
+        struct totals
+        {
+            std::uint64_t                                 started;
+            std::array<std::uint64_t, codes.size() + 1>   responses;
+            std::array<std::uint64_t, Buckets>            latency;
+            std::uint64_t                                 latency_ns;
+        };
+
+        shard& local();
+
+        static std::size_t code_slot(std::uint16_t status);
+        static std::size_t bucket(clock::duration elapsed);
+        static void bump(std::atomic<std::uint64_t>& n, std::uint64_t by = 1);
+
+        const std::uint64_t                 _id;
+        std::vector<route>                  _routes;
+        mutable std::mutex                  _mutex;
+        std::vector<std::unique_ptr<shard>> _shards;
+        std::vector<collector>              _collectors;
+    };
+
+    inline void metrics::start(std::size_t route)
+    {
+        auto& s = local();
+
+        if (route < s.routes.size()) {
+            bump(s.routes[route].started);
+        }
+    }
+
+    inline void metrics::finish(std::size_t route, std::uint16_t status, clock::duration elapsed)
+    {
+        auto& s = local();
+
+        if (route < s.routes.size()) {
+            auto& c = s.routes[route];
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+
+            bump(c.responses[code_slot(status)]);
+            bump(c.latency[bucket(elapsed)]);
+            bump(c.latency_ns, ns > 0 ? static_cast<std::uint64_t>(ns) : 0);
+        }
+    }
+
+    inline std::size_t metrics::code_slot(std::uint16_t status)
+    {
+        std::size_t i = 0;
+
+        while (i < codes.size() && codes[i] != status) {
+            ++i;
+        }
+
+        return i;
+    }
+
+    inline std::size_t metrics::bucket(clock::duration elapsed)
+    {
+        const double seconds = std::chrono::duration<double>(elapsed).count();
+        std::size_t i = 0;
+
+        while (i < bounds.size() && seconds > bounds[i]) {
+            ++i;
+        }
+
+        return i;
+    }
+
+    inline void metrics::bump(std::atomic<std::uint64_t>& n, std::uint64_t by)
+    {
+        // Only the owning thread writes, so no read-modify-write is needed
+        n.store(n.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+}
+}
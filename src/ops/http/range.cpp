@@ -0,0 +1,128 @@
+#include "range.h"
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <limits>
+#include <vector>
+
+namespace ops
+{
+namespace http
+{
+
+///
+/// \brief Parse a Range header with a single byte range. Other forms,
+///        including multiple ranges, are ignored and the whole file is sent.
+///
+/// \param header the value of the Range header
+/// \param size   the size of the entity
+/// \param first  set to the first byte of a satisfiable range
+/// \param length set to the length of a satisfiable range
+///
+/// \returns whether the header names a range, and if it can be satisfied
+///
+byte_range parse_range(const std::string& header,
+                       std::size_t size,
+                       std::size_t& first,
+                       std::size_t& length)
+{
+    static const std::string unit{"bytes="};
+
+    if (0 != header.compare(0, unit.size(), unit)
+        || std::string::npos != header.find(','))
+    {
+        return byte_range::none;
+    }
+
+    const auto spec = boost::trim_copy(header.substr(unit.size()));
+    const auto dash = spec.find('-');
+
+    if (std::string::npos == dash) {
+        return byte_range::none;
+    }
+
+    const auto from = boost::trim_copy(spec.substr(0, dash));
+    const auto to   = boost::trim_copy(spec.substr(dash + 1));
+
+    if (std::string::npos != from.find_first_not_of("0123456789")
+        || std::string::npos != to.find_first_not_of("0123456789"))
+    {
+        return byte_range::none;
+    }
+
+    // Positions beyond the end of any file are clamped to the file size
+    const auto position = [](const std::string& digits) -> unsigned long long {
+        return digits.size() > 18
+            ? std::numeric_limits<unsigned long long>::max()
+            : std::stoull(digits);
+    };
+
+    if (from.empty()) {
+        // The last n bytes
+        if (to.empty()) {
+            return byte_range::none;
+        }
+
+        const auto n = position(to);
+
+        if (0 == n || 0 == size) {
+            return byte_range::unsatisfiable;
+        }
+
+        length = static_cast<std::size_t>(std::min<unsigned long long>(n, size));
+        first  = size - length;
+    } else {
+        const auto start = position(from);
+
+        if (start >= size) {
+            return byte_range::unsatisfiable;
+        }
+
+        const auto end = to.empty()
+            ? size - 1
+            : static_cast<std::size_t>(std::min<unsigned long long>(position(to), size - 1));
+
+        if (end < start) {
+            return byte_range::none;
+        }
+
+        first  = static_cast<std::size_t>(start);
+        length = end - first + 1;
+    }
+
+    return byte_range::satisfiable;
+}
+
+///
+/// \returns true if an entity tag is in the list of an If-None-Match
+///          header, using the weak comparison function
+///
+bool etag_matches(const std::string& header, const std::string& etag)
+{
+    if (header.empty()) {
+        return false;
+    }
+
+    std::vector<std::string> tags{};
+    boost::split(tags, header, [](char c) { return ',' == c; });
+
+    for (auto& tag : tags) {
+        boost::trim(tag);
+
+        if ("*" == tag) {
+            return true;
+        }
+
+        if (0 == tag.compare(0, 2, "W/")) {
+            tag.erase(0, 2);
+        }
+
+        if (tag == etag) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace http
+} // namespace ops
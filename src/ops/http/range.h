@@ -0,0 +1,27 @@
+///
+/// \file range.h
+///
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace ops
+{
+namespace http
+{
+    enum class byte_range
+    {
+        none,
+        satisfiable,
+        unsatisfiable
+    };
+
+    byte_range parse_range(const std::string& header,
+                           std::size_t size,
+                           std::size_t& first,
+                           std::size_t& length);
+
+    bool etag_matches(const std::string& header, const std::string& etag);
+}
+}
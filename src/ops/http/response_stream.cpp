@@ -0,0 +1,167 @@
+#include "response_stream.h"
+#include <exception>
+#include <stdexcept>
+#include "../util/logger.h"
+
+namespace ops
+{
+namespace http
+{
+
+///
+/// \class response_stream
+///
+/// \brief JSON response sent with chunked transfer encoding
+///
+/// The response is written incrementally, one value at a time, and is sent
+/// to the client in chunks of about response_stream::ChunkSize bytes while
+/// the rest is still being produced. Writing never waits for the client:
+/// if it reads more slowly than the response is produced, the rest of the
+/// response is queued in memory and sent after the handler has returned, so
+/// a slow client does not hold on to a listener thread. Callers bound the
+/// size of what they stream, e.g. with page::MaxLimit.
+///
+/// Obtain a stream from request::stream_response. Once the stream is
+/// created, the status code and headers have been sent and can no longer be
+/// changed. If the stream is destroyed before response_stream::close is
+/// called, e.g., because an exception was thrown, the connection is aborted
+/// without the final chunk, so the client can not take the truncated body
+/// for a complete response.
+///
+
+///
+/// \brief Start the response.
+///
+/// \param request  the request to reply to
+/// \param response status code and headers of the response
+///
+response_stream::response_stream(const web::http::http_request& request,
+                                 web::http::http_response& response)
+  : _after_key{false},
+    _closed{false}
+{
+    _pending.reserve(ChunkSize);
+
+    // Without a content length, the body is sent with chunked encoding
+    response.set_body(_buffer.create_istream());
+    _reply = request.reply(response).then([](pplx::task<void> sent) {
+        try {
+            sent.get();
+        } catch (const std::exception& error) {
+            util::log::notice("streamed response failed", {{"error", error.what()}});
+        }
+    });
+}
+
+response_stream::~response_stream()
+{
+    if (!_closed) {
+        try {
+            _closed = true;
+            _buffer.close(std::ios_base::out,
+                          std::make_exception_ptr(std::runtime_error{"response aborted"})).wait();
+        } catch (const std::exception& error) {
+            util::log::error("can not close response stream", {{"error", error.what()}});
+        }
+    }
+}
+
+void response_stream::begin_object()
+{
+    separate();
+    _pending += '{';
+    _first.push_back(true);
+}
+
+void response_stream::end_object()
+{
+    _pending += '}';
+    _first.pop_back();
+}
+
+void response_stream::begin_array()
+{
+    separate();
+    _pending += '[';
+    _first.push_back(true);
+}
+
+void response_stream::end_array()
+{
+    _pending += ']';
+    _first.pop_back();
+}
+
+///
+/// \brief Write the name of the next member of the current object.
+///
+void response_stream::key(const std::string& name)
+{
+    separate();
+    _pending += nlohmann::json(name).dump();
+    _pending += ':';
+    _after_key = true;
+}
+
+///
+/// \brief Write a value, as an array element or as the value of the member
+///        named by the previous call to response_stream::key.
+///
+void response_stream::value(const nlohmann::json& j)
+{
+    separate();
+    _pending += j.dump();
+
+    if (_pending.size() >= ChunkSize) {
+        flush();
+    }
+}
+
+///
+/// \brief Send what is left of the response. The client may still be
+///        receiving it when this function returns.
+///
+void response_stream::close()
+{
+    if (_closed) {
+        return;
+    }
+
+    flush();
+
+    _closed = true;
+    _buffer.close(std::ios_base::out).wait();
+}
+
+void response_stream::separate()
+{
+    if (_after_key) {
+        _after_key = false;
+    } else if (!_first.empty()) {
+        if (!_first.back()) {
+            _pending += ',';
+        }
+        _first.back() = false;
+    }
+}
+
+void response_stream::flush()
+{
+    if (_pending.empty()) {
+        return;
+    }
+
+    // Once the reply is done before the body is complete, nobody reads
+    // the rest
+    if (_reply.is_done()) {
+        throw std::runtime_error{"client closed the connection"};
+    }
+
+    // The buffer copies the data, and does not block on the reader
+    _buffer.putn_nocopy(reinterpret_cast<const unsigned char*>(_pending.data()),
+                        _pending.size()).wait();
+    _pending.clear();
+}
+
+} // namespace http
+} // namespace ops
@@ -0,0 +1,54 @@
+///
+/// \file response_stream.h
+///
+#pragma once
+
+#include <cpprest/http_listener.h>
+#include <cpprest/producerconsumerstream.h>
+#include <cstddef>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace ops
+{
+namespace http
+{
+    class response_stream
+    {
+    public:
+        static constexpr std::size_t ChunkSize = 16 * 1024;
+
+        response_stream(const web::http::http_request& request,
+                        web::http::http_response& response);
+
+        ~response_stream();
+
+        response_stream(const response_stream&) = delete;
+        response_stream& operator=(const response_stream&) = delete;
+
+        void begin_object();
+        void end_object();
+        void begin_array();
+        void end_array();
+
+        void key(const std::string& name);
+        void value(const nlohmann::json& j);
+
+        void close();
+
+    private:
+        void separate();
+        void flush();
+
+        using buffer = Concurrency::streams::producer_consumer_buffer<unsigned char>;
+
+        buffer            _buffer;
+        pplx::task<void>  _reply;
+        std::string       _pending;
+        std::vector<bool> _first;
+        bool              _after_key;
+        bool              _closed;
+    };
+}
+}
@@ -1,4 +1,5 @@
 #include "controller.h"
+#include "../../util/logger.h"
 
 namespace ops
 {
@@ -13,32 +14,32 @@ controller::controller()
 
 void controller::get_item(http::request& request)
 {
-    std::cout << "get_item" << std::endl;
+    util::log::debug("get_item is not implemented");
 }
 
 void controller::get(http::request& request)
 {
-    std::cout << "get" << std::endl;
+    util::log::debug("get is not implemented");
 }
 
 void controller::post(http::request& request)
 {
-    std::cout << "post" << std::endl;
+    util::log::debug("post is not implemented");
 }
 
 void controller::put(http::request& request)
 {
-    std::cout << "put" << std::endl;
+    util::log::debug("put is not implemented");
 }
 
 void controller::patch(http::request& request)
 {
-    std::cout << "patch" << std::endl;
+    util::log::debug("patch is not implemented");
 }
 
 void controller::del(http::request& request)
 {
-    std::cout << "del" << std::endl;
+    util::log::debug("del is not implemented");
 }
 
 } // namespace rest
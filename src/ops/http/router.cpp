@@ -0,0 +1,238 @@
+#include "router.h"
+
+namespace ops
+{
+namespace http
+{
+
+namespace
+{
+    bool is_digits(std::string_view segment)
+    {
+        if (segment.empty()) {
+            return false;
+        }
+        for (const char c : segment) {
+            if (c < '0' || c > '9') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool is_hex(std::string_view segment)
+    {
+        if (segment.empty()) {
+            return false;
+        }
+        for (const char c : segment) {
+            if ((c < '0' || c > '9') && (c < 'a' || c > 'f')) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+///
+/// \class router
+///
+/// \brief Segment trie used to dispatch requests to registered routes
+///
+/// URI patterns of the form used throughout the application, e.g.,
+///
+/// \code
+/// ^/campaigns/([0-9a-f]+)/features/([0-9a-f]+)$
+/// \endcode
+///
+/// are compiled into a trie of static path segments and capture segments
+/// (`([0-9a-f]+)` and `([0-9]+)`). Each leaf holds a table of HTTP methods.
+/// Dispatching a path is then linear in the length of the path and does not
+/// involve a regular expression engine. Patterns which use any other regular
+/// expression syntax are rejected by router::add.
+///
+/// Paths are dispatched as the regular expressions would, except that a
+/// path with a line break (sent as `%0A`) is not matched, where `^` and `$`
+/// would match at the line break.
+///
+
+router::router() : _root{}
+{
+}
+
+///
+/// \brief Compile a URI pattern and add it to the trie.
+///
+/// \param method      HTTP method to respond to
+/// \param uri_pattern a regular expression that the request URI must match
+/// \param route       an index which identifies the route in the caller
+///
+/// \returns false if the pattern uses regular expression syntax which the
+///          router does not support, in which case nothing is added
+///
+bool router::add(const std::string& method,
+                 const std::string& uri_pattern,
+                 std::size_t route)
+{
+    std::vector<segment> segments{};
+
+    if (!compile(uri_pattern, segments)) {
+        return false;
+    }
+
+    node* n = &_root;
+
+    for (const auto& seg : segments) {
+        switch (seg.first)
+        {
+        case s_digits:
+            if (!n->digits) {
+                n->digits = std::make_unique<node>();
+            }
+            n = n->digits.get();
+            break;
+        case s_hex:
+            if (!n->hex) {
+                n->hex = std::make_unique<node>();
+            }
+            n = n->hex.get();
+            break;
+        case s_literal:
+        default:
+            auto& child = n->literals[seg.second];
+            if (!child) {
+                child = std::make_unique<node>();
+            }
+            n = child.get();
+        }
+    }
+
+    for (const auto& entry : n->methods) {
+        if (entry.first == method) {
+            // The first registered handler takes precedence
+            return true;
+        }
+    }
+
+    n->methods.emplace_back(method, route);
+    return true;
+}
+
+///
+/// \brief Look up the route which matches the given method and path.
+///
+/// \param method   HTTP method of the request
+/// \param path     decoded request path
+/// \param route    receives the index of the matching route
+/// \param captures receives the full path, followed by the captured segments
+///
+/// \returns true if a matching route was found
+///
+bool router::find(const std::string& method,
+                  const std::string& path,
+                  std::size_t& route,
+                  params& captures) const
+{
+    if (path.empty() || '/' != path.front()) {
+        return false;
+    }
+
+    captures.clear();
+    captures.emplace_back(path);
+
+    return find(_root, method, std::string_view{path}.substr(1), route, captures);
+}
+
+bool router::compile(const std::string& uri_pattern,
+                     std::vector<segment>& segments)
+{
+    std::string_view pattern{uri_pattern};
+
+    if (pattern.size() < 3 || '^' != pattern.front() || '$' != pattern.back()) {
+        return false;
+    }
+
+    pattern = pattern.substr(1, pattern.size() - 2);
+
+    if ('/' != pattern.front()) {
+        return false;
+    }
+
+    pattern.remove_prefix(1);
+
+    while (true)
+    {
+        const auto slash = pattern.find('/');
+        const auto seg = pattern.substr(0, slash);
+
+        if ("([0-9a-f]+)" == seg) {
+            segments.emplace_back(s_hex, std::string{});
+        } else if ("([0-9]+)" == seg) {
+            segments.emplace_back(s_digits, std::string{});
+        } else if (std::string_view::npos == seg.find_first_of("\\^$.|?*+()[]{}")) {
+            segments.emplace_back(s_literal, std::string{seg});
+        } else {
+            return false;
+        }
+
+        if (std::string_view::npos == slash) {
+            break;
+        }
+
+        pattern.remove_prefix(slash + 1);
+    }
+
+    return true;
+}
+
+bool router::find(const node& n,
+                  const std::string& method,
+                  std::string_view path,
+                  std::size_t& route,
+                  params& captures)
+{
+    const auto slash = path.find('/');
+    const bool last = std::string_view::npos == slash;
+    const auto seg = path.substr(0, slash);
+    const auto rest = last ? std::string_view{} : path.substr(slash + 1);
+
+    const auto accept = [&](const node& child) {
+        if (!last) {
+            return find(child, method, rest, route, captures);
+        }
+        for (const auto& entry : child.methods) {
+            if (entry.first == method) {
+                route = entry.second;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    const auto literal = n.literals.find(seg);
+
+    if (n.literals.end() != literal && accept(*literal->second)) {
+        return true;
+    }
+
+    if (n.digits && is_digits(seg)) {
+        captures.emplace_back(seg);
+        if (accept(*n.digits)) {
+            return true;
+        }
+        captures.pop_back();
+    }
+
+    if (n.hex && is_hex(seg)) {
+        captures.emplace_back(seg);
+        if (accept(*n.hex)) {
+            return true;
+        }
+        captures.pop_back();
+    }
+
+    return false;
+}
+
+} // namespace http
+} // namespace ops
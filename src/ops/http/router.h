@@ -0,0 +1,70 @@
+///
+/// \file router.h
+///
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ops
+{
+namespace http
+{
+    class router
+    {
+    public:
+        using params = std::vector<std::string>;
+
+        router();
+
+        router(const router&) = delete;
+        router& operator=(const router&) = delete;
+
+        bool add(const std::string& method,
+                 const std::string& uri_pattern,
+                 std::size_t route);
+
+        bool find(const std::string& method,
+                  const std::string& path,
+                  std::size_t& route,
+                  params& captures) const;
+
+    private:
+        struct node
+        {
+            using literal_map = std::map<std::string, std::unique_ptr<node>, std::less<>>;
+            using method_table = std::vector<std::pair<std::string, std::size_t>>;
+
+            literal_map           literals;
+            std::unique_ptr<node> digits;
+            std::unique_ptr<node> hex;
+            method_table          methods;
+        };
+
+        enum segment_type
+        {
+            s_literal,
+            s_digits,
+            s_hex
+        };
+
+        using segment = std::pair<segment_type, std::string>;
+
+        static bool compile(const std::string& uri_pattern,
+                            std::vector<segment>& segments);
+
+        static bool find(const node& n,
+                         const std::string& method,
+                         std::string_view path,
+                         std::size_t& route,
+                         params& captures);
+
+        node _root;
+    };
+}
+}
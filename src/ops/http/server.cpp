@@ -1,11 +1,34 @@
 #include "server.h"
-#include <cpprest/filestream.h>
+#include <algorithm>
+#include <boost/asio/signal_set.hpp>
+#include <cpprest/rawptrstream.h>
+#include <cerrno>
+#include <csignal>
+#include <sstream>
+#include <system_error>
+#include "../mongodb/update.h"
+#include "range.h"
+#include "../util/logger.h"
 
 namespace ops
 {
 namespace http
 {
 
+namespace
+{
+    template <typename F>
+    class scope_exit
+    {
+    public:
+        explicit scope_exit(F f) : _f{f} {}
+        ~scope_exit() { _f(); }
+
+    private:
+        F _f;
+    };
+}
+
 ///
 /// \class request
 ///
@@ -16,19 +39,32 @@ namespace http
 /// \brief Create a request object.
 ///
 /// \param request original REST SDK request object
-/// \param match   regex results when matching against URL
+/// \param params  the request path, followed by the captured URI parameters
 ///
-request::request(web::http::http_request&& request, const boost::smatch& match)
-  : _match{match},
+request::request(web::http::http_request&& request, router::params&& params)
+  : _uri_params{std::move(params)},
     _params{web::uri::split_query(request.request_uri().query())},
     _request{std::move(request)},
-    _response{web::http::status_codes::OK}
+    _response{web::http::status_codes::OK},
+    _streaming{false}
 {
     web::http::http_headers& headers = _response.headers();
     headers["Access-Control-Allow-Origin"] = "*";
     headers["Content-Type"] = "application/json";
 }
 
+///
+/// \returns the value of the named request header, or an empty string if
+///          the header is not present
+///
+std::string request::get_header(const std::string& name) const
+{
+    const auto& headers = _request.headers();
+    const auto i = headers.find(name);
+
+    return headers.end() != i ? i->second : std::string{};
+}
+
 ///
 /// \brief Extract the request body and pass it to the provided callback.
 ///
@@ -36,7 +72,13 @@ request::request(web::http::http_request&& request, const boost::smatch& match)
 ///
 void request::with_body(std::function<void(const std::string&)> handler)
 {
-    _request.extract_string().then(handler).wait();
+    std::string body{};
+    {
+        trace::scope span{_trace.get(), "with_body"};
+        body = _request.extract_string().get();
+    }
+
+    handler(body);
 }
 
 ///
@@ -47,7 +89,57 @@ void request::with_body(std::function<void(const std::string&)> handler)
 ///
 void request::with_body(std::function<void(const std::vector<unsigned char>&)> handler)
 {
-    _request.extract_vector().then(handler).wait();
+    std::vector<unsigned char> body{};
+    {
+        trace::scope span{_trace.get(), "with_body"};
+        body = _request.extract_vector().get();
+    }
+
+    handler(body);
+}
+
+///
+/// \brief Read the request body in chunks of at most
+///        request::BodyChunkSize bytes, as it arrives, and pass each chunk
+///        to a callback. Only one chunk is held in memory at a time.
+///
+/// \param consumer callback which receives each chunk; the data is only
+///                 valid during the call
+/// \param max_size the largest body accepted
+///
+/// \throws payload_too_large if the body is larger than \a max_size. A
+///         Content-Length over the limit is rejected before anything is
+///         read.
+///
+void request::read_body(std::function<void(const unsigned char*, std::size_t)> consumer,
+                        std::size_t max_size)
+{
+    const auto& headers = _request.headers();
+
+    if (headers.has("Content-Length") && headers.content_length() > max_size) {
+        throw payload_too_large{"request body exceeds " + std::to_string(max_size) + " bytes"};
+    }
+
+    auto body = _request.body().streambuf();
+
+    std::vector<unsigned char> chunk(BodyChunkSize);
+    std::size_t total = 0;
+
+    for (;;) {
+        const std::size_t n = body.getn(chunk.data(), chunk.size()).get();
+
+        if (0 == n) {
+            break;
+        }
+
+        total += n;
+
+        if (total > max_size) {
+            throw payload_too_large{"request body exceeds " + std::to_string(max_size) + " bytes"};
+        }
+
+        consumer(chunk.data(), n);
+    }
 }
 
 ///
@@ -82,6 +174,13 @@ void request::send_error_response(web::http::status_code code,
                                   const std::string& tag,
                                   const std::string& error)
 {
+    if (_streaming) {
+        // The status line has already been sent, the client sees a
+        // truncated body instead
+        util::log::error("error in streamed response", {{"error", error}});
+        return;
+    }
+
     nlohmann::json response{};
     response["status"] = code;
     response["error"] = error;
@@ -90,15 +189,147 @@ void request::send_error_response(web::http::status_code code,
     send_response(response.dump());
 }
 
-void request::send_media_response(const std::string& file, const std::string& format)
+///
+/// \brief Send a file from the local file system, or a 404 response if it
+///        does not exist.
+///
+/// \param file      path to the file
+/// \param format    the media type of the file
+/// \param immutable true if the contents behind this URI never change
+///
+/// \sa request::send_media_response(std::shared_ptr<const util::mapped_file>, const std::string&, bool)
+///
+void request::send_media_response(const std::string& file,
+                                  const std::string& format,
+                                  bool immutable)
 {
-    using namespace Concurrency::streams;
+    std::shared_ptr<const util::mapped_file> mapped{};
 
-    file_stream<unsigned char>::open_istream(file)
-        .then([this, format](const basic_istream<unsigned char>& istream) {
-            _request.reply(web::http::status_codes::OK, istream, format);
-        })
-        .wait();
+    try {
+        mapped = std::make_shared<const util::mapped_file>(file);
+    } catch (const std::system_error& error) {
+        if (ENOENT == error.code().value()) {
+            send_error_response(404, "NOT_FOUND", "Not found");
+            return;
+        }
+        throw;
+    }
+
+    send_media_response(std::move(mapped), format, immutable);
+}
+
+///
+/// \brief Send a memory-mapped file.
+///
+/// The response carries a strong ETag, and honors `If-None-Match` (304 Not
+/// Modified) and single byte ranges in `Range` (206 Partial Content, or 416
+/// Range Not Satisfiable), subject to `If-Range`. The body is read straight
+/// from the mapping, which is kept alive until the response has been sent;
+/// this function does not wait for that.
+///
+/// \param file      the mapped file
+/// \param format    the media type of the file
+/// \param immutable true if the contents behind this URI never change, so
+///                  that clients and proxies may cache them indefinitely
+/// \param offset    where the response body starts in the file, e.g., the
+///                  first audio frame after a seek position. Ranges are
+///                  relative to this offset.
+///
+void request::send_media_response(std::shared_ptr<const util::mapped_file> file,
+                                  const std::string& format,
+                                  bool immutable,
+                                  std::size_t offset)
+{
+    using namespace web::http;
+
+    if (offset > file->size()) {
+        throw std::invalid_argument{"bad media offset"};
+    }
+
+    const std::size_t size = file->size() - offset;
+
+    // The tail of a file is a different entity than the whole file
+    std::string etag = file->etag();
+
+    if (offset > 0) {
+        etag.insert(etag.size() - 1, "-" + std::to_string(offset));
+    }
+
+    http_headers& headers = _response.headers();
+    headers["ETag"] = etag;
+    headers["Accept-Ranges"] = "bytes";
+    headers["Cache-Control"] = immutable
+        ? "public, max-age=31536000, immutable"
+        : "no-cache";
+
+    if (etag_matches(get_header("If-None-Match"), etag)) {
+        _response.set_status_code(status_codes::NotModified);
+        _request.reply(_response);
+        return;
+    }
+
+    std::size_t first  = 0;
+    std::size_t length = size;
+
+    const auto range    = get_header("Range");
+    const auto if_range = get_header("If-Range");
+
+    if (!range.empty() && (if_range.empty() || if_range == etag)) {
+        switch (parse_range(range, size, first, length))
+        {
+        case byte_range::satisfiable:
+            _response.set_status_code(status_codes::PartialContent);
+            headers["Content-Range"] = "bytes " + std::to_string(first) + "-"
+                + std::to_string(first + length - 1) + "/" + std::to_string(size);
+            break;
+        case byte_range::unsatisfiable:
+            _response.set_status_code(status_codes::RangeNotSatisfiable);
+            headers["Content-Range"] = "bytes */" + std::to_string(size);
+            _request.reply(_response);
+            return;
+        case byte_range::none:
+        default:
+            break;
+        }
+    }
+
+    // set_body keeps the JSON content type preset by the constructor
+    headers["Content-Type"] = format;
+
+    if (0 == length) {
+        _response.set_body(std::string{}, format);
+        _request.reply(_response);
+        return;
+    }
+
+    Concurrency::streams::rawptr_buffer<unsigned char> buffer{
+        file->data() + offset + first, length, std::ios::in};
+
+    _response.set_body(buffer.create_istream(), length, format);
+
+    _request.reply(_response).then([file](pplx::task<void> sent) {
+        try {
+            sent.get();
+        } catch (const std::exception& error) {
+            util::log::notice("media response failed", {{"error", error.what()}});
+        }
+    });
+}
+
+///
+/// \brief Start a JSON response which is written incrementally and sent with
+///        chunked transfer encoding, using the status code and headers set so
+///        far.
+///
+/// \returns the stream to write the response body to
+///
+/// \sa response_stream
+///
+response_stream request::stream_response()
+{
+    _streaming = true;
+
+    return response_stream{_request, _response};
 }
 
 ///
@@ -155,14 +386,31 @@ server::server(const uint16_t port,
   : _port{port},
     _scheme{scheme},
     _host{host},
-    _path{path}
+    _path{path},
+    _stopping{false},
+    _in_flight{0},
+    _shutdown_timeout{std::chrono::seconds{30}}
 {
+    on(web::http::methods::GET, "^/metrics$", [this](http::request& req) {
+        send_metrics(req);
+    });
 }
 
 ///
 /// \brief Run the server.
 ///
-void server::run()
+/// Blocks until the process receives SIGINT or SIGTERM, or until server::stop
+/// is called, and then shuts the server down gracefully.
+///
+/// \returns false if requests were still being handled when the shutdown
+///          timeout expired. Their handlers may still be running, so the
+///          controllers and the server must not be destroyed; the caller
+///          should end the process without running destructors, e.g., with
+///          std::quick_exit.
+///
+/// \sa server::shutdown
+///
+bool server::run()
 {
     using namespace web::http;
 
@@ -188,14 +436,28 @@ void server::run()
         request.reply(response);
     });
 
+    boost::asio::signal_set signals{_io, SIGINT, SIGTERM};
+
+    signals.async_wait([](const boost::system::error_code& error, int signal) {
+        if (!error) {
+            util::log::info("received signal, shutting down", {{"signal", signal}});
+        }
+    });
+
     try {
         _listener.open()
-                 .then([this]() { std::cout << "Listening on port " << _port << "..." << std::endl; })
+                 .then([this]() { util::log::info("listening", {{"port", _port}}); })
                  .wait();
-        while (true);
+
+        // Sleep until a signal arrives or stop() is called
+        _io.run();
+
+        return shutdown();
     } catch (const std::exception& e) {
-        std::cout << e.what() << std::endl;
+        util::log::error("server failed", {{"error", e.what()}});
     }
+
+    return true;
 }
 
 ///
@@ -203,16 +465,78 @@ void server::run()
 ///
 /// \param port the port number to listen on
 ///
-void server::run(const uint16_t port)
+bool server::run(const uint16_t port)
 {
     set_port(port);
 
-    run();
+    return run();
+}
+
+///
+/// \brief Ask a running server to shut down.
+///
+/// This function is thread-safe and returns immediately. The call to
+/// server::run returns once the shutdown has completed.
+///
+void server::stop()
+{
+    _io.stop();
+}
+
+///
+/// \brief Stop accepting requests, wait for requests which are already being
+///        handled, and then run the shutdown hooks.
+///
+/// Requests which arrive after shutdown has started receive a 503 response.
+/// If in-flight requests have not finished when the shutdown timeout
+/// expires, the server gives up waiting for them, and the shutdown hooks are
+/// not run, since they release state which the handlers still use.
+///
+/// \returns true if all requests finished in time
+///
+/// \sa server::set_shutdown_timeout, server::on_shutdown
+///
+bool server::shutdown()
+{
+    _stopping = true;
+
+    auto closed = _listener.close();
+
+    bool drained;
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        drained = _drained.wait_for(lock, _shutdown_timeout, [this]() {
+            return 0 == _in_flight;
+        });
+    }
+
+    if (!drained) {
+        util::log::warning("shutdown timeout expired",
+            {{"in_flight", _in_flight.load()}});
+        return false;
+    }
+
+    closed.wait();
+
+    for (const auto& hook : _shutdown_hooks) {
+        try {
+            hook();
+        } catch (const std::exception& error) {
+            util::log::error("shutdown hook failed", {{"error", error.what()}});
+        }
+    }
+
+    return true;
 }
 
 ///
 /// \brief Register a request handler.
 ///
+/// Patterns built from static path segments and the `([0-9a-f]+)` and
+/// `([0-9]+)` capture groups are compiled into the router. Other patterns
+/// are kept as regular expressions and only tried when the router finds no
+/// match.
+///
 /// \param method      HTTP method to respond to
 /// \param uri_pattern a regular expression that the request URI must match
 /// \param handler     a callback which will be used to handle the request
@@ -221,71 +545,163 @@ void server::on(web::http::method method,
                 const std::string& uri_pattern,
                 request::handler handler)
 {
-    request::route route{method, boost::regex{uri_pattern}, handler};
-    _routes.emplace_back(route);
+    const std::size_t index = _routes.size();
+
+    _routes.emplace_back(request::route{method, uri_pattern, handler});
+
+    // The metrics of route n are at n + 1, after metrics::Unmatched
+    _metrics.add_route(method, uri_pattern);
+
+    if (!_router.add(method, uri_pattern, index)) {
+        _regex_routes.emplace_back(index, boost::regex{uri_pattern});
+    }
 }
 
 void server::handle_request(web::http::http_request request)
 {
-    auto path = web::http::uri::decode(request.relative_uri().path());
+    // The counter is incremented before the flag is checked so that shutdown()
+    // never misses a request which got past the check.
+    ++_in_flight;
+
+    const auto done = [this]() {
+        if (0 == --_in_flight) {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _drained.notify_all();
+        }
+    };
+
+    const scope_exit<decltype(done)> in_flight{done};
+
+    const auto started = metrics::clock::now();
+
+    if (_stopping) {
+        _metrics.start(metrics::Unmatched);
+        http::request req{std::move(request), router::params{}};
+        req.send_error_response(503, "SERVICE_UNAVAILABLE", "Server is shutting down");
+        _metrics.finish(metrics::Unmatched, 503, metrics::clock::now() - started);
+        return;
+    }
+
+    const auto path = web::http::uri::decode(request.relative_uri().path());
+    const auto method = request.method();
+
+    router::params params{};
+    std::size_t index = 0;
+
+    if (!_router.find(method, path, index, params)
+        && !match_regex(method, path, index, params))
+    {
+        // send 404 response
+        _metrics.start(metrics::Unmatched);
+        http::request req{std::move(request), std::move(params)};
+        req.send_error_response(404, "NOT_FOUND", "Not found");
+        _metrics.finish(metrics::Unmatched, 404, metrics::clock::now() - started);
+        return;
+    }
+
+    const auto& route = _routes[index];
+
+    _metrics.start(index + 1);
+
+    http::request req{std::move(request), std::move(params)};
+
+    req.set_trace(_tracer.start(route.method + " " + route.pattern));
+
+    try {
+        route.handler(req);
+    //} catch (const web::json::json_exception& error) {
+    //    req.send_error_response(400, "BAD_JSON", error.what());
+    //} catch (const mongocxx::exception& error) {
+    //    switch (error.code().value())
+    //    {
+    //    case 13053:
+    //        req.send_error_response(502, "BAD_GATEWAY",
+    //            "No suitable servers found. Is mongod running?");
+    //        break;
+    //    case 11000:
+    //        req.send_error_response(409, "DUPLICATE_KEY",
+    //            "Duplicate key error.");
+    //        break;
+    //    default:
+    //        req.send_error_response(500, "INTERNAL_SERVER_ERROR",
+    //            error.what());
+    //    }
+    //} catch (const ops::model_error& error) {
+    //    switch (error.type())
+    //    {
+    //    case model_error::validation_error:
+    //        req.send_error_response(400, "VALIDATION_FAILED", error.json_data());
+    //        break;
+    //    case model_error::document_not_found:
+    //        req.send_error_response(404, "NOT_FOUND", "No such document");
+    //        break;
+    //    case model_error::bad_oid:
+    //        req.send_error_response(400, "BAD_OID", "Bad ObjectId");
+    //        break;
+    //    case model_error::bad_bson_data:
+    //    default:
+    //        req.send_error_response(400, "BAD_BSON", "Not a valid document");
+    //    }
+    } catch (const std::invalid_argument& error) {
+        req.send_error_response(400, "BAD_REQUEST", error.what());
+    } catch (const mongodb::version_conflict& error) {
+        req.send_error_response(412, "PRECONDITION_FAILED", error.what());
+    } catch (const payload_too_large& error) {
+        req.send_error_response(413, "PAYLOAD_TOO_LARGE", error.what());
+    } catch (const conflict& error) {
+        req.send_error_response(409, "CONFLICT", error.what());
+    } catch (const std::exception& error) {
+        util::log::error("request failed", {{"route", route.pattern}, {"error", error.what()}});
+        req.send_error_response(500, "INTERNAL_SERVER_ERROR", error.what());
+    }
+
+    _metrics.finish(index + 1, req.status_code(), metrics::clock::now() - started);
+
+    if (req.trace()) {
+        _tracer.finish(*req.trace(), req.status_code());
+    }
+}
+
+///
+/// \brief Send the metrics of all the routes, and of the scrape hooks, in the
+///        Prometheus text format.
+///
+/// \sa server::on_scrape
+///
+void server::send_metrics(http::request& req) const
+{
+    std::ostringstream out{};
+    _metrics.expose(out);
+
+    req.set_header("Content-Type", "text/plain; version=0.0.4");
+    req.send_response(out.str());
+}
+
+///
+/// \brief Match the path against the routes which could not be compiled into
+///        the router, in the order in which they were registered.
+///
+bool server::match_regex(const web::http::method& method,
+                         const std::string& path,
+                         std::size_t& route,
+                         router::params& params) const
+{
     boost::smatch match{};
 
-    for (const auto& route : _routes) {
-        if (request.method() == route.method
-            && boost::regex_search(path, match, route.pattern))
+    for (const auto& entry : _regex_routes) {
+        if (method == _routes[entry.first].method
+            && boost::regex_search(path, match, entry.second))
         {
-            http::request req{std::move(request), match};
-
-            try {
-                route.handler(req);
-                return;
-            //} catch (const web::json::json_exception& error) {
-            //    req.send_error_response(400, "BAD_JSON", error.what());
-            //    return;
-            //} catch (const mongocxx::exception& error) {
-            //    switch (error.code().value())
-            //    {
-            //    case 13053:
-            //        req.send_error_response(502, "BAD_GATEWAY",
-            //            "No suitable servers found. Is mongod running?");
-            //        break;
-            //    case 11000:
-            //        req.send_error_response(409, "DUPLICATE_KEY",
-            //            "Duplicate key error.");
-            //        break;
-            //    default:
-            //        req.send_error_response(500, "INTERNAL_SERVER_ERROR",
-            //            error.what());
-            //    }
-            //    return;
-            //} catch (const ops::model_error& error) {
-            //    switch (error.type())
-            //    {
-            //    case model_error::validation_error:
-            //        req.send_error_response(400, "VALIDATION_FAILED", error.json_data());
-            //        break;
-            //    case model_error::document_not_found:
-            //        req.send_error_response(404, "NOT_FOUND", "No such document");
-            //        break;
-            //    case model_error::bad_oid:
-            //        req.send_error_response(400, "BAD_OID", "Bad ObjectId");
-            //        break;
-            //    case model_error::bad_bson_data:
-            //    default:
-            //        req.send_error_response(400, "BAD_BSON", "Not a valid document");
-            //    }
-            //    return;
-            } catch (const std::exception& error) {
-                std::cout << error.what() << std::endl;
-                req.send_error_response(500, "INTERNAL_SERVER_ERROR", error.what());
-                return;
+            params.clear();
+            for (std::size_t i = 0; i < match.size(); ++i) {
+                params.emplace_back(match.str(i));
             }
+            route = entry.first;
+            return true;
         }
     }
 
-    // send 404 response
-    http::request req{std::move(request), match};
-    req.send_error_response(404, "NOT_FOUND", "Not found");
+    return false;
 }
 
 ///
@@ -297,5 +713,42 @@ void server::handle_request(web::http::http_request request)
 /// \param port the port number
 ///
 
+///
+/// \fn server::set_shutdown_timeout
+///
+/// \brief Configure how long a shutdown waits for in-flight requests to
+///        complete (30 seconds by default).
+///
+/// \param timeout the deadline for draining in-flight requests
+///
+
+///
+/// \fn server::set_trace_options
+///
+/// \brief Configure which requests are traced, and where their traces go.
+///        Call before server::run.
+///
+/// \sa tracer
+///
+
+///
+/// \fn server::on_shutdown
+///
+/// \brief Register a function to run, in order of registration, after the
+///        server has stopped handling requests, e.g., to flush buffered
+///        database writes.
+///
+/// \param hook the function to run during shutdown
+///
+
+///
+/// \fn server::on_scrape
+///
+/// \brief Register a function which adds metrics to the response of
+///        `GET /metrics`, e.g., the state of a cache.
+///
+/// \param collector the function, which writes in the Prometheus text format
+///
+
 } // namespace http
 } // namespace ops
@@ -3,13 +3,26 @@
 ///
 #pragma once
 
+#include <atomic>
+#include <boost/asio/io_context.hpp>
 #include <boost/regex.hpp>
+#include <chrono>
+#include <condition_variable>
 #include <cpprest/http_listener.h>
 #include <cstdint>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
+#include "../util/mapped_file.h"
+#include "metrics.h"
+#include "response_stream.h"
+#include "router.h"
+#include "trace.h"
 
 namespace ops
 {
@@ -17,51 +30,93 @@ namespace http
 {
     using query_params = std::map<std::string, std::string>;
 
+    ///
+    /// Thrown when a request body is larger than the handler accepts.
+    ///
+    class payload_too_large : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    ///
+    /// Thrown when a request conflicts with the current state of a resource,
+    /// e.g., a delete of something which is still in use.
+    ///
+    class conflict : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
     class request
     {
     public:
         using handler = std::function<void(http::request&)>;
 
+        static constexpr std::size_t BodyChunkSize = 64 * 1024;
+
         struct route
         {
             web::http::method method;
-            boost::regex      pattern;
+            std::string       pattern;
             request::handler  handler;
         };
 
-        request(web::http::http_request&& request, const boost::smatch& match);
+        request(web::http::http_request&& request, router::params&& params);
 
         std::string get_uri_param(size_t n) const;
+        std::string get_header(const std::string& name) const;
 
         template <typename T>
         T get_query_param(const std::string& name,
                           const T& def) const;
 
         void set_status_code(web::http::status_code code);
+        web::http::status_code status_code() const;
+
+        void set_header(const std::string& name, const std::string& value);
+
+        void set_trace(std::unique_ptr<http::trace> t);
+        http::trace* trace() const;
 
         void with_body(std::function<void(const std::string&)> handler);
         void with_body(std::function<void(const std::vector<unsigned char>&)> handler);
 
+        void read_body(std::function<void(const unsigned char*, std::size_t)> consumer,
+                       std::size_t max_size);
+
         void send_response(const std::string& body = "");
         void send_response(const nlohmann::json& j);
         void send_error_response(web::http::status_code code,
                                  const std::string& tag,
                                  const std::string& error);
 
-        void send_media_response(const std::string& file, const std::string& format);
+        void send_media_response(const std::string& file,
+                                 const std::string& format,
+                                 bool immutable = false);
+
+        void send_media_response(std::shared_ptr<const util::mapped_file> file,
+                                 const std::string& format,
+                                 bool immutable = false,
+                                 std::size_t offset = 0);
+
+        response_stream stream_response();
 
     private:
         template <typename T> T type_conv(const std::string& str) const;
 
-        boost::smatch            _match;
-        query_params             _params;
-        web::http::http_request  _request;
-        web::http::http_response _response;
+        router::params               _uri_params;
+        query_params                 _params;
+        web::http::http_request      _request;
+        web::http::http_response     _response;
+        bool                         _streaming;
+        std::unique_ptr<http::trace> _trace;
     };
 
     inline std::string request::get_uri_param(size_t n) const
     {
-        return _match.str(n);
+        return n < _uri_params.size() ? _uri_params[n] : std::string{};
     }
 
     template <typename T>
@@ -79,6 +134,26 @@ namespace http
         _response.set_status_code(code);
     }
 
+    inline web::http::status_code request::status_code() const
+    {
+        return _response.status_code();
+    }
+
+    inline void request::set_header(const std::string& name, const std::string& value)
+    {
+        _response.headers()[name] = value;
+    }
+
+    inline void request::set_trace(std::unique_ptr<http::trace> t)
+    {
+        _trace = std::move(t);
+    }
+
+    inline http::trace* request::trace() const
+    {
+        return _trace.get();
+    }
+
     template <typename T>
     T request::type_conv(const std::string& str) const
     {
@@ -112,10 +187,16 @@ namespace http
         server(const server&) = delete;
         server& operator=(const server&) = delete;
 
-        void run();
-        void run(const uint16_t port);
+        bool run();
+        bool run(const uint16_t port);
+        void stop();
 
         void set_port(const uint16_t port);
+        void set_shutdown_timeout(std::chrono::milliseconds timeout);
+        void set_trace_options(const trace_options& opts);
+
+        void on_shutdown(std::function<void()> hook);
+        void on_scrape(http::metrics::collector collector);
 
         void on(web::http::method method,
                 const std::string& uri_pattern,
@@ -125,17 +206,59 @@ namespace http
         void handle_request(web::http::http_request request);
 
     private:
+        bool shutdown();
+        void send_metrics(http::request& req) const;
+
+        bool match_regex(const web::http::method& method,
+                         const std::string& path,
+                         std::size_t& route,
+                         router::params& params) const;
+
+        using regex_route = std::pair<std::size_t, boost::regex>;
+        using hook_list   = std::vector<std::function<void()>>;
+
         http_listener               _listener;
         uint16_t                    _port;
         std::string                 _scheme;
         std::string                 _host;
         std::string                 _path;
         std::vector<request::route> _routes;
+        http::router                _router;
+        std::vector<regex_route>    _regex_routes;
+        boost::asio::io_context     _io;
+        std::atomic<bool>           _stopping;
+        std::atomic<std::size_t>    _in_flight;
+        std::mutex                  _mutex;
+        std::condition_variable     _drained;
+        std::chrono::milliseconds   _shutdown_timeout;
+        hook_list                   _shutdown_hooks;
+        http::metrics               _metrics;
+        http::tracer                _tracer;
     };
 
     inline void server::set_port(const uint16_t port)
     {
         _port = port;
     }
+
+    inline void server::set_shutdown_timeout(std::chrono::milliseconds timeout)
+    {
+        _shutdown_timeout = timeout;
+    }
+
+    inline void server::set_trace_options(const trace_options& opts)
+    {
+        _tracer.configure(opts);
+    }
+
+    inline void server::on_shutdown(std::function<void()> hook)
+    {
+        _shutdown_hooks.emplace_back(std::move(hook));
+    }
+
+    inline void server::on_scrape(http::metrics::collector collector)
+    {
+        _metrics.add_collector(std::move(collector));
+    }
 }
 }
@@ -0,0 +1,214 @@
+#include "trace.h"
+#include <atomic>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../util/logger.h"
+
+namespace ops
+{
+namespace http
+{
+
+namespace
+{
+    double milliseconds(trace::clock::duration d)
+    {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+    std::int64_t microseconds(trace::clock::duration d)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    }
+
+    ///
+    /// \returns a small number which identifies the calling thread in trace
+    ///          files
+    ///
+    std::uint32_t thread_number()
+    {
+        static std::atomic<std::uint32_t> next{0};
+        thread_local const std::uint32_t number = ++next;
+
+        return number;
+    }
+
+    void write_event(std::ostream& out, const std::string& name,
+                     trace::clock::time_point start, trace::clock::duration duration,
+                     std::uint32_t pid, std::uint32_t tid)
+    {
+        std::string escaped{};
+        for (const char c : name) {
+            if ('\\' == c || '"' == c) {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+
+        out << "{\"name\":\"" << escaped << "\",\"ph\":\"X\",\"ts\":"
+            << microseconds(start.time_since_epoch()) << ",\"dur\":" << microseconds(duration)
+            << ",\"pid\":" << pid << ",\"tid\":" << tid << "},\n";
+    }
+}
+
+///
+/// \class trace
+///
+/// \brief Timings of the stages of a single request
+///
+/// A trace is created by the server for a sampled request and handed to the
+/// handler with the request, see request::trace. Handlers time their stages
+/// with trace::scope, which does nothing when the request is not traced:
+///
+///     ops::http::trace::scope span{request.trace(), "session.upsert"};
+///
+/// Spans may nest, and are kept in the order in which they were opened.
+///
+
+///
+/// \brief Start a trace, and the span which covers the whole request.
+///
+trace::trace(std::string name)
+  : _name{std::move(name)},
+    _start{clock::now()},
+    _duration{clock::duration::zero()},
+    _depth{0}
+{
+    _spans.reserve(16);
+}
+
+///
+/// \brief End the span which covers the whole request.
+///
+void trace::finish()
+{
+    _duration = clock::now() - _start;
+}
+
+///
+/// \returns a single line with the duration of the request and of each of
+///          its spans, in milliseconds
+///
+std::string trace::summary() const
+{
+    std::ostringstream out{};
+    out << std::fixed << std::setprecision(3) << _name << " " << milliseconds(_duration) << " ms";
+
+    for (std::size_t i = 0; i < _spans.size(); ++i) {
+        const auto& s = _spans[i];
+        out << (0 == i ? ": " : ", ") << std::string(2 * s.depth, '.') << s.name
+            << " " << milliseconds(s.duration) << " ms";
+    }
+
+    return out.str();
+}
+
+///
+/// \brief Write the request and its spans as complete events ("ph": "X") of
+///        the Chrome trace event format, each followed by a comma.
+///
+void trace::write_events(std::ostream& out, std::uint32_t pid, std::uint32_t tid) const
+{
+    write_event(out, _name, _start, _duration, pid, tid);
+
+    for (const auto& s : _spans) {
+        write_event(out, s.name, s.start, s.duration, pid, tid);
+    }
+}
+
+///
+/// \class tracer
+///
+/// \brief Decides which requests are traced, and reports their traces
+///
+/// A share of the requests, given by trace_options::sample_rate, is traced.
+/// Traces which take longer than trace_options::slow are logged, and all
+/// traces are appended to trace_options::file if it is set. The file is in
+/// the JSON array form of the Chrome trace event format, which allows the
+/// closing bracket to be left out, so it can be loaded into
+/// `chrome://tracing` or Perfetto at any time.
+///
+
+tracer::tracer() : _options{}
+{
+}
+
+///
+/// \brief Set the sampling rate and the outputs. Call before the server
+///        runs.
+///
+void tracer::configure(const trace_options& opts)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    _options = opts;
+
+    if (_file.is_open()) {
+        _file.close();
+    }
+
+    if (!_options.file.empty()) {
+        struct stat st{};
+        const bool empty = 0 != ::stat(_options.file.c_str(), &st) || 0 == st.st_size;
+
+        _file.open(_options.file, std::ios::out | std::ios::app);
+
+        if (!_file) {
+            util::log::notice("can not open trace file", {{"file", _options.file}});
+        } else if (empty) {
+            _file << "[\n";
+        }
+    }
+}
+
+///
+/// \returns a new trace, or nullptr if the request is not sampled
+///
+std::unique_ptr<trace> tracer::start(const std::string& name) const
+{
+    const double rate = _options.sample_rate;
+
+    if (rate <= 0) {
+        return nullptr;
+    }
+
+    if (rate < 1) {
+        thread_local std::minstd_rand random{std::random_device{}()};
+        thread_local std::uniform_real_distribution<double> uniform{0, 1};
+
+        if (uniform(random) >= rate) {
+            return nullptr;
+        }
+    }
+
+    return std::make_unique<trace>(name);
+}
+
+///
+/// \brief Finish a trace and report it.
+///
+/// \param t      the trace
+/// \param status the status code of the response
+///
+void tracer::finish(trace& t, std::uint16_t status)
+{
+    t.finish();
+
+    if (_options.slow.count() > 0 && t.duration() >= _options.slow) {
+        util::log::warning("slow request", {{"status", status}, {"trace", t.summary()}});
+    }
+
+    if (!_options.file.empty()) {
+        std::ostringstream events{};
+        t.write_events(events, static_cast<std::uint32_t>(::getpid()), thread_number());
+
+        std::lock_guard<std::mutex> lock{_mutex};
+        _file << events.str() << std::flush;
+    }
+}
+
+} // namespace http
+} // namespace ops
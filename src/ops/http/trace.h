@@ -0,0 +1,141 @@
+///
+/// \file trace.h
+///
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ops
+{
+namespace http
+{
+    struct trace_options
+    {
+        double                    sample_rate = 0;
+        std::chrono::milliseconds slow        = std::chrono::milliseconds{0};
+        std::string               file        = "";
+    };
+
+    class trace
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        struct span
+        {
+            const char*       name;
+            clock::time_point start;
+            clock::duration   duration;
+            std::uint32_t     depth;
+        };
+
+        class scope
+        {
+        public:
+            scope(trace* t, const char* name);
+            ~scope();
+
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+
+        private:
+            trace*      _trace;
+            std::size_t _index;
+        };
+
+        explicit trace(std::string name);
+
+        trace(const trace&) = delete;
+        trace& operator=(const trace&) = delete;
+
+        void finish();
+
+        const std::string& name() const;
+        clock::duration duration() const;
+        const std::vector<span>& spans() const;
+
+        std::string summary() const;
+        void write_events(std::ostream& out, std::uint32_t pid, std::uint32_t tid) const;
+
+    private:
+        std::size_t open(const char* name);
+        void close(std::size_t index);
+
+        std::string       _name;
+        clock::time_point _start;
+        clock::duration   _duration;
+        std::vector<span> _spans;
+        std::uint32_t     _depth;
+    };
+
+    class tracer
+    {
+    public:
+        tracer();
+
+        tracer(const tracer&) = delete;
+        tracer& operator=(const tracer&) = delete;
+
+        void configure(const trace_options& opts);
+
+        std::unique_ptr<trace> start(const std::string& name) const;
+        void finish(trace& t, std::uint16_t status);
+
+    private:
+        trace_options _options;
+        std::mutex    _mutex;
+        std::ofstream _file;
+    };
+
+    inline trace::scope::scope(trace* t, const char* name)
+      : _trace{t},
+        _index{t ? t->open(name) : 0}
+    {
+    }
+
+    inline trace::scope::~scope()
+    {
+        if (_trace) {
+            _trace->close(_index);
+        }
+    }
+
+    inline std::size_t trace::open(const char* name)
+    {
+        _spans.push_back(span{name, clock::now(), clock::duration::zero(), _depth++});
+
+        return _spans.size() - 1;
+    }
+
+    inline void trace::close(std::size_t index)
+    {
+        auto& s = _spans[index];
+
+        s.duration = clock::now() - s.start;
+        --_depth;
+    }
+
+    inline const std::string& trace::name() const
+    {
+        return _name;
+    }
+
+    inline trace::clock::duration trace::duration() const
+    {
+        return _duration;
+    }
+
+    inline const std::vector<trace::span>& trace::spans() const
+    {
+        return _spans;
+    }
+}
+}
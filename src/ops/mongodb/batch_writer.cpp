@@ -0,0 +1,189 @@
+#include "batch_writer.h"
+#include <mongocxx/collection.hpp>
+#include <mongocxx/options/insert.hpp>
+#include <stdexcept>
+#include "pool.h"
+
+namespace ops
+{
+namespace mongodb
+{
+
+///
+/// \class batch_writer
+///
+/// \brief Group commit for append-only collections
+///
+/// Documents are buffered and written by a background thread with one
+/// insert_many per batch. A batch is written as soon as it holds
+/// options::max_batch documents, or options::max_delay after its first
+/// document was appended, whichever comes first. While a batch is being
+/// written the next one fills up, so batches grow with the load.
+///
+/// Callers are told when their document is durable through the future
+/// returned by batch_writer::append:
+///
+/// \code
+/// ops::mongodb::batch_writer events{"events"};
+///
+/// events.write(make_document(kvp("status", "completed"))); // blocks
+/// \endcode
+///
+
+///
+/// \brief Create a writer which inserts into the given collection.
+///
+batch_writer::batch_writer(const std::string& collection, const options& opts)
+  : batch_writer{[collection](documents& docs) {
+        mongocxx::options::insert insert_options{};
+        insert_options.ordered(false);
+
+        auto lease = pool::instance().acquire();
+        lease.collection(collection).insert_many(docs, insert_options);
+    }, opts}
+{
+}
+
+///
+/// \brief Create a writer which passes each batch to \a s.
+///
+batch_writer::batch_writer(sink s, const options& opts)
+  : _sink{std::move(s)},
+    _options{opts},
+    _stopping{false},
+    _stats{0, 0, 0}
+{
+    _thread = std::thread{&batch_writer::run, this};
+}
+
+batch_writer::~batch_writer()
+{
+    stop();
+}
+
+///
+/// \brief Buffer a document for writing.
+///
+/// \returns a future which becomes ready when the batch containing the
+///          document has been written, or holds the error if it failed
+///
+/// \throws std::runtime_error if the writer has been stopped
+///
+std::shared_future<void> batch_writer::append(bsoncxx::document::value doc)
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+
+    if (_stopping) {
+        throw std::runtime_error{"batch writer has been stopped"};
+    }
+
+    bool notify = false;
+
+    if (!_current) {
+        _current = std::make_unique<batch>();
+        _current->docs.reserve(_options.max_batch);
+        _current->written = _current->done.get_future().share();
+        _current->deadline = std::chrono::steady_clock::now() + _options.max_delay;
+        notify = true;
+    }
+
+    _current->docs.emplace_back(std::move(doc));
+
+    auto written = _current->written;
+
+    if (_current->docs.size() >= _options.max_batch) {
+        notify = true;
+    }
+
+    lock.unlock();
+
+    if (notify) {
+        _ready.notify_one();
+    }
+
+    return written;
+}
+
+///
+/// \brief Write the buffered documents and stop the background thread.
+///        Called on server shutdown.
+///
+void batch_writer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _stopping = true;
+    }
+
+    _ready.notify_one();
+
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+///
+/// \returns a snapshot of the number of documents and batches written
+///
+batch_writer::statistics batch_writer::stats() const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    return _stats;
+}
+
+void batch_writer::run()
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+
+    while (true) {
+        if (!_current) {
+            if (_stopping) {
+                break;
+            }
+            _ready.wait(lock, [this]() { return _current || _stopping; });
+            continue;
+        }
+
+        const bool full = _current->docs.size() >= _options.max_batch;
+
+        if (!full && !_stopping
+            && std::chrono::steady_clock::now() < _current->deadline)
+        {
+            _ready.wait_until(lock, _current->deadline);
+            continue;
+        }
+
+        auto b = std::move(_current);
+
+        lock.unlock();
+
+        bool failed = false;
+
+        try {
+            _sink(b->docs);
+            b->done.set_value();
+        } catch (...) {
+            failed = true;
+            b->done.set_exception(std::current_exception());
+        }
+
+        lock.lock();
+
+        if (failed) {
+            _stats.failures += 1;
+        } else {
+            _stats.documents += b->docs.size();
+            _stats.batches += 1;
+        }
+    }
+}
+
+///
+/// \struct batch_options
+///
+/// \brief Batch size and latency limits of a batch_writer
+///
+
+} // namespace mongodb
+} // namespace ops
@@ -0,0 +1,88 @@
+///
+/// \file batch_writer.h
+///
+#pragma once
+
+#include <bsoncxx/document/value.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ops
+{
+namespace mongodb
+{
+    struct batch_options
+    {
+        std::size_t               max_batch = 1000;
+        std::chrono::milliseconds max_delay = std::chrono::milliseconds{0};
+    };
+
+    class batch_writer
+    {
+    public:
+        using options   = batch_options;
+        using documents = std::vector<bsoncxx::document::value>;
+        using sink      = std::function<void(documents&)>;
+
+        struct statistics
+        {
+            std::uint64_t documents;
+            std::uint64_t batches;
+            std::uint64_t failures;
+        };
+
+        explicit batch_writer(const std::string& collection, const options& opts = options{});
+        explicit batch_writer(sink s, const options& opts = options{});
+        ~batch_writer();
+
+        batch_writer(const batch_writer&) = delete;
+        batch_writer& operator=(const batch_writer&) = delete;
+
+        std::shared_future<void> append(bsoncxx::document::value doc);
+        void write(bsoncxx::document::value doc);
+
+        void stop();
+
+        statistics stats() const;
+
+    private:
+        struct batch
+        {
+            documents                             docs;
+            std::promise<void>                    done;
+            std::shared_future<void>              written;
+            std::chrono::steady_clock::time_point deadline;
+        };
+
+        void run();
+
+        const sink                _sink;
+        const options             _options;
+        mutable std::mutex        _mutex;
+        std::condition_variable   _ready;
+        std::unique_ptr<batch>    _current;
+        bool                      _stopping;
+        statistics                _stats;
+        std::thread               _thread;
+    };
+
+    ///
+    /// \brief Append a document and wait until the batch it is part of has
+    ///        been written.
+    ///
+    /// \throws the error which the write failed with, if any
+    ///
+    inline void batch_writer::write(bsoncxx::document::value doc)
+    {
+        append(std::move(doc)).get();
+    }
+}
+}
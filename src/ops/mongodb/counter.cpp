@@ -1,79 +1,261 @@
 #include "counter.h"
+#include <algorithm>
 #include <bsoncxx/builder/basic/document.hpp>
 #include <bsoncxx/builder/basic/kvp.hpp>
 #include <cstdint>
-#include <iomanip>
-#include <iostream>
-#include <sstream>
+#include <stdexcept>
+#include <utility>
 
 namespace ops
 {
 namespace mongodb
 {
 
-std::uint64_t counter::next()
+namespace
 {
-    using bsoncxx::builder::basic::kvp;
-    using bsoncxx::builder::basic::sub_document;
+    ///
+    /// Reserve \a count ids in the counter collection, shared by all the
+    /// processes using the database.
+    ///
+    std::uint64_t reserve(std::uint64_t count)
+    {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+
+        auto lease = pool::instance().acquire();
+        auto collection = lease.collection("counter");
+
+        const auto update = make_document(
+            kvp("$inc", make_document(kvp("COUNT", static_cast<std::int64_t>(count)))));
+
+        mongocxx::options::find_one_and_update options{};
+        options.upsert(true);
+        options.return_document(mongocxx::options::return_document::k_before);
+
+        const auto result = collection.find_one_and_update({}, update.view(), options);
 
-    std::lock_guard<std::mutex> guard(_mutex);
+        if (!result) {
+            return 0;
+        }
 
-    static std::uint64_t counter = 0;
-    static std::uint64_t available = 0;
+        const auto view = result.value().view();
+        const auto& v_count = view["COUNT"];
+
+        if (bsoncxx::type::k_int64 == v_count.type()) {
+            return v_count.get_int64().value;
+        } else if (bsoncxx::type::k_int32 == v_count.type()) {
+            return v_count.get_int32().value;
+        } else if (bsoncxx::type::k_double == v_count.type()) {
+            return v_count.get_double().value;
+        }
+
+        throw std::runtime_error{"unexpected counter type"};
+    }
+}
+
+///
+/// \class id_allocator
+///
+/// \brief Hands out unique ids from blocks reserved in bulk
+///
+/// Ids are reserved \a increment at a time from a source, and each thread
+/// takes \a thread_block ids at a time from the current reservation with a
+/// single atomic add, so threads only synchronize once per thread block.
+/// When a fifth of the reservation is left, the next one is reserved on a
+/// background thread, so the source is normally not waited on. A thread
+/// which runs out before the refill is done waits for it; a failed refill
+/// is rethrown to one waiting caller, and the next caller asks again.
+///
+/// Ids are unique, but not ordered across threads, and the ids left in a
+/// thread's block when the thread exits are never used.
+///
+
+thread_local id_allocator::local id_allocator::_local{0, 0, 0};
+
+std::atomic<std::uint64_t> id_allocator::_instances{0};
+
+id_allocator::id_allocator(source src, std::uint64_t increment, std::uint64_t thread_block)
+  : _source{std::move(src)},
+    _increment{increment},
+    _thread_block{std::max<std::uint64_t>(1, std::min(thread_block, increment / 5))},
+    _uid{++_instances},
+    _wanted{false},
+    _stopping{false}
+{
+    _worker = std::thread{&id_allocator::refill, this};
+}
 
-    if (0 == available--)
+id_allocator::~id_allocator()
+{
     {
-        const auto db = ops::mongodb::pool::instance().database();
-        auto collection = db.collection("counter");
+        std::lock_guard<std::mutex> lock{_mutex};
+        _stopping = true;
+    }
 
-        bsoncxx::builder::basic::document builder{};
-        builder.append(kvp("$inc", [](sub_document subdoc) {
-            subdoc.append(kvp("COUNT", Increment));
-        }));
+    _refilled.notify_all();
+    _worker.join();
+}
 
-        mongocxx::options::find_one_and_replace options{};
-        options.upsert(true);
+///
+/// \brief Take a new block of ids for the calling thread.
+///
+void id_allocator::claim(local& block)
+{
+    while (true) {
+        const auto r = std::atomic_load(&_current);
 
-        auto result = collection.find_one_and_replace({}, builder.view(), options);
-
-        if (result) {
-            const auto view = result.value().view();
-            const auto& v_count = view["COUNT"];
-            if (bsoncxx::type::k_int64 == v_count.type()) {
-                counter = v_count.get_int64().value;
-            } else if (bsoncxx::type::k_int32 == v_count.type()) {
-                counter = v_count.get_int32().value;
-            } else if (bsoncxx::type::k_double == v_count.type()) {
-                counter = v_count.get_double().value;
-            } else {
-                throw std::runtime_error{"unexpected counter type"};
+        if (r) {
+            const auto first = r->next.fetch_add(_thread_block, std::memory_order_relaxed);
+
+            if (first < r->end) {
+                block = local{_uid, first, std::min(first + _thread_block, r->end)};
+
+                // Exactly one thread takes the block which crosses the mark
+                if (first <= r->refill_at && r->refill_at < first + _thread_block) {
+                    refill_async();
+                }
+                return;
             }
-        } else {
-            counter = 0;
         }
 
-        available = Increment - 1;
+        advance(r);
     }
+}
+
+///
+/// \brief Replace an exhausted reservation with the next one, waiting for
+///        the background refill if it is in progress, or asking for it if it
+///        has not been started. The source is never called while the lock
+///        is held.
+///
+void id_allocator::advance(const std::shared_ptr<range>& exhausted)
+{
+    std::unique_lock<std::mutex> lock{_mutex};
 
-    ++counter;
+    while (true) {
+        _refilled.wait(lock, [this]() { return !_wanted; });
 
-    return counter * 83211077003543;
+        if (std::atomic_load(&_current) != exhausted) {
+            return;
+        }
+
+        if (_error) {
+            std::rethrow_exception(std::exchange(_error, nullptr));
+        }
+
+        if (_spare) {
+            std::atomic_store(&_current, std::move(_spare));
+            return;
+        }
+
+        _wanted = true;
+        _refilled.notify_all();
+    }
 }
 
-std::string counter::generate_id()
+void id_allocator::refill_async()
 {
-    const std::uint64_t id = next();
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
 
-    std::stringstream id_stream;
-    id_stream << std::hex << std::setw(12) << std::setfill('0') << id;
+        if (_spare || _wanted) {
+            return;
+        }
 
-    std::string str = id_stream.str();
-    const int8_t diff = str.size() - 12;
+        _wanted = true;
+    }
 
-    return diff > 0 ? str.substr(diff, 12) : str;
+    _refilled.notify_all();
 }
 
-std::mutex counter::_mutex;
+///
+/// \brief Background thread which reserves the next range when asked to by
+///        refill_async.
+///
+void id_allocator::refill()
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+
+    while (true) {
+        _refilled.wait(lock, [this]() { return _wanted || _stopping; });
+
+        if (_stopping) {
+            break;
+        }
+
+        lock.unlock();
+
+        std::shared_ptr<range> r{};
+        std::exception_ptr error{};
+
+        try {
+            r = make_range();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+
+        _spare = std::move(r);
+        _error = error;
+        _wanted = false;
+
+        _refilled.notify_all();
+    }
+}
+
+std::shared_ptr<id_allocator::range> id_allocator::make_range()
+{
+    const std::uint64_t first = _source(_increment) + 1;
+
+    auto r = std::make_shared<range>();
+    r->next = first;
+    r->end = first + _increment;
+    r->refill_at = r->end - _increment / 5;
+
+    return r;
+}
+
+///
+/// \class counter
+///
+/// \brief Process-wide id generator backed by the counter collection
+///
+
+///
+/// \returns a unique, non-sequential 64-bit id
+///
+std::uint64_t counter::next()
+{
+    static id_allocator allocator{reserve, Increment, ThreadBlock};
+
+    return allocator.next() * 83211077003543;
+}
+
+///
+/// \returns a unique id as 12 hex digits
+///
+std::string counter::generate_id()
+{
+    return format_id(next());
+}
+
+///
+/// \returns the low 48 bits of an id as 12 hex digits
+///
+std::string counter::format_id(std::uint64_t id)
+{
+    static constexpr char digits[] = "0123456789abcdef";
+
+    std::string str(12, '0');
+
+    for (auto i = str.rbegin(); i != str.rend(); ++i) {
+        *i = digits[id & 0xf];
+        id >>= 4;
+    }
+
+    return str;
+}
 
 } // namespace mongodb
 } // namespace ops
@@ -3,25 +3,99 @@
 ///
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <exception>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
 #include "pool.h"
 
 namespace ops
 {
 namespace mongodb
 {
+    class id_allocator
+    {
+    public:
+        ///
+        /// Reserves \a count ids and returns the value of the counter before
+        /// the reservation, i.e., the ids reserved are `(n, n + count]`.
+        ///
+        using source = std::function<std::uint64_t(std::uint64_t count)>;
+
+        id_allocator(source src, std::uint64_t increment, std::uint64_t thread_block);
+        ~id_allocator();
+
+        id_allocator(const id_allocator&) = delete;
+        id_allocator& operator=(const id_allocator&) = delete;
+
+        std::uint64_t next();
+
+    private:
+        struct range
+        {
+            std::atomic<std::uint64_t> next;
+            std::uint64_t              end;
+            std::uint64_t              refill_at;
+        };
+
+        struct local
+        {
+            std::uint64_t owner;
+            std::uint64_t next;
+            std::uint64_t end;
+        };
+
+        void claim(local& block);
+        void advance(const std::shared_ptr<range>& exhausted);
+        void refill_async();
+        void refill();
+
+        std::shared_ptr<range> make_range();
+
+        static thread_local local _local;
+        static std::atomic<std::uint64_t> _instances;
+
+        const source            _source;
+        const std::uint64_t     _increment;
+        const std::uint64_t     _thread_block;
+        const std::uint64_t     _uid;
+        std::shared_ptr<range>  _current;
+        std::shared_ptr<range>  _spare;
+        std::exception_ptr      _error;
+        bool                    _wanted;
+        bool                    _stopping;
+        std::mutex              _mutex;
+        std::condition_variable _refilled;
+        std::thread             _worker;
+    };
+
     class counter
     {
     public:
         counter() = delete;
 
-        static constexpr auto Increment = 500;
+        static constexpr auto Increment   = 4096;
+        static constexpr auto ThreadBlock = 16;
 
         static std::uint64_t next();
         static std::string generate_id();
-
-    private:
-        static std::mutex _mutex;
+        static std::string format_id(std::uint64_t id);
     };
+
+    inline std::uint64_t id_allocator::next()
+    {
+        auto& block = _local;
+
+        if (_uid != block.owner || block.next == block.end) {
+            claim(block);
+        }
+
+        return block.next++;
+    }
 }
 }
@@ -10,8 +10,9 @@
 #include <iostream>
 #include <mongocxx/client.hpp>
 #include <mongocxx/collection.hpp>
-#include <sstream>
+#include <optional>
 #include "pool.h"
+#include "update.h"
 
 namespace ops
 {
@@ -38,10 +39,21 @@ namespace mongodb
 
         static void create(bsoncxx::document::view view);
 
-        static document find(bsoncxx::document::view filter);
+        static document find(bsoncxx::document::view filter,
+                             bsoncxx::document::view projection = {});
 
         template <typename K, typename V>
-        static document find(const K& k, const V& v);
+        static document find(const K& k,
+                             const V& v,
+                             bsoncxx::document::view projection = {});
+
+        static document update(bsoncxx::document::view filter,
+                               mongodb::update&& changes,
+                               bsoncxx::document::view guard);
+
+        static document update(bsoncxx::document::view filter,
+                               mongodb::update&& changes,
+                               std::optional<std::int64_t> version = std::nullopt);
 
         static std::int64_t count();
 
@@ -55,29 +67,31 @@ namespace mongodb
             const V& v, 
             mongocxx::options::count options = mongocxx::options::count{});
 
-        std::istringstream stream() const;
-
     private:
         bsoncxx::oid             _oid;
         bsoncxx::document::value _value;
+        bool                     _partial;
     };
 
     template <typename T>
     document<T>::document()
-      : _value{make_document(kvp("_id", _oid))}
+      : _value{make_document(kvp("_id", _oid))},
+        _partial{false}
     {
     }
 
     template <typename T>
     document<T>::document(bsoncxx::document::view view)
       : _oid{view["_id"].get_oid().value},
-        _value{view}
+        _value{view},
+        _partial{false}
     {
     }
 
     template <typename T> void document<T>::fetch()
     {
-        auto collection = pool::instance().database().collection(T::collection);
+        auto lease = pool::instance().acquire();
+        auto collection = lease.collection(T::collection);
 
         const auto filter = make_document(kvp("_id", _oid));
         const auto result = collection.find_one(filter.view());
@@ -91,7 +105,12 @@ namespace mongodb
 
     template <typename T> void document<T>::save()
     {
-        auto collection = pool::instance().database().collection(T::collection);
+        if (_partial) {
+            throw std::runtime_error{"can not save a document fetched with a projection"};
+        }
+
+        auto lease = pool::instance().acquire();
+        auto collection = lease.collection(T::collection);
 
         const auto filter = make_document(kvp("_id", _oid));
 
@@ -103,7 +122,8 @@ namespace mongodb
 
     template <typename T> void document<T>::remove()
     {
-        auto collection = pool::instance().database().collection(T::collection);
+        auto lease = pool::instance().acquire();
+        auto collection = lease.collection(T::collection);
 
         const auto filter = make_document(kvp("_id", _oid));
 
@@ -117,6 +137,7 @@ namespace mongodb
     void document<T>::inject(bsoncxx::document::view view)
     {
         _value = bsoncxx::document::value{view};
+        _partial = false;
     }
 
     template <typename T>
@@ -133,31 +154,113 @@ namespace mongodb
         doc.save();
     }
 
+    ///
+    /// \brief Fetch the first document matching \a filter.
+    ///
+    /// \param filter     selects the document
+    /// \param projection the fields to return, or empty for all fields. A
+    ///                   document fetched with a projection can not be saved.
+    ///
     template <typename T>
-    document<T> document<T>::find(bsoncxx::document::view filter)
+    document<T> document<T>::find(bsoncxx::document::view filter,
+                                  bsoncxx::document::view projection)
     {
-        auto collection = pool::instance().database().collection(T::collection);
+        mongocxx::options::find opts{};
 
-        const auto result = collection.find_one(filter);
+        if (!projection.empty()) {
+            opts.projection(projection);
+        }
+
+        auto lease = pool::instance().acquire();
+        auto collection = lease.collection(T::collection);
+
+        const auto result = collection.find_one(filter, opts);
 
         if (!result) {
             throw std::runtime_error{"not found"};
         }
 
-        return document{result.value().view()};
+        document doc{result.value().view()};
+        doc._partial = !projection.empty();
+
+        return doc;
     }
 
     template <typename T>
     template <typename K, typename V>
-    document<T> document<T>::find(const K& k, const V& v)
+    document<T> document<T>::find(const K& k,
+                                  const V& v,
+                                  bsoncxx::document::view projection)
     {
-        return document<T>::find(make_document(kvp(k, v)));
+        return document<T>::find(make_document(kvp(k, v)), projection);
+    }
+
+    ///
+    /// \brief Apply a partial update to the document matching \a filter, and
+    ///        increment its version.
+    ///
+    /// \param filter  selects the document to update
+    /// \param changes the fields to set, unset and increment
+    /// \param guard   extra conditions which the document must meet, e.g.,
+    ///                the version the caller read
+    ///
+    /// \returns the document after the update
+    ///
+    /// \throws version_conflict if the document matches \a filter but not
+    ///         \a guard
+    ///
+    template <typename T>
+    document<T> document<T>::update(bsoncxx::document::view filter,
+                                    mongodb::update&& changes,
+                                    bsoncxx::document::view guard)
+    {
+        changes.inc(mongodb::update::Version);
+
+        bsoncxx::builder::basic::document guarded{};
+        guarded.append(bsoncxx::builder::concatenate(filter));
+        guarded.append(bsoncxx::builder::concatenate(guard));
+
+        mongocxx::options::find_one_and_update options{};
+        options.return_document(mongocxx::options::return_document::k_after);
+
+        auto lease = pool::instance().acquire();
+        auto collection = lease.collection(T::collection);
+
+        const auto result = collection.find_one_and_update(
+            guarded.view(), changes.extract(), options);
+
+        if (!result) {
+            if (!guard.empty() && collection.count_documents(filter) > 0) {
+                throw version_conflict{"document has been modified"};
+            }
+            throw std::runtime_error{"not found"};
+        }
+
+        return document{result.value().view()};
+    }
+
+    ///
+    /// \brief Apply a partial update to the document matching \a filter,
+    ///        provided that it is at the given \a version, if any.
+    ///
+    template <typename T>
+    document<T> document<T>::update(bsoncxx::document::view filter,
+                                    mongodb::update&& changes,
+                                    std::optional<std::int64_t> version)
+    {
+        if (version.has_value()) {
+            const auto guard = make_document(kvp(mongodb::update::Version, version.value()));
+            return update(filter, std::move(changes), guard.view());
+        }
+
+        return update(filter, std::move(changes), bsoncxx::document::view{});
     }
 
     template <typename T>
     std::int64_t document<T>::count()
     {
-        auto collection = pool::instance().database().collection(T::collection);
+        auto lease = pool::instance().acquire();
+        auto collection = lease.collection(T::collection);
         return collection.count({});
     }
 
@@ -165,7 +268,8 @@ namespace mongodb
     std::int64_t document<T>::count(bsoncxx::document::view filter, 
                                     mongocxx::options::count options)
     {
-        auto collection = pool::instance().database().collection(T::collection);
+        auto lease = pool::instance().acquire();
+        auto collection = lease.collection(T::collection);
         return collection.count(filter, options);
     }
 
@@ -176,15 +280,6 @@ namespace mongodb
         return document<T>::count(make_document(kvp(k, v)));
     }
 
-    template <typename T>
-    std::istringstream document<T>::stream() const
-    {
-        std::istringstream stream;
-        stream.str(bsoncxx::to_json(_value.view()));
-
-        return stream;
-    }
-
     template <typename T>
     std::ostream& operator<<(std::ostream& os, const document<T>& doc)
     {
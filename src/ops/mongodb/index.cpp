@@ -0,0 +1,135 @@
+#include "index.h"
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/json.hpp>
+#include <mongocxx/pipeline.hpp>
+#include <set>
+#include "../util/logger.h"
+#include "pool.h"
+
+namespace ops
+{
+namespace mongodb
+{
+
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::builder::basic::make_document;
+
+namespace
+{
+    std::string to_string(const bsoncxx::document::element& element)
+    {
+        const auto str = element.get_utf8().value;
+        return std::string{str.data(), str.size()};
+    }
+
+    std::int64_t to_int64(const bsoncxx::document::element& element)
+    {
+        switch (element.type())
+        {
+        case bsoncxx::type::k_int32:
+            return element.get_int32().value;
+        case bsoncxx::type::k_int64:
+            return element.get_int64().value;
+        default:
+            return 0;
+        }
+    }
+}
+
+///
+/// \class index_set
+///
+/// \brief The indexes declared by the application's models
+///
+/// Collect the models at startup and call index_set::ensure once the
+/// connection pool has been initialized:
+///
+/// \code
+/// ops::mongodb::index_set{}
+///     .add<core::campaign>()
+///     .add<core::content>()
+///     .ensure();
+/// \endcode
+///
+
+///
+/// \brief Create the declared indexes which do not exist yet, and report
+///        existing indexes which are not declared by any model or have not
+///        been used since the database server was started.
+///
+/// Failures are reported, but are not fatal.
+///
+void index_set::ensure() const
+{
+    for (const auto& e : _entries) {
+        try {
+            ensure(e);
+        } catch (const std::exception& error) {
+            util::log::warning("can not check indexes",
+                {{"collection", e.collection}, {"error", error.what()}});
+        }
+    }
+}
+
+void index_set::ensure(const entry& e)
+{
+    auto lease = pool::instance().acquire();
+    auto collection = lease.collection(e.collection);
+
+    std::set<std::string> existing{};
+
+    for (const bsoncxx::document::view& spec : collection.list_indexes()) {
+        existing.insert(to_string(spec["name"]));
+    }
+
+    std::set<std::string> declared{"_id_"};
+
+    for (const auto& idx : e.indexes) {
+        declared.insert(idx.name);
+
+        if (existing.count(idx.name)) {
+            continue;
+        }
+
+        try {
+            collection.create_index(
+                bsoncxx::from_json(idx.keys).view(),
+                make_document(kvp("name", idx.name), kvp("unique", idx.unique)).view());
+            util::log::notice("created index",
+                {{"collection", e.collection}, {"index", idx.name}});
+        } catch (const std::exception& error) {
+            util::log::warning("can not create index",
+                {{"collection", e.collection}, {"index", idx.name}, {"error", error.what()}});
+        }
+    }
+
+    for (const auto& name : existing) {
+        if (!declared.count(name)) {
+            util::log::notice("index is not declared by any model",
+                {{"collection", e.collection}, {"index", name}});
+        }
+    }
+
+    // Access counters are reset when mongod restarts, so an unused index is
+    // only a hint
+    mongocxx::pipeline stats{};
+    stats.index_stats();
+
+    for (const bsoncxx::document::view& stat : collection.aggregate(stats)) {
+        const auto name = to_string(stat["name"]);
+        if (existing.count(name) && "_id_" != name && 0 == to_int64(stat["accesses"]["ops"])) {
+            util::log::notice("index has not been used since the server started",
+                {{"collection", e.collection}, {"index", name}});
+        }
+    }
+}
+
+///
+/// \struct index
+///
+/// \brief Name, key pattern (as JSON) and uniqueness of a collection index
+///
+
+} // namespace mongodb
+} // namespace ops
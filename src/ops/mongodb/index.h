@@ -0,0 +1,61 @@
+///
+/// \file index.h
+///
+#pragma once
+
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace ops
+{
+namespace mongodb
+{
+    ///
+    /// An index declared by a model, e.g.,
+    ///
+    /// \code
+    /// static constexpr ops::mongodb::index indexes[] = {
+    ///     {"id_1", R"({"id": 1})", true}
+    /// };
+    /// \endcode
+    ///
+    struct index
+    {
+        const char* name;
+        const char* keys;
+        bool        unique;
+    };
+
+    class index_set
+    {
+    public:
+        template <typename T>
+        index_set& add();
+
+        void ensure() const;
+
+    private:
+        struct entry
+        {
+            std::string        collection;
+            std::vector<index> indexes;
+        };
+
+        static void ensure(const entry& e);
+
+        std::vector<entry> _entries;
+    };
+
+    ///
+    /// \brief Add the indexes declared by model \a T, as `T::indexes`, for
+    ///        the collection `T::collection`.
+    ///
+    template <typename T>
+    index_set& index_set::add()
+    {
+        _entries.push_back(entry{T::collection, {std::begin(T::indexes), std::end(T::indexes)}});
+        return *this;
+    }
+}
+}
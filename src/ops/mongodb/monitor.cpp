@@ -0,0 +1,479 @@
+#include "monitor.h"
+#include <algorithm>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/json.hpp>
+#include <set>
+#include "../http/metrics.h"
+#include "../util/logger.h"
+#include "pool.h"
+
+namespace ops
+{
+namespace mongodb
+{
+
+namespace
+{
+    // Commands which the explain command accepts
+    const std::set<std::string> explainable{
+        "aggregate", "count", "delete", "distinct", "find", "findAndModify", "update"
+    };
+
+    std::string to_string(bsoncxx::stdx::string_view s)
+    {
+        return std::string{s.data(), s.size()};
+    }
+
+    void append_shape(std::string& out, const bsoncxx::document::element& e);
+
+    void append_shape(std::string& out, bsoncxx::document::view doc)
+    {
+        out += '{';
+
+        bool first = true;
+        for (const auto& e : doc) {
+            if (!first) {
+                out += ',';
+            }
+            first = false;
+
+            out += '"';
+            out += to_string(e.key());
+            out += "\":";
+            append_shape(out, e);
+        }
+
+        out += '}';
+    }
+
+    ///
+    /// Operators and field names are kept, values are replaced with "?".
+    /// Arrays of documents, e.g., the operands of $or, keep their shape.
+    ///
+    void append_shape(std::string& out, const bsoncxx::document::element& e)
+    {
+        if (bsoncxx::type::k_document == e.type()) {
+            append_shape(out, e.get_document().value);
+        } else if (bsoncxx::type::k_array == e.type()) {
+            out += '[';
+
+            bool first = true;
+            for (const auto& item : e.get_array().value) {
+                if (bsoncxx::type::k_document != item.type()) {
+                    out += "\"?\"";
+                    break;
+                }
+                if (!first) {
+                    out += ',';
+                }
+                first = false;
+                append_shape(out, item.get_document().value);
+            }
+
+            out += ']';
+        } else {
+            out += "\"?\"";
+        }
+    }
+
+    ///
+    /// \returns the filter of a command, or an empty view
+    ///
+    bsoncxx::document::view filter(const std::string& name, bsoncxx::document::view body)
+    {
+        const auto element = [&]() -> bsoncxx::document::element {
+            if ("find" == name) {
+                return body["filter"];
+            } else if ("count" == name || "distinct" == name || "findAndModify" == name) {
+                return body["query"];
+            } else if ("update" == name) {
+                return body["updates"][0]["q"];
+            } else if ("delete" == name) {
+                return body["deletes"][0]["q"];
+            }
+            return {};
+        }();
+
+        if (element && bsoncxx::type::k_document == element.type()) {
+            return element.get_document().value;
+        }
+
+        return {};
+    }
+}
+
+///
+/// \class monitor
+///
+/// \brief Latency and failures of every database command, per collection
+///        and command, and a log of slow commands
+///
+/// The monitor is installed in the driver's command monitoring (APM), see
+/// monitor::apm, so it sees all the commands sent through the pool: the
+/// document<T> and page<T> queries, counter reservations, and direct
+/// collection calls alike. The reported durations are measured by the
+/// driver around the round trip to the server; pool::stats has the time
+/// spent waiting for a connection.
+///
+/// A command which takes longer than monitor_options::slow is logged with
+/// the shape of its filter, i.e., the filter with every value replaced by
+/// "?", which groups the same query with different parameters without
+/// logging any data. With monitor_options::explain, the query plan of slow
+/// commands is fetched on a background thread and logged as well.
+///
+
+const std::array<std::chrono::microseconds, monitor::LatencyBuckets - 1> monitor::latency_bounds{
+    std::chrono::microseconds{100},
+    std::chrono::microseconds{250},
+    std::chrono::microseconds{500},
+    std::chrono::microseconds{1000},
+    std::chrono::microseconds{2500},
+    std::chrono::microseconds{5000},
+    std::chrono::microseconds{10000},
+    std::chrono::microseconds{25000},
+    std::chrono::microseconds{50000},
+    std::chrono::microseconds{100000},
+    std::chrono::microseconds{250000},
+    std::chrono::microseconds{1000000}
+};
+
+///
+/// \returns the database monitor singleton instance
+///
+monitor& monitor::instance()
+{
+    static monitor instance{};
+    return instance;
+}
+
+monitor::monitor()
+  : _slow_us{0},
+    _explain{false},
+    _stopping{false}
+{
+}
+
+monitor::~monitor()
+{
+    stop();
+}
+
+///
+/// \brief Set the slow command threshold, and whether slow commands are
+///        explained.
+///
+void monitor::configure(const options& opts)
+{
+    _slow_us = std::chrono::duration_cast<std::chrono::microseconds>(opts.slow).count();
+    _explain = opts.explain;
+
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    if (opts.explain && !_thread.joinable() && !_stopping) {
+        _thread = std::thread{&monitor::run, this};
+    }
+}
+
+///
+/// \returns the command monitoring callbacks to pass to the driver
+///
+mongocxx::options::apm monitor::apm()
+{
+    mongocxx::options::apm apm{};
+
+    apm.on_command_started([this](const mongocxx::events::command_started_event& event) {
+        started(event);
+    });
+
+    apm.on_command_succeeded([this](const mongocxx::events::command_succeeded_event& event) {
+        finished(event.request_id(), event.duration(), false);
+    });
+
+    apm.on_command_failed([this](const mongocxx::events::command_failed_event& event) {
+        finished(event.request_id(), event.duration(), true);
+    });
+
+    return apm;
+}
+
+///
+/// \returns the counters of every collection and command seen so far
+///
+std::vector<monitor::statistics> monitor::stats() const
+{
+    std::vector<statistics> result{};
+
+    std::shared_lock<std::shared_mutex> lock{_counters_mutex};
+
+    result.reserve(_counters.size());
+
+    for (const auto& entry : _counters) {
+        const auto tab = entry.first.find('\t');
+        const auto& c = *entry.second;
+
+        statistics s{entry.first.substr(0, tab), entry.first.substr(tab + 1), {}, 0, 0};
+
+        for (std::size_t i = 0; i < LatencyBuckets; ++i) {
+            s.latency[i] = c.latency[i].load(std::memory_order_relaxed);
+        }
+        s.latency_us = c.latency_us.load(std::memory_order_relaxed);
+        s.failures = c.failures.load(std::memory_order_relaxed);
+
+        result.emplace_back(std::move(s));
+    }
+
+    return result;
+}
+
+///
+/// \brief Write the latency histograms and failure counts of the commands
+///        in the Prometheus text format, for a scrape.
+///
+void monitor::collect(std::ostream& out) const
+{
+    using http::metrics;
+
+    const auto commands = stats();
+
+    std::vector<double> bounds{};
+    for (const auto bound : latency_bounds) {
+        bounds.push_back(std::chrono::duration<double>(bound).count());
+    }
+
+    const auto labels = [](const statistics& c) {
+        return metrics::label("collection", c.collection) + "," + metrics::label("command", c.command);
+    };
+
+    metrics::header(out, "mongodb_command_duration_seconds",
+        "Time of database commands, by collection and command.", "histogram");
+    for (const auto& c : commands) {
+        metrics::histogram(out, "mongodb_command_duration_seconds", labels(c),
+            bounds, {c.latency.begin(), c.latency.end()}, c.latency_us / 1e6);
+    }
+
+    metrics::header(out, "mongodb_command_failures_total",
+        "Database commands which failed, by collection and command.", "counter");
+    for (const auto& c : commands) {
+        out << "mongodb_command_failures_total{" << labels(c) << "} " << c.failures << '\n';
+    }
+}
+
+///
+/// \brief Stop the explain thread. Slow commands are still logged.
+///
+void monitor::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _stopping = true;
+        _explains.clear();
+    }
+
+    _ready.notify_all();
+
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+///
+/// \returns the shape of a query filter, as JSON
+///
+std::string monitor::shape(bsoncxx::document::view filter)
+{
+    std::string out{};
+    append_shape(out, filter);
+
+    return out;
+}
+
+void monitor::started(const mongocxx::events::command_started_event& event)
+{
+    const auto body = event.command();
+
+    command c{event.request_id(), to_string(event.database_name()),
+              {}, to_string(event.command_name()), {}, nullptr};
+
+    // The first field names the collection, except for getMore
+    if ("getMore" == c.name) {
+        const auto e = body["collection"];
+        if (e && bsoncxx::type::k_utf8 == e.type()) {
+            c.collection = to_string(e.get_utf8().value);
+        }
+    } else if (body.begin() != body.end()) {
+        const auto& e = *body.begin();
+        if (bsoncxx::type::k_utf8 == e.type()) {
+            c.collection = to_string(e.get_utf8().value);
+        }
+    }
+
+    // The body is only valid during the callback, so what a slow command
+    // would need is taken now. Only a command which may be explained is
+    // copied whole.
+    if (_slow_us > 0) {
+        const auto f = filter(c.name, body);
+        if (!f.empty()) {
+            c.filter_shape = shape(f);
+        }
+
+        if (_explain && 0 != explainable.count(c.name)) {
+            c.body = std::make_unique<bsoncxx::document::value>(body);
+        }
+    }
+
+    in_progress().emplace_back(std::move(c));
+}
+
+void monitor::finished(std::int64_t request_id, std::int64_t duration_us, bool failed)
+{
+    auto& commands = in_progress();
+
+    const auto i = std::find_if(commands.begin(), commands.end(),
+        [request_id](const command& c) { return c.request_id == request_id; });
+
+    if (commands.end() == i) {
+        return;
+    }
+
+    auto& c = find(i->collection, i->name);
+
+    std::size_t bucket = 0;
+    while (bucket < latency_bounds.size() && duration_us > latency_bounds[bucket].count()) {
+        ++bucket;
+    }
+
+    c.latency[bucket].fetch_add(1, std::memory_order_relaxed);
+    c.latency_us.fetch_add(static_cast<std::uint64_t>(std::max<std::int64_t>(duration_us, 0)),
+                           std::memory_order_relaxed);
+
+    if (failed) {
+        c.failures.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const auto threshold = _slow_us.load();
+
+    if (threshold > 0 && duration_us >= threshold) {
+        slow(*i, duration_us);
+    }
+
+    commands.erase(i);
+}
+
+///
+/// The driver reports the start and the end of a command on the thread which
+/// runs it, so the commands in progress are kept per thread, without a lock.
+///
+std::vector<monitor::command>& monitor::in_progress()
+{
+    thread_local std::vector<command> commands{};
+
+    return commands;
+}
+
+monitor::counters& monitor::find(const std::string& collection, const std::string& name)
+{
+    const auto key = collection + '\t' + name;
+
+    {
+        std::shared_lock<std::shared_mutex> lock{_counters_mutex};
+
+        const auto i = _counters.find(key);
+        if (_counters.end() != i) {
+            return *i->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock{_counters_mutex};
+
+    auto& c = _counters[key];
+    if (!c) {
+        c = std::make_unique<counters>();
+    }
+
+    return *c;
+}
+
+void monitor::slow(command& c, std::int64_t duration_us)
+{
+    util::log::warning("slow database command", {
+        {"collection", c.collection},
+        {"command", c.name},
+        {"duration_us", duration_us},
+        {"filter", c.filter_shape}
+    });
+
+    if (!_explain || !c.body) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        if (_stopping || _explains.size() >= MaxPendingExplains) {
+            return;
+        }
+
+        _explains.emplace_back(std::move(c));
+    }
+
+    _ready.notify_one();
+}
+
+void monitor::run()
+{
+    using bsoncxx::builder::basic::kvp;
+
+    for (;;) {
+        command c{};
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _ready.wait(lock, [this]() { return _stopping || !_explains.empty(); });
+
+            if (_stopping) {
+                return;
+            }
+
+            c = std::move(_explains.front());
+            _explains.pop_front();
+        }
+
+        // Leave out the fields which the driver adds to every command, such
+        // as the session and the database name
+        bsoncxx::builder::basic::document explained{};
+        for (const auto& e : c.body->view()) {
+            const auto key = to_string(e.key());
+            if ('$' != key.front() && "lsid" != key && "txnNumber" != key) {
+                explained.append(kvp(key, e.get_value()));
+            }
+        }
+
+        try {
+            auto lease = pool::instance().acquire();
+
+            const auto reply = lease.client().database(c.database).run_command(
+                bsoncxx::builder::basic::make_document(
+                    kvp("explain", explained.extract()),
+                    kvp("verbosity", "queryPlanner")));
+
+            const auto plan = reply.view()["queryPlanner"]["winningPlan"];
+
+            util::log::notice("slow database command plan", {
+                {"collection", c.collection},
+                {"command", c.name},
+                {"plan", plan && bsoncxx::type::k_document == plan.type()
+                    ? bsoncxx::to_json(plan.get_document().value)
+                    : std::string{}}
+            });
+        } catch (const std::exception& error) {
+            util::log::notice("can not explain slow database command", {
+                {"collection", c.collection},
+                {"command", c.name},
+                {"error", error.what()}
+            });
+        }
+    }
+}
+
+} // namespace mongodb
+} // namespace ops
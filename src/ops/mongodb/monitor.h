@@ -0,0 +1,117 @@
+///
+/// \file monitor.h
+///
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bsoncxx/document/value.hpp>
+#include <bsoncxx/document/view.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mongocxx/events/command_failed_event.hpp>
+#include <mongocxx/events/command_started_event.hpp>
+#include <mongocxx/events/command_succeeded_event.hpp>
+#include <mongocxx/options/apm.hpp>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ops
+{
+namespace mongodb
+{
+    struct monitor_options
+    {
+        std::chrono::milliseconds slow    = std::chrono::milliseconds{0};
+        bool                      explain = false;
+    };
+
+    class monitor
+    {
+    public:
+        using options = monitor_options;
+
+        static constexpr std::size_t LatencyBuckets = 13;
+
+        // Explains of slow operations which may wait for the worker
+        static constexpr std::size_t MaxPendingExplains = 16;
+
+        struct statistics
+        {
+            std::string                               collection;
+            std::string                               command;
+            std::array<std::uint64_t, LatencyBuckets> latency;
+            std::uint64_t                             latency_us;
+            std::uint64_t                             failures;
+        };
+
+        static const std::array<std::chrono::microseconds, LatencyBuckets - 1> latency_bounds;
+
+        static monitor& instance();
+
+        ~monitor();
+
+        monitor(const monitor&) = delete;
+        monitor& operator=(const monitor&) = delete;
+
+        void configure(const options& opts);
+
+        mongocxx::options::apm apm();
+
+        std::vector<statistics> stats() const;
+        void collect(std::ostream& out) const;
+
+        void stop();
+
+        static std::string shape(bsoncxx::document::view filter);
+
+    private:
+        struct counters
+        {
+            std::array<std::atomic<std::uint64_t>, LatencyBuckets> latency;
+            std::atomic<std::uint64_t>                             latency_us;
+            std::atomic<std::uint64_t>                             failures;
+        };
+
+        struct command
+        {
+            std::int64_t                              request_id;
+            std::string                               database;
+            std::string                               collection;
+            std::string                               name;
+            std::string                               filter_shape;
+            std::unique_ptr<bsoncxx::document::value> body;
+        };
+
+        monitor();
+
+        void started(const mongocxx::events::command_started_event& event);
+        void finished(std::int64_t request_id, std::int64_t duration_us, bool failed);
+
+        counters& find(const std::string& collection, const std::string& name);
+
+        static std::vector<command>& in_progress();
+
+        void slow(command& c, std::int64_t duration_us);
+        void run();
+
+        std::atomic<std::int64_t>                                  _slow_us;
+        std::atomic<bool>                                          _explain;
+        mutable std::shared_mutex                                  _counters_mutex;
+        std::unordered_map<std::string, std::unique_ptr<counters>> _counters;
+        std::mutex                                                 _mutex;
+        std::condition_variable                                    _ready;
+        std::deque<command>                                        _explains;
+        bool                                                       _stopping;
+        std::thread                                                _thread;
+    };
+}
+}
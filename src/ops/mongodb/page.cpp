@@ -1,20 +1,117 @@
 #include "page.h"
+#include <boost/algorithm/string.hpp>
+#include <stdexcept>
+#include <vector>
+
+namespace ops
+{
+namespace mongodb
+{
+
+///
+/// \brief Parse the name of a page_total mode, as used in query strings.
+///
+/// \param str one of "none", "estimated" or "cached"
+///
+/// \returns the corresponding mode, or page_total::none if the name is not
+///          recognized
+///
+page_total page_total_from(const std::string& str)
+{
+    if ("estimated" == str) {
+        return page_total::estimated;
+    } else if ("cached" == str) {
+        return page_total::cached;
+    }
+
+    return page_total::none;
+}
+
+///
+/// \brief Parse a comma separated list of fields, as used in query strings,
+///        into a projection.
+///
+/// The `id` field is always included, so that the documents returned can
+/// still be referred to.
+///
+/// \param fields e.g. "name,features.0d41a7c3e9b2.data"
+///
+/// \returns an inclusion projection, or an empty document if \a fields is
+///          empty
+///
+/// \throws std::invalid_argument if a field name is malformed
+///
+bsoncxx::document::value projection_from(const std::string& fields)
+{
+    std::vector<std::string> names{};
+    boost::split(names, fields, [](char c) { return ',' == c; });
+
+    bsoncxx::builder::basic::document builder{};
+    bool empty = true;
+
+    for (auto& name : names) {
+        boost::trim(name);
+
+        if (name.empty()) {
+            continue;
+        }
+
+        if ('$' == name.front() || '.' == name.front() || '.' == name.back()
+            || std::string::npos != name.find(".."))
+        {
+            throw std::invalid_argument{"bad field name: " + name};
+        }
+
+        if ("id" != name) {
+            builder.append(kvp(name, 1));
+        }
+        empty = false;
+    }
+
+    if (!empty) {
+        builder.append(kvp("id", 1));
+    }
+
+    return builder.extract();
+}
+
+} // namespace mongodb
+} // namespace ops
+
+///
+/// \enum ops::mongodb::page_total
+///
+/// \brief How a page reports the number of documents in the collection
+///
+/// - \a none omits the total,
+/// - \a estimated uses the collection metadata (estimated_document_count),
+/// - \a cached counts the documents, but reuses the result for page::CountTtl.
+///   When it expires, one request recounts while the others keep getting the
+///   previous value.
+///
 
 ///
 /// \class ops::mongodb::page
 ///
 /// A \a page is a subset of documents drawn from a MongoDB collection.
 ///
+/// Documents are ordered by `_id`. Each page carries an opaque token for the
+/// page that follows it (see page::next), which can be passed to page::after.
+/// Unlike page::get with a large \a skip, page::after costs the same for deep
+/// pages as for the first page, since the server walks the `_id` index
+/// straight to the first document of the page.
+///
 
 ///
-/// \fn ops::mongodb::page::page(Container<document<T>>&& collection, const std::size_t offset, const std::size_t size, const std::size_t total)
+/// \fn ops::mongodb::page::page(Container<document<T>>&& collection, const std::size_t offset, const std::size_t size, std::optional<std::size_t> total, std::string next)
 ///
 /// \brief todo
 ///
 /// \param collection todo
 /// \param offset     todo
 /// \param size       todo
-/// \param total      todo
+/// \param total      number of documents in the collection, if requested
+/// \param next       token for the next page, or empty on the last page
 ///
 
 ///
@@ -28,9 +125,102 @@
 ///
 
 ///
-/// \fn ops::mongodb::page::get(const std::int64_t skip, const std::int64_t limit)
+/// \fn ops::mongodb::page::total() const
 ///
-/// \brief todo
+/// \returns the number of documents in the collection, unless the page was
+///          requested with page_total::none
+///
+
+///
+/// \fn ops::mongodb::page::next() const
+///
+/// \returns an opaque token which identifies the next page, or an empty
+///          string if this is the last page
+///
+
+///
+/// \fn ops::mongodb::page::get(const std::int64_t skip, const std::int64_t limit, const page_total totals, bsoncxx::document::view projection)
+///
+/// \brief Fetch a page by offset. The cost grows with \a skip.
+///
+/// \param projection the fields to return, or empty for all fields
 ///
 /// \returns todo
 ///
+/// \throws std::invalid_argument if \a limit is not within 1..page::MaxLimit
+///
+
+///
+/// \fn ops::mongodb::page::after(const std::string& token, const std::int64_t limit, const page_total totals, bsoncxx::document::view projection)
+///
+/// \brief Fetch the page which follows the one that returned \a token from
+///        page::next. An empty token gives the first page.
+///
+/// \throws std::invalid_argument if the token is malformed
+///
+
+///
+/// \class ops::mongodb::page_cursor
+///
+/// A \a page_cursor selects the same documents as a \a page, but does not
+/// load them up front. The documents are handed out one at a time by
+/// page_cursor::for_each, and are read from the server in batches of at most
+/// page_cursor::BatchSize, so memory use does not grow with the page size.
+/// This is meant to feed a streamed response:
+///
+/// \code
+/// auto cursor = page_cursor<campaign>::after(token, limit);
+/// auto stream = request.stream_response();
+///
+/// stream.begin_array();
+/// cursor.for_each([&stream](bsoncxx::document::view view) {
+///     stream.value(ops::util::json::extract(view));
+/// });
+/// stream.end_array();
+/// stream.close();
+/// \endcode
+///
+/// A database connection is only held while a batch is read. Each batch
+/// after the first is a new query which continues after the `_id` of the
+/// last document handed out, so no cursor is left open on the server while
+/// the response is written.
+///
+
+///
+/// \fn ops::mongodb::page_cursor::get(const std::int64_t skip, const std::int64_t limit, const page_total totals, bsoncxx::document::view projection)
+///
+/// \brief Open a cursor on a page selected by offset.
+///
+/// The first batch is read before this function returns, so that database
+/// errors surface before a response is started.
+///
+/// \throws std::invalid_argument if \a limit is not within 1..page::MaxLimit
+///
+/// \sa page::get
+///
+
+///
+/// \fn ops::mongodb::page_cursor::after(const std::string& token, const std::int64_t limit, const page_total totals, bsoncxx::document::view projection)
+///
+/// \brief Open a cursor on the page which follows \a token.
+///
+/// \throws std::invalid_argument if the token is malformed
+///
+/// \sa page::after
+///
+
+///
+/// \fn ops::mongodb::page_cursor::for_each(F f)
+///
+/// \brief Call \a f with a view of each document in the page, in order. The
+///        view is only valid during the call.
+///
+/// \returns the number of documents visited
+///
+
+///
+/// \fn ops::mongodb::page_cursor::next() const
+///
+/// \returns the token for the next page, or an empty string if this is the
+///          last page. Only known once page_cursor::for_each has returned.
+///
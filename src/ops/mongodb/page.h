@@ -3,7 +3,15 @@
 ///
 #pragma once
 
+#include <algorithm>
+#include <bsoncxx/builder/basic/array.hpp>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
 #include <vector>
 #include "document.h"
 
@@ -11,6 +19,19 @@ namespace ops
 {
 namespace mongodb
 {
+    enum class page_total
+    {
+        none,
+        estimated,
+        cached
+    };
+
+    page_total page_total_from(const std::string& str);
+
+    bsoncxx::document::value projection_from(const std::string& fields);
+
+    template <typename T> class page_cursor;
+
     template <typename T, template <typename> class Container = std::vector>
     class page
     {
@@ -19,37 +40,70 @@ namespace mongodb
         page(Container<document<T>>&& collection,
              const std::size_t offset,
              const std::size_t size,
-             const std::size_t total);
+             std::optional<std::size_t> total,
+             std::string next);
 
     public:
         static constexpr std::int64_t DefaultLimit = 60;
+        static constexpr std::int64_t MaxLimit     = 1000;
+
+        static constexpr std::chrono::seconds CountTtl{10};
 
         document<T> at(const std::size_t pos) const;
 
+        std::optional<std::size_t> total() const;
+        const std::string& next() const;
+
         static page<T> get(const std::int64_t skip  = 0,
-                           const std::int64_t limit = DefaultLimit);
+                           const std::int64_t limit = DefaultLimit,
+                           const page_total totals  = page_total::none,
+                           bsoncxx::document::view projection = {});
+
+        static page<T> after(const std::string& token,
+                             const std::int64_t limit = DefaultLimit,
+                             const page_total totals  = page_total::none,
+                             bsoncxx::document::view projection = {});
 
         iterator begin() noexcept;
         iterator end() noexcept;
 
     private:
-        Container<document<T>> _collection;
-        std::size_t            _offset;
-        std::size_t            _size;
-        std::size_t            _total;
+        friend class page_cursor<T>;
+
+        static bsoncxx::document::value filter_after(const std::string& token);
+
+        static mongocxx::options::find find_options(const std::int64_t skip,
+                                                    const std::int64_t limit,
+                                                    bsoncxx::document::view projection);
+
+        static page<T> fetch(bsoncxx::document::view filter,
+                             const std::int64_t skip,
+                             const std::int64_t limit,
+                             const page_total totals,
+                             bsoncxx::document::view projection);
+
+        static std::optional<std::size_t> count(mongocxx::collection& collection,
+                                                const page_total totals);
+
+        Container<document<T>>     _collection;
+        std::size_t                _offset;
+        std::size_t                _size;
+        std::optional<std::size_t> _total;
+        std::string                _next;
     };
 
     template <typename T, template <typename> class Container>
     page<T, Container>::page(Container<document<T>>&& collection,
                              const std::size_t offset,
                              const std::size_t size,
-                             const std::size_t total)
+                             std::optional<std::size_t> total,
+                             std::string next)
       : _collection{std::move(collection)},
         _offset{offset},
         _size{size},
-        _total{total}
+        _total{total},
+        _next{std::move(next)}
     {
-        assert(total >= collection.size());
     }
 
     template <typename T, template <typename> class Container>
@@ -58,27 +112,165 @@ namespace mongodb
         return _collection.at(pos);
     }
 
+    template <typename T, template <typename> class Container>
+    std::optional<std::size_t> page<T, Container>::total() const
+    {
+        return _total;
+    }
+
+    template <typename T, template <typename> class Container>
+    const std::string& page<T, Container>::next() const
+    {
+        return _next;
+    }
+
     template <typename T, template <typename> class Container>
     page<T> page<T, Container>::get(const std::int64_t skip,
-                                    const std::int64_t limit)
+                                    const std::int64_t limit,
+                                    const page_total totals,
+                                    bsoncxx::document::view projection)
+    {
+        return fetch(bsoncxx::document::view{}, skip, limit, totals, projection);
+    }
+
+    template <typename T, template <typename> class Container>
+    page<T> page<T, Container>::after(const std::string& token,
+                                      const std::int64_t limit,
+                                      const page_total totals,
+                                      bsoncxx::document::view projection)
     {
+        const auto filter = filter_after(token);
+
+        return fetch(filter.view(), 0, limit, totals, projection);
+    }
+
+    template <typename T, template <typename> class Container>
+    bsoncxx::document::value page<T, Container>::filter_after(const std::string& token)
+    {
+        if (token.empty()) {
+            return make_document();
+        }
+
+        if (24 != token.size()
+            || std::string::npos != token.find_first_not_of("0123456789abcdef"))
+        {
+            throw std::invalid_argument{"bad page token"};
+        }
+
+        return make_document(
+            kvp("_id", make_document(kvp("$gt", bsoncxx::oid{token}))));
+    }
+
+    template <typename T, template <typename> class Container>
+    mongocxx::options::find page<T, Container>::find_options(const std::int64_t skip,
+                                                             const std::int64_t limit,
+                                                             bsoncxx::document::view projection)
+    {
+        if (limit <= 0 || limit > MaxLimit) {
+            throw std::invalid_argument{"bad page limit"};
+        }
+
         mongocxx::options::find opts{};
+        opts.sort(make_document(kvp("_id", 1)));
         opts.skip(skip);
-        opts.limit(limit);
+        // Fetch one extra document to find out if there is a next page
+        opts.limit(limit + 1);
+
+        if (!projection.empty()) {
+            opts.projection(projection);
+        }
 
-        auto collection = pool::instance().database().collection(T::collection);
-        auto cursor = collection.find({}, opts);
+        return opts;
+    }
+
+    template <typename T, template <typename> class Container>
+    page<T> page<T, Container>::fetch(bsoncxx::document::view filter,
+                                      const std::int64_t skip,
+                                      const std::int64_t limit,
+                                      const page_total totals,
+                                      bsoncxx::document::view projection)
+    {
+        const auto opts = find_options(skip, limit, projection);
+
+        auto lease = pool::instance().acquire();
+        auto collection = lease.collection(T::collection);
+        auto cursor = collection.find(filter, opts);
 
         Container<document<T>> container{};
+        std::string next{};
 
-        for (const bsoncxx::document::view& bson : cursor)
+        for (const bsoncxx::document::view& bson : cursor) {
+            if (static_cast<std::int64_t>(container.size()) == limit) {
+                next = container.back().view()["_id"].get_oid().value.to_string();
+                break;
+            }
             container.emplace_back(document<T>{bson});
+        }
 
         return page<T>{
-            std::move(container), 
-            static_cast<std::size_t>(skip), 
+            std::move(container),
+            static_cast<std::size_t>(skip),
             static_cast<std::size_t>(limit),
-            static_cast<std::size_t>(collection.count({}))};
+            count(collection, totals),
+            std::move(next)};
+    }
+
+    template <typename T, template <typename> class Container>
+    std::optional<std::size_t> page<T, Container>::count(mongocxx::collection& collection,
+                                                         const page_total totals)
+    {
+        struct cached_count
+        {
+            std::mutex                            mutex;
+            std::condition_variable               counted;
+            std::optional<std::size_t>            value;
+            std::chrono::steady_clock::time_point expires;
+            bool                                  refreshing = false;
+        };
+
+        static cached_count cache{};
+
+        switch (totals)
+        {
+        case page_total::estimated:
+            return static_cast<std::size_t>(collection.estimated_document_count());
+        case page_total::cached:
+        {
+            std::unique_lock<std::mutex> lock{cache.mutex};
+
+            // Only one caller counts at a time; the others are served the
+            // stale value, or wait for the first count to finish
+            cache.counted.wait(lock, [] { return !cache.refreshing || cache.value; });
+
+            if (cache.refreshing || std::chrono::steady_clock::now() < cache.expires) {
+                return cache.value;
+            }
+
+            cache.refreshing = true;
+            lock.unlock();
+
+            std::size_t value = 0;
+            try {
+                value = static_cast<std::size_t>(collection.count_documents({}));
+            } catch (...) {
+                lock.lock();
+                cache.refreshing = false;
+                cache.counted.notify_all();
+                throw;
+            }
+
+            lock.lock();
+            cache.value = value;
+            cache.expires = std::chrono::steady_clock::now() + CountTtl;
+            cache.refreshing = false;
+            cache.counted.notify_all();
+
+            return value;
+        }
+        case page_total::none:
+        default:
+            return std::nullopt;
+        }
     }
 
     template <typename T, template <typename> class Container>
@@ -92,5 +284,173 @@ namespace mongodb
     {
         return _collection.end();
     }
+
+    template <typename T>
+    class page_cursor
+    {
+    public:
+        static constexpr std::int32_t BatchSize = 100;
+
+        page_cursor(page_cursor&&) = default;
+
+        static page_cursor<T> get(const std::int64_t skip  = 0,
+                                  const std::int64_t limit = page<T>::DefaultLimit,
+                                  const page_total totals  = page_total::none,
+                                  bsoncxx::document::view projection = {});
+
+        static page_cursor<T> after(const std::string& token,
+                                    const std::int64_t limit = page<T>::DefaultLimit,
+                                    const page_total totals  = page_total::none,
+                                    bsoncxx::document::view projection = {});
+
+        template <typename F> std::size_t for_each(F f);
+
+        std::optional<std::size_t> total() const;
+        const std::string& next() const;
+
+    private:
+        page_cursor(bsoncxx::document::view filter,
+                    const std::int64_t skip,
+                    const std::int64_t limit,
+                    const page_total totals,
+                    bsoncxx::document::view projection);
+
+        void fetch(mongocxx::collection& collection,
+                   const std::int64_t visited,
+                   const bsoncxx::oid& last);
+
+        bsoncxx::document::value              _filter;
+        bsoncxx::document::value              _projection;
+        std::int64_t                          _skip;
+        std::int64_t                          _limit;
+        std::vector<bsoncxx::document::value> _batch;
+        bool                                  _exhausted;
+        std::optional<std::size_t>            _total;
+        std::string                           _next;
+    };
+
+    template <typename T>
+    page_cursor<T>::page_cursor(bsoncxx::document::view filter,
+                                const std::int64_t skip,
+                                const std::int64_t limit,
+                                const page_total totals,
+                                bsoncxx::document::view projection)
+      : _filter{filter},
+        _projection{projection},
+        _skip{skip},
+        _limit{limit},
+        _exhausted{false}
+    {
+        auto lease = pool::instance().acquire();
+        auto collection = lease.collection(T::collection);
+
+        // Run the query now, so that errors are reported before the caller
+        // starts sending a response
+        fetch(collection, 0, bsoncxx::oid{});
+        _total = page<T>::count(collection, totals);
+    }
+
+    template <typename T>
+    page_cursor<T> page_cursor<T>::get(const std::int64_t skip,
+                                       const std::int64_t limit,
+                                       const page_total totals,
+                                       bsoncxx::document::view projection)
+    {
+        return page_cursor<T>{bsoncxx::document::view{}, skip, limit, totals, projection};
+    }
+
+    template <typename T>
+    page_cursor<T> page_cursor<T>::after(const std::string& token,
+                                         const std::int64_t limit,
+                                         const page_total totals,
+                                         bsoncxx::document::view projection)
+    {
+        const auto filter = page<T>::filter_after(token);
+
+        return page_cursor<T>{filter.view(), 0, limit, totals, projection};
+    }
+
+    template <typename T>
+    void page_cursor<T>::fetch(mongocxx::collection& collection,
+                               const std::int64_t visited,
+                               const bsoncxx::oid& last)
+    {
+        using bsoncxx::builder::basic::make_array;
+
+        // One extra document tells whether there is a next page
+        const std::int64_t wanted = _limit - visited + 1;
+        const std::int64_t size   = std::min<std::int64_t>(wanted, BatchSize);
+
+        auto opts = page<T>::find_options(0 == visited ? _skip : 0, _limit, _projection.view());
+        opts.limit(size);
+        opts.batch_size(static_cast<std::int32_t>(size));
+
+        _batch.clear();
+
+        if (0 == visited) {
+            for (const bsoncxx::document::view& view : collection.find(_filter.view(), opts)) {
+                _batch.emplace_back(view);
+            }
+        } else {
+            // Continue after the last document handed out, rather than
+            // keeping a cursor open on the server
+            const auto filter = make_document(kvp(
+                "$and",
+                make_array(_filter.view(),
+                           make_document(kvp("_id", make_document(kvp("$gt", last)))))));
+
+            for (const bsoncxx::document::view& view : collection.find(filter.view(), opts)) {
+                _batch.emplace_back(view);
+            }
+        }
+
+        _exhausted = size == wanted || static_cast<std::int64_t>(_batch.size()) < size;
+    }
+
+    template <typename T>
+    template <typename F>
+    std::size_t page_cursor<T>::for_each(F f)
+    {
+        std::int64_t n = 0;
+        bsoncxx::oid last{};
+
+        for (;;) {
+            for (const auto& bson : _batch) {
+                if (n == _limit) {
+                    _next = last.to_string();
+                    return static_cast<std::size_t>(n);
+                }
+
+                last = bson.view()["_id"].get_oid().value;
+                f(bson.view());
+                ++n;
+            }
+
+            if (_exhausted) {
+                break;
+            }
+
+            // The connection is only held while a batch is read, not while
+            // \a f writes it to a possibly slow client
+            auto lease = pool::instance().acquire();
+            auto collection = lease.collection(T::collection);
+
+            fetch(collection, n, last);
+        }
+
+        return static_cast<std::size_t>(n);
+    }
+
+    template <typename T>
+    std::optional<std::size_t> page_cursor<T>::total() const
+    {
+        return _total;
+    }
+
+    template <typename T>
+    const std::string& page_cursor<T>::next() const
+    {
+        return _next;
+    }
 }
 }
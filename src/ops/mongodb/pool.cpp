@@ -1,9 +1,17 @@
 #include "pool.h"
-#include <iostream>
+#include <algorithm>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
 #include <mongocxx/client.hpp>
 #include <mongocxx/instance.hpp>
+#include <mongocxx/options/client.hpp>
+#include <mongocxx/options/pool.hpp>
 #include <mongocxx/pool.hpp>
 #include <stdexcept>
+#include <vector>
+#include "../http/metrics.h"
+#include "../util/logger.h"
+#include "monitor.h"
 
 namespace ops
 {
@@ -16,9 +24,10 @@ static mongocxx::instance instance{};
 /// \class pool
 ///
 /// \brief MongoDB database connection pool
-/// 
-/// This is a singleton class. Call pool::init (once), passing the name of the 
-/// database used in the application, to initialize the connection pool:
+///
+/// This is a singleton class, shared by all threads in the process. Call
+/// pool::init (once), passing the name of the database used in the
+/// application, to initialize the connection pool:
 ///
 /// \code
 /// int main()
@@ -31,16 +40,34 @@ static mongocxx::instance instance{};
 /// }
 /// \endcode
 ///
-/// Then use pool::instance to access the singleton.
+/// Then use pool::instance to access the singleton, and pool::acquire to
+/// lease a client for the duration of an operation.
 ///
 /// \code
-/// auto db = ops::mongodb::pool::instance();
-/// auto client = db.acquire_entry();
+/// auto lease = ops::mongodb::pool::instance().acquire();
+/// auto collection = lease.collection("campaigns");
 /// \endcode
 ///
-/// \sa pool::instance
+/// At most options::max_size clients are leased at any time. Callers beyond
+/// that wait for a client to be returned, and pool::acquire throws if none
+/// becomes available within options::wait_timeout.
+///
+/// \sa pool::instance, lease
 ///
 
+///
+/// \brief Upper bounds of the wait time histogram buckets. The last bucket
+///        counts everything above the last bound.
+///
+const std::array<std::chrono::microseconds, pool::WaitBuckets - 1> pool::wait_bounds{
+    std::chrono::microseconds{10},
+    std::chrono::microseconds{100},
+    std::chrono::microseconds{1000},
+    std::chrono::microseconds{10000},
+    std::chrono::microseconds{100000},
+    std::chrono::microseconds{1000000}
+};
+
 ///
 /// \returns the database pool singleton instance
 ///
@@ -50,51 +77,310 @@ mongodb::pool& pool::instance()
         throw std::runtime_error{"pool::init has not been called"};
     }
 
-    static thread_local mongodb::pool instance{};
+    static mongodb::pool instance{};
     return instance;
 }
 
 ///
-/// \returns the database used by this application
+/// \brief Lease a client from the pool, waiting for one to become available
+///        if the pool is exhausted.
+///
+/// \returns a lease which returns the client to the pool when destroyed
+///
+mongodb::lease pool::acquire()
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+
+        if (_in_use >= _options.max_size) {
+            ++_waiting;
+            const bool available = _available.wait_for(lock, _options.wait_timeout, [this]() {
+                return _in_use < _options.max_size;
+            });
+            --_waiting;
+
+            if (!available) {
+                ++_timeouts;
+                throw std::runtime_error{"timed out waiting for a database connection"};
+            }
+        }
+
+        ++_in_use;
+        ++_acquired;
+    }
+
+    record_wait(std::chrono::steady_clock::now() - start);
+
+    try {
+        return lease{_pool->acquire(), this};
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+///
+/// \returns a snapshot of the pool's usage counters
 ///
-mongocxx::database pool::database() const
+pool::statistics pool::stats() const
 {
-    const auto client = acquire_entry();
-    return client->database(_database);
+    statistics stats{};
+
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        stats.in_use   = _in_use;
+        stats.waiting  = _waiting;
+        stats.acquired = _acquired;
+        stats.timeouts = _timeouts;
+    }
+
+    for (std::size_t i = 0; i < WaitBuckets; ++i) {
+        stats.wait_time[i] = _wait_time[i].load(std::memory_order_relaxed);
+    }
+
+    stats.wait_us = _wait_us.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+///
+/// \brief Write the usage counters and the wait time histogram of the pool
+///        in the Prometheus text format, for a scrape.
+///
+void pool::collect(std::ostream& out) const
+{
+    using http::metrics;
+
+    const auto s = stats();
+
+    metrics::gauge(out, "mongodb_pool_in_use",
+        "Database connections leased.", s.in_use);
+    metrics::gauge(out, "mongodb_pool_waiting",
+        "Requests waiting for a database connection.", s.waiting);
+    metrics::counter(out, "mongodb_pool_acquired_total",
+        "Database connections acquired.", s.acquired);
+    metrics::counter(out, "mongodb_pool_timeouts_total",
+        "Waits for a database connection which timed out.", s.timeouts);
+
+    std::vector<double> bounds{};
+    for (const auto bound : wait_bounds) {
+        bounds.push_back(std::chrono::duration<double>(bound).count());
+    }
+
+    metrics::header(out, "mongodb_pool_wait_seconds",
+        "Time to acquire a database connection.", "histogram");
+    metrics::histogram(out, "mongodb_pool_wait_seconds", "", bounds,
+        {s.wait_time.begin(), s.wait_time.end()}, s.wait_us / 1e6);
 }
 
 ///
 /// \brief Initialize the database connection pool.
 ///
-/// \param db  the name of the MongoDB database used in this application
-/// \param uri a valid MongoDB connection string
+/// \param db   the name of the MongoDB database used in this application
+/// \param uri  a valid MongoDB connection string
+/// \param opts pool size, wait timeout and warm-up configuration
 ///
 /// \sa https://docs.mongodb.com/manual/reference/connection-string/
 ///
-void pool::init(const std::string& db, const std::string& uri)
+void pool::init(const std::string& db, const std::string& uri, const options& opts)
 {
     if (!_initialized) {
         _uri = uri;
         _database = db;
+        _options = opts;
         _initialized = true;
+
+        if (_options.warm_up) {
+            instance().warm_up();
+        }
     } else {
-        std::cout << "notice: calling pool::init more than once has no effect" << std::endl;
+        util::log::notice("calling pool::init more than once has no effect");
+    }
+}
+
+pool::pool()
+  : _pool{std::make_unique<mongocxx::pool>(pool_uri(), mongocxx::options::pool{
+        mongocxx::options::client{}.apm_opts(monitor::instance().apm())})},
+    _in_use{0},
+    _waiting{0},
+    _acquired{0},
+    _timeouts{0},
+    _wait_us{0}
+{
+    for (auto& bucket : _wait_time) {
+        bucket = 0;
+    }
+}
+
+///
+/// \brief Open options::min_size connections up front, so that the first
+///        requests do not pay for connection setup.
+///
+void pool::warm_up()
+{
+    using bsoncxx::builder::basic::kvp;
+    using bsoncxx::builder::basic::make_document;
+
+    std::vector<lease> leases{};
+
+    const auto count = std::min(_options.min_size, _options.max_size);
+
+    try {
+        for (std::size_t i = 0; i < count; ++i) {
+            leases.emplace_back(acquire());
+            leases.back().database().run_command(make_document(kvp("ping", 1)));
+        }
+    } catch (const std::exception& e) {
+        util::log::notice("connection pool warm-up failed", {{"error", e.what()}});
+    }
+}
+
+void pool::release()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        --_in_use;
+    }
+
+    _available.notify_one();
+}
+
+void pool::record_wait(std::chrono::steady_clock::duration elapsed)
+{
+    std::size_t i = 0;
+
+    while (i < wait_bounds.size() && elapsed > wait_bounds[i]) {
+        ++i;
     }
+
+    _wait_time[i].fetch_add(1, std::memory_order_relaxed);
+    _wait_us.fetch_add(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()),
+        std::memory_order_relaxed);
 }
 
-pool::pool() : _pool{std::make_shared<mongocxx::pool>(mongocxx::uri{_uri})}
+///
+/// \brief Pass the pool size limits on to the driver, unless the connection
+///        string already sets them. The driver keeps up to minPoolSize idle
+///        clients open, and never blocks in acquire since pool::acquire caps
+///        the number of leases at maxPoolSize.
+///
+mongocxx::uri pool::pool_uri()
 {
+    std::string uri{_uri};
+
+    const auto append = [&uri](const std::string& option) {
+        if (std::string::npos == uri.find('?')) {
+            const auto scheme = uri.find("://");
+            if (std::string::npos == uri.find('/', std::string::npos == scheme ? 0 : scheme + 3)) {
+                uri += '/';
+            }
+            uri += '?';
+        } else if ('?' != uri.back() && '&' != uri.back()) {
+            uri += '&';
+        }
+        uri += option;
+    };
+
+    if (std::string::npos == uri.find("maxPoolSize")) {
+        append("maxPoolSize=" + std::to_string(_options.max_size));
+    }
+
+    if (_options.min_size > 0 && std::string::npos == uri.find("minPoolSize")) {
+        append("minPoolSize=" + std::to_string(_options.min_size));
+    }
+
+    return mongocxx::uri{uri};
 }
 
 ///
-/// \fn pool::acquire_entry
+/// \struct pool_options
 ///
-/// \brief Acquire a client from the database connection pool.
+/// \brief Connection pool configuration
+///
+
+///
+/// \struct pool::statistics
+///
+/// \brief Connection pool usage counters, with a histogram of the time spent
+///        in pool::acquire
 ///
 
 bool pool::_initialized = false;
 std::string pool::_uri;
 std::string pool::_database;
+pool::options pool::_options;
+
+///
+/// \class lease
+///
+/// \brief A client leased from the connection pool
+///
+/// The client, and any database or collection object obtained from it, may
+/// only be used while the lease is alive. The client is returned to the
+/// pool when the lease is destroyed.
+///
+
+lease::lease(mongocxx::pool::entry&& entry, mongodb::pool* owner)
+  : _entry{std::move(entry)},
+    _owner{owner}
+{
+}
+
+lease::lease(lease&& other) noexcept
+  : _entry{std::move(other._entry)},
+    _owner{other._owner}
+{
+    other._owner = nullptr;
+}
+
+lease& lease::operator=(lease&& other) noexcept
+{
+    if (this != &other) {
+        reset();
+        _entry = std::move(other._entry);
+        _owner = other._owner;
+        other._owner = nullptr;
+    }
+
+    return *this;
+}
+
+lease::~lease()
+{
+    reset();
+}
+
+///
+/// \returns the database used by this application
+///
+mongocxx::database lease::database() const
+{
+    return _entry->database(pool::_database);
+}
+
+void lease::reset()
+{
+    if (_owner) {
+        _entry.reset();
+        _owner->release();
+        _owner = nullptr;
+    }
+}
+
+///
+/// \fn lease::client
+///
+/// \returns the leased client
+///
+
+///
+/// \fn lease::collection
+///
+/// \returns the collection with the given name in the application database
+///
 
 } // namespace mongodb
 } // namespace ops
@@ -3,38 +3,124 @@
 ///
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mongocxx/collection.hpp>
 #include <mongocxx/database.hpp>
 #include <mongocxx/pool.hpp>
+#include <mutex>
+#include <ostream>
 #include <string>
 
 namespace ops
 {
 namespace mongodb
 {
+    class lease;
+
+    struct pool_options
+    {
+        std::size_t               min_size     = 0;
+        std::size_t               max_size     = 100;
+        std::chrono::milliseconds wait_timeout = std::chrono::seconds{5};
+        bool                      warm_up      = false;
+    };
+
     class pool
     {
     public:
+        using options = pool_options;
+
+        static constexpr std::size_t WaitBuckets = 7;
+
+        struct statistics
+        {
+            std::size_t                            in_use;
+            std::size_t                            waiting;
+            std::uint64_t                          acquired;
+            std::uint64_t                          timeouts;
+            std::array<std::uint64_t, WaitBuckets> wait_time;
+            std::uint64_t                          wait_us;
+        };
+
+        static const std::array<std::chrono::microseconds, WaitBuckets - 1> wait_bounds;
+
         static mongodb::pool& instance();
 
-        mongocxx::pool::entry acquire_entry() const;
-        mongocxx::database database() const;
+        mongodb::lease acquire();
+
+        statistics stats() const;
+        void collect(std::ostream& out) const;
 
         static void init(
             const std::string& db,
-            const std::string& uri = "mongodb://localhost:27017");
+            const std::string& uri = "mongodb://localhost:27017",
+            const options& opts    = options{});
 
     private:
+        friend class lease;
+
         pool();
 
+        void warm_up();
+        void release();
+        void record_wait(std::chrono::steady_clock::duration elapsed);
+
+        static mongocxx::uri pool_uri();
+
         static bool                     _initialized;
         static std::string              _uri;
         static std::string              _database;
-        std::shared_ptr<mongocxx::pool> _pool;
+        static options                  _options;
+        std::unique_ptr<mongocxx::pool> _pool;
+        mutable std::mutex              _mutex;
+        std::condition_variable         _available;
+        std::size_t                     _in_use;
+        std::size_t                     _waiting;
+        std::uint64_t                   _acquired;
+        std::uint64_t                   _timeouts;
+
+        std::array<std::atomic<std::uint64_t>, WaitBuckets> _wait_time;
+        std::atomic<std::uint64_t>                          _wait_us;
+    };
+
+    class lease
+    {
+    public:
+        lease(lease&& other) noexcept;
+        lease& operator=(lease&& other) noexcept;
+
+        ~lease();
+
+        lease(const lease&) = delete;
+        lease& operator=(const lease&) = delete;
+
+        mongocxx::client& client() const;
+        mongocxx::database database() const;
+        mongocxx::collection collection(const std::string& name) const;
+
+    private:
+        friend class pool;
+
+        lease(mongocxx::pool::entry&& entry, mongodb::pool* owner);
+
+        void reset();
+
+        mongocxx::pool::entry _entry;
+        mongodb::pool*        _owner;
     };
 
-    inline mongocxx::pool::entry pool::acquire_entry() const
+    inline mongocxx::client& lease::client() const
+    {
+        return *_entry;
+    }
+
+    inline mongocxx::collection lease::collection(const std::string& name) const
     {
-        return _pool->acquire();
+        return database().collection(name);
     }
 }
 }
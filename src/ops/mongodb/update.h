@@ -0,0 +1,147 @@
+///
+/// \file update.h
+///
+#pragma once
+
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/builder/concatenate.hpp>
+#include <bsoncxx/document/value.hpp>
+#include <bsoncxx/document/view.hpp>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace ops
+{
+namespace mongodb
+{
+    ///
+    /// Thrown when a guarded update finds the document, but not in the
+    /// expected version.
+    ///
+    class version_conflict : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    class update
+    {
+    public:
+        static constexpr auto Version = "version";
+
+        template <typename V>
+        update& set(const std::string& path, V&& value);
+
+        update& set(bsoncxx::document::view fields);
+        update& unset(const std::string& path);
+        update& inc(const std::string& path, std::int64_t n = 1);
+
+        bool empty() const;
+
+        bsoncxx::document::value extract();
+
+    private:
+        bsoncxx::builder::basic::document _set;
+        bsoncxx::builder::basic::document _unset;
+        bsoncxx::builder::basic::document _inc;
+        bool                              _has_set   = false;
+        bool                              _has_unset = false;
+        bool                              _has_inc   = false;
+    };
+
+    ///
+    /// \brief Check that a name taken from a request can be used as one
+    ///        field of a path in dot notation.
+    ///
+    /// \returns \a name
+    ///
+    /// \throws std::invalid_argument if \a name is empty, starts with `$` or
+    ///         contains a `.`
+    ///
+    inline const std::string& field_name(const std::string& name)
+    {
+        if (name.empty() || '$' == name.front() || std::string::npos != name.find('.')) {
+            throw std::invalid_argument{"bad field name: " + name};
+        }
+
+        return name;
+    }
+
+    ///
+    /// \brief Set the field at \a path (in dot notation) to \a value.
+    ///
+    template <typename V>
+    update& update::set(const std::string& path, V&& value)
+    {
+        _set.append(bsoncxx::builder::basic::kvp(path, std::forward<V>(value)));
+        _has_set = true;
+        return *this;
+    }
+
+    ///
+    /// \brief Set every field of \a fields, whose keys are paths in dot
+    ///        notation.
+    ///
+    inline update& update::set(bsoncxx::document::view fields)
+    {
+        if (!fields.empty()) {
+            _set.append(bsoncxx::builder::concatenate(fields));
+            _has_set = true;
+        }
+        return *this;
+    }
+
+    ///
+    /// \brief Remove the field at \a path.
+    ///
+    inline update& update::unset(const std::string& path)
+    {
+        _unset.append(bsoncxx::builder::basic::kvp(path, ""));
+        _has_unset = true;
+        return *this;
+    }
+
+    ///
+    /// \brief Increment the number at \a path, creating it if it is missing.
+    ///
+    inline update& update::inc(const std::string& path, std::int64_t n)
+    {
+        _inc.append(bsoncxx::builder::basic::kvp(path, n));
+        _has_inc = true;
+        return *this;
+    }
+
+    inline bool update::empty() const
+    {
+        return !_has_set && !_has_unset && !_has_inc;
+    }
+
+    ///
+    /// \returns the update document, with `$set`, `$unset` and `$inc`
+    ///          operators as needed
+    ///
+    inline bsoncxx::document::value update::extract()
+    {
+        using bsoncxx::builder::basic::kvp;
+
+        bsoncxx::builder::basic::document builder{};
+
+        if (_has_set) {
+            builder.append(kvp("$set", _set.extract()));
+        }
+
+        if (_has_unset) {
+            builder.append(kvp("$unset", _unset.extract()));
+        }
+
+        if (_has_inc) {
+            builder.append(kvp("$inc", _inc.extract()));
+        }
+
+        return builder.extract();
+    }
+}
+}
@@ -0,0 +1,121 @@
+#include "atomic_file.h"
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace ops
+{
+namespace util
+{
+
+///
+/// \class atomic_file
+///
+/// \brief A file which becomes visible under its final name only once it
+///        has been written completely
+///
+/// The data is written to a temporary file in the target directory, which
+/// atomic_file::commit flushes to disk and renames into place. Readers of
+/// the final path see either nothing, or the whole file. If the object is
+/// destroyed before atomic_file::commit, e.g., because an upload failed,
+/// the temporary file is removed.
+///
+
+///
+/// \brief Create a temporary file.
+///
+/// \param directory the directory which the file will be committed to; the
+///                  rename is only atomic within one file system
+///
+/// \throws std::system_error if the file can not be created
+///
+atomic_file::atomic_file(const std::string& directory)
+  : _temp_path{directory + "/.upload-XXXXXX"},
+    _fd{-1},
+    _size{0},
+    _committed{false}
+{
+    std::vector<char> name(_temp_path.begin(), _temp_path.end());
+    name.push_back('\0');
+
+    _fd = ::mkostemp(name.data(), O_CLOEXEC);
+
+    if (_fd < 0) {
+        throw std::system_error{errno, std::generic_category(), directory};
+    }
+
+    _temp_path.assign(name.data());
+}
+
+atomic_file::~atomic_file()
+{
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+
+    if (!_committed) {
+        ::unlink(_temp_path.c_str());
+    }
+}
+
+///
+/// \brief Append data to the file.
+///
+/// \throws std::system_error on a write error, e.g., when the disk is full
+///
+void atomic_file::write(const void* data, std::size_t size)
+{
+    const char* p = static_cast<const char*>(data);
+
+    while (size > 0) {
+        const ssize_t n = ::write(_fd, p, size);
+
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            throw std::system_error{errno, std::generic_category(), _temp_path};
+        }
+
+        p += n;
+        size -= static_cast<std::size_t>(n);
+        _size += static_cast<std::size_t>(n);
+    }
+}
+
+///
+/// \brief Flush the file to disk and move it to its final path, replacing
+///        any file already there.
+///
+/// \param path the final path, in the directory passed to the constructor
+///
+/// \throws std::system_error if the file can not be flushed or renamed
+///
+void atomic_file::commit(const std::string& path)
+{
+    if (0 != ::fsync(_fd)) {
+        throw std::system_error{errno, std::generic_category(), _temp_path};
+    }
+
+    ::close(_fd);
+    _fd = -1;
+
+    if (0 != std::rename(_temp_path.c_str(), path.c_str())) {
+        throw std::system_error{errno, std::generic_category(), path};
+    }
+
+    _committed = true;
+}
+
+///
+/// \fn atomic_file::size
+///
+/// \returns the number of bytes written so far
+///
+
+} // namespace util
+} // namespace ops
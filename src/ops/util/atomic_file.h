@@ -0,0 +1,40 @@
+///
+/// \file atomic_file.h
+///
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace ops
+{
+namespace util
+{
+    class atomic_file
+    {
+    public:
+        explicit atomic_file(const std::string& directory);
+        ~atomic_file();
+
+        atomic_file(const atomic_file&) = delete;
+        atomic_file& operator=(const atomic_file&) = delete;
+
+        void write(const void* data, std::size_t size);
+
+        void commit(const std::string& path);
+
+        std::size_t size() const;
+
+    private:
+        std::string _temp_path;
+        int         _fd;
+        std::size_t _size;
+        bool        _committed;
+    };
+
+    inline std::size_t atomic_file::size() const
+    {
+        return _size;
+    }
+}
+}
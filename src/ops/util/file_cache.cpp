@@ -0,0 +1,221 @@
+#include "file_cache.h"
+#include <system_error>
+#include "../http/metrics.h"
+#include "logger.h"
+
+namespace ops
+{
+namespace util
+{
+
+///
+/// \class file_cache
+///
+/// \brief Memory-mapped files, kept while the total mapped size fits within a
+///        byte budget
+///
+/// The least recently used files are unmapped first when the budget is
+/// exceeded. A file which is evicted while a response still reads from it
+/// stays mapped until the last reference goes away. Files larger than the
+/// whole budget are mapped for the caller but not kept.
+///
+/// The cache does not notice changes to files; it is meant for files which
+/// are written once, such as uploaded media. Use file_cache::erase when a
+/// file is removed.
+///
+/// All member functions are thread-safe. Files are mapped outside the lock.
+///
+
+///
+/// \param max_bytes the byte budget
+///
+file_cache::file_cache(std::size_t max_bytes)
+  : _max_bytes{max_bytes},
+    _bytes{0},
+    _hits{0},
+    _misses{0},
+    _evictions{0},
+    _bytes_hit{0},
+    _bytes_missed{0}
+{
+}
+
+///
+/// \brief Get a mapping of a file, mapping it on a miss.
+///
+/// \param path the file to map
+///
+/// \throws std::system_error if the file can not be mapped
+///
+std::shared_ptr<const mapped_file> file_cache::get(const std::string& path)
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        const auto i = _entries.find(path);
+
+        if (_entries.end() != i) {
+            _lru.splice(_lru.begin(), _lru, i->second.position);
+            ++_hits;
+            _bytes_hit += i->second.file->size();
+            return i->second.file;
+        }
+    }
+
+    auto file = insert(path, std::make_shared<const mapped_file>(path));
+
+    std::lock_guard<std::mutex> lock{_mutex};
+    ++_misses;
+    _bytes_missed += file->size();
+
+    return file;
+}
+
+///
+/// \brief Map files ahead of their first request, and ask the kernel to read
+///        them in.
+///
+/// Files which do not exist or can not be mapped are skipped. The hit and
+/// miss counters are not affected.
+///
+/// \param paths the files to map
+///
+/// \returns the number of files that were newly mapped
+///
+std::size_t file_cache::prewarm(const std::vector<std::string>& paths)
+{
+    std::size_t mapped = 0;
+
+    for (const auto& path : paths) {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            if (_entries.end() != _entries.find(path)) {
+                continue;
+            }
+        }
+
+        try {
+            auto file = std::make_shared<const mapped_file>(path);
+            file->prefetch();
+            insert(path, std::move(file));
+            ++mapped;
+        } catch (const std::system_error& error) {
+            log::notice("can not prewarm file", {{"file", path}, {"error", error.what()}});
+        }
+    }
+
+    return mapped;
+}
+
+///
+/// \brief Drop a file from the cache.
+///
+void file_cache::erase(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    const auto i = _entries.find(path);
+
+    if (_entries.end() != i) {
+        _bytes -= i->second.file->size();
+        _lru.erase(i->second.position);
+        _entries.erase(i);
+    }
+}
+
+///
+/// \returns a snapshot of the cache counters
+///
+file_cache::statistics file_cache::stats() const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    statistics stats{};
+    stats.hits         = _hits;
+    stats.misses       = _misses;
+    stats.evictions    = _evictions;
+    stats.bytes_hit    = _bytes_hit;
+    stats.bytes_missed = _bytes_missed;
+    stats.files        = _entries.size();
+    stats.bytes        = _bytes;
+
+    return stats;
+}
+
+///
+/// \brief Write the cache counters in the Prometheus text format, for a
+///        scrape.
+///
+/// \param name the prefix of the metric names, e.g., "media_cache"
+///
+void file_cache::collect(std::ostream& out, const std::string& name) const
+{
+    using http::metrics;
+
+    const auto s = stats();
+
+    metrics::counter(out, name + "_hits_total",
+        "File lookups served from the cache.", s.hits);
+    metrics::counter(out, name + "_misses_total",
+        "File lookups which mapped the file.", s.misses);
+    metrics::counter(out, name + "_evictions_total",
+        "Files evicted from the cache.", s.evictions);
+    metrics::counter(out, name + "_hit_bytes_total",
+        "Bytes served from the cache.", s.bytes_hit);
+    metrics::counter(out, name + "_miss_bytes_total",
+        "Bytes mapped on a cache miss.", s.bytes_missed);
+    metrics::gauge(out, name + "_files",
+        "Files in the cache.", s.files);
+    metrics::gauge(out, name + "_bytes",
+        "Bytes of files in the cache.", s.bytes);
+    metrics::gauge(out, name + "_hit_ratio",
+        "Share of file lookups served from the cache.", s.hit_ratio());
+}
+
+///
+/// \brief Add a mapping as the most recently used entry and evict entries
+///        over the budget. If another thread added the same file first, its
+///        mapping is kept and returned instead.
+///
+std::shared_ptr<const mapped_file> file_cache::insert(const std::string& path,
+                                                      std::shared_ptr<const mapped_file> file)
+{
+    if (file->size() > _max_bytes) {
+        return file;
+    }
+
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    const auto i = _entries.find(path);
+
+    if (_entries.end() != i) {
+        return i->second.file;
+    }
+
+    _lru.push_front(path);
+    _entries.emplace(path, entry{file, _lru.begin()});
+    _bytes += file->size();
+
+    while (_bytes > _max_bytes) {
+        const auto victim = _entries.find(_lru.back());
+        _bytes -= victim->second.file->size();
+        _entries.erase(victim);
+        _lru.pop_back();
+        ++_evictions;
+    }
+
+    return file;
+}
+
+///
+/// \struct file_cache::statistics
+///
+/// \brief Cache usage counters
+///
+/// \a bytes_hit and \a bytes_missed add up the sizes of the files returned
+/// by file_cache::get, i.e., the bytes served from and past the cache when
+/// whole files are sent.
+///
+
+} // namespace util
+} // namespace ops
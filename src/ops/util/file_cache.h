@@ -0,0 +1,82 @@
+///
+/// \file file_cache.h
+///
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "mapped_file.h"
+
+namespace ops
+{
+namespace util
+{
+    class file_cache
+    {
+    public:
+        struct statistics
+        {
+            std::uint64_t hits;
+            std::uint64_t misses;
+            std::uint64_t evictions;
+            std::uint64_t bytes_hit;
+            std::uint64_t bytes_missed;
+            std::size_t   files;
+            std::size_t   bytes;
+
+            double hit_ratio() const;
+        };
+
+        explicit file_cache(std::size_t max_bytes);
+
+        file_cache(const file_cache&) = delete;
+        file_cache& operator=(const file_cache&) = delete;
+
+        std::shared_ptr<const mapped_file> get(const std::string& path);
+
+        std::size_t prewarm(const std::vector<std::string>& paths);
+
+        void erase(const std::string& path);
+
+        statistics stats() const;
+        void collect(std::ostream& out, const std::string& name) const;
+
+    private:
+        using lru_list = std::list<std::string>;
+
+        struct entry
+        {
+            std::shared_ptr<const mapped_file> file;
+            lru_list::iterator                 position;
+        };
+
+        std::shared_ptr<const mapped_file> insert(const std::string& path,
+                                                  std::shared_ptr<const mapped_file> file);
+
+        const std::size_t                      _max_bytes;
+        mutable std::mutex                     _mutex;
+        std::unordered_map<std::string, entry> _entries;
+        lru_list                               _lru;
+        std::size_t                            _bytes;
+        std::uint64_t                          _hits;
+        std::uint64_t                          _misses;
+        std::uint64_t                          _evictions;
+        std::uint64_t                          _bytes_hit;
+        std::uint64_t                          _bytes_missed;
+    };
+
+    inline double file_cache::statistics::hit_ratio() const
+    {
+        const auto total = hits + misses;
+
+        return total > 0 ? static_cast<double>(hits) / static_cast<double>(total) : 0.0;
+    }
+}
+}
@@ -1,5 +1,17 @@
 #include "json.h"
 #include <boost/algorithm/string.hpp>
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/json.hpp>
+#include <bsoncxx/types.hpp>
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../mongodb/update.h"
 
 namespace ops
 {
@@ -8,6 +20,334 @@ namespace util
 namespace json
 {
 
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::builder::basic::make_document;
+using bsoncxx::builder::basic::sub_array;
+using bsoncxx::builder::basic::sub_document;
+
+namespace
+{
+    template <typename Element>
+    nlohmann::json from_element(const Element& element);
+
+    template <typename View>
+    nlohmann::json from_array(const View& view)
+    {
+        auto j = nlohmann::json::array();
+
+        for (const auto& element : view) {
+            j.push_back(from_element(element));
+        }
+
+        return j;
+    }
+
+    nlohmann::json from_document(bsoncxx::document::view view)
+    {
+        auto j = nlohmann::json::object();
+
+        for (const auto& element : view) {
+            const auto key = element.key();
+            j.emplace(std::string{key.data(), key.size()}, from_element(element));
+        }
+
+        return j;
+    }
+
+    ///
+    /// Produces the same output as the legacy extended JSON mode of
+    /// bsoncxx::to_json, which is what documents were previously parsed from.
+    ///
+    template <typename Element>
+    nlohmann::json from_element(const Element& element)
+    {
+        switch (element.type())
+        {
+        case bsoncxx::type::k_double:
+            return element.get_double().value;
+        case bsoncxx::type::k_utf8:
+        {
+            const auto str = element.get_utf8().value;
+            return std::string{str.data(), str.size()};
+        }
+        case bsoncxx::type::k_document:
+            return from_document(element.get_document().value);
+        case bsoncxx::type::k_array:
+            return from_array(element.get_array().value);
+        case bsoncxx::type::k_bool:
+            return element.get_bool().value;
+        case bsoncxx::type::k_null:
+            return nullptr;
+        case bsoncxx::type::k_int32:
+            return element.get_int32().value;
+        case bsoncxx::type::k_int64:
+            return element.get_int64().value;
+        case bsoncxx::type::k_oid:
+            return { {"$oid", element.get_oid().value.to_string()} };
+        case bsoncxx::type::k_date:
+            return { {"$date", element.get_date().to_int64()} };
+        case bsoncxx::type::k_decimal128:
+            return { {"$numberDecimal", element.get_decimal128().value.to_string()} };
+        case bsoncxx::type::k_timestamp:
+        {
+            const auto ts = element.get_timestamp();
+            return { {"$timestamp", { {"t", ts.timestamp}, {"i", ts.increment} }} };
+        }
+        default:
+        {
+            // Rarely used types go through the slow path
+            const auto doc = make_document(kvp("v", element.get_value()));
+            return nlohmann::json::parse(bsoncxx::to_json(doc.view()))["v"];
+        }
+        }
+    }
+
+    // Extended JSON keys of the rarely used types which from_element leaves
+    // to bsoncxx::to_json
+    const std::set<std::string> slow_path_keys{
+        "$binary", "$code", "$dbPointer", "$maxKey", "$minKey", "$numberLong",
+        "$regex", "$symbol", "$undefined"
+    };
+
+    ///
+    /// \returns true if \a j is an extended JSON form of one of those types,
+    ///          e.g., `{"$binary": "...", "$type": "00"}`
+    ///
+    bool slow_path(const nlohmann::json& j)
+    {
+        if (j.empty() || j.size() > 2) {
+            return false;
+        }
+
+        bool known = false;
+
+        for (auto i = j.begin(); i != j.end(); ++i) {
+            if (i.key().empty() || '$' != i.key().front()) {
+                return false;
+            }
+            known = known || slow_path_keys.count(i.key()) > 0;
+        }
+
+        return known;
+    }
+
+    template <typename Builder>
+    void append_members(Builder& builder, const nlohmann::json& j);
+
+    void append_elements(sub_array& builder, const nlohmann::json& j);
+
+    ///
+    /// Call \a append with the BSON representation of the value \a j.
+    ///
+    template <typename Append>
+    void append_value(const nlohmann::json& j, Append&& append)
+    {
+        using value_t = nlohmann::json::value_t;
+
+        switch (j.type())
+        {
+        case value_t::boolean:
+            append(j.get<bool>());
+            break;
+        case value_t::number_integer:
+        {
+            const auto value = j.get<std::int64_t>();
+            if (value >= std::numeric_limits<std::int32_t>::min()
+                && value <= std::numeric_limits<std::int32_t>::max())
+            {
+                append(static_cast<std::int32_t>(value));
+            } else {
+                append(value);
+            }
+            break;
+        }
+        case value_t::number_unsigned:
+        {
+            const auto value = j.get<std::uint64_t>();
+            if (value <= static_cast<std::uint64_t>(std::numeric_limits<std::int32_t>::max())) {
+                append(static_cast<std::int32_t>(value));
+            } else if (value <= static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max())) {
+                append(static_cast<std::int64_t>(value));
+            } else {
+                append(static_cast<double>(value));
+            }
+            break;
+        }
+        case value_t::number_float:
+            append(j.get<double>());
+            break;
+        case value_t::string:
+            append(j.get_ref<const std::string&>());
+            break;
+        case value_t::array:
+            append([&j](sub_array sub_builder) { append_elements(sub_builder, j); });
+            break;
+        case value_t::object:
+        {
+            // Extended JSON forms produced by from_bson
+            if (1 == j.size()) {
+                const auto& item = j.begin();
+                if ("$oid" == item.key() && item->is_string()) {
+                    append(bsoncxx::oid{item->get_ref<const std::string&>()});
+                    break;
+                }
+                if ("$date" == item.key() && item->is_number_integer()) {
+                    append(bsoncxx::types::b_date{std::chrono::milliseconds{item->get<std::int64_t>()}});
+                    break;
+                }
+                if ("$numberDecimal" == item.key() && item->is_string()) {
+                    append(bsoncxx::types::b_decimal128{
+                        bsoncxx::decimal128{item->get_ref<const std::string&>()}});
+                    break;
+                }
+                if ("$timestamp" == item.key() && item->is_object()
+                    && item->contains("t") && item->contains("i"))
+                {
+                    append(bsoncxx::types::b_timestamp{
+                        item->at("i").get<std::uint32_t>(), item->at("t").get<std::uint32_t>()});
+                    break;
+                }
+            }
+            if (slow_path(j)) {
+                // The forms which from_element produces through
+                // bsoncxx::to_json go back through bsoncxx::from_json
+                const auto doc = bsoncxx::from_json(nlohmann::json{{"v", j}}.dump());
+                append(doc.view()["v"].get_value());
+                break;
+            }
+            append([&j](sub_document sub_builder) { append_members(sub_builder, j); });
+            break;
+        }
+        case value_t::null:
+        default:
+            append(bsoncxx::types::b_null{});
+        }
+    }
+
+    template <typename Builder>
+    void append_members(Builder& builder, const nlohmann::json& j)
+    {
+        for (auto i = j.begin(); i != j.end(); ++i) {
+            const auto& key = i.key();
+            append_value(i.value(), [&builder, &key](auto&& value) {
+                builder.append(kvp(key, std::forward<decltype(value)>(value)));
+            });
+        }
+    }
+
+    void append_elements(sub_array& builder, const nlohmann::json& j)
+    {
+        for (const auto& item : j) {
+            append_value(item, [&builder](auto&& value) {
+                builder.append(std::forward<decltype(value)>(value));
+            });
+        }
+    }
+
+    void collect_patch(const std::string& path,
+                       const nlohmann::json& patch,
+                       nlohmann::json& j_set,
+                       std::vector<std::string>& unset)
+    {
+        for (auto i = patch.begin(); i != patch.end(); ++i) {
+            const auto& key = mongodb::field_name(i.key());
+
+            const std::string field = path + "." + key;
+            const auto& value = i.value();
+
+            if (value.is_null()) {
+                unset.push_back(field);
+            } else if (value.is_object() && !value.empty()
+                       && (value.begin().key().empty() || '$' != value.begin().key().front()))
+            {
+                // An empty key is rejected by field_name in the recursion
+                collect_patch(field, value, j_set, unset);
+            } else if (!value.is_object() || !value.empty()) {
+                // An empty object leaves an existing object unchanged, so
+                // it is skipped
+                j_set[field] = value;
+            }
+        }
+    }
+}
+
+///
+/// \brief Convert a BSON document to JSON.
+///
+/// The document is traversed directly, without going through a JSON string.
+/// Types which have no JSON counterpart are represented using (legacy)
+/// MongoDB extended JSON, as bsoncxx::to_json would.
+///
+/// \param view the document to convert
+///
+/// \returns a JSON object
+///
+nlohmann::json from_bson(bsoncxx::document::view view)
+{
+    return from_document(view);
+}
+
+///
+/// \brief Convert a JSON object to a BSON document.
+///
+/// Integers are stored as 32-bit values when they fit, and as 64-bit values
+/// otherwise, the same as bsoncxx::from_json does. The extended JSON forms
+/// produced by from_bson, such as `$oid`, `$date`, `$numberDecimal` and
+/// `$timestamp`, are converted back to their BSON types.
+///
+/// \param j a JSON object
+///
+/// \returns a BSON document
+///
+/// \throws std::invalid_argument if \a j is not an object
+///
+bsoncxx::document::value to_bson(const nlohmann::json& j)
+{
+    if (!j.is_object()) {
+        throw std::invalid_argument{"expected a JSON object"};
+    }
+
+    bsoncxx::builder::basic::document builder{};
+    append_members(builder, j);
+
+    return builder.extract();
+}
+
+///
+/// \brief Translate a JSON merge patch (RFC 7386) of the field at \a path
+///        into a partial update.
+///
+/// Members set to null are unset, and objects are merged member by member,
+/// so that only the fields named in the patch are written.
+///
+/// \param path  the field being patched, in dot notation
+/// \param patch the merge patch
+///
+/// \throws std::invalid_argument if a member name can not be used in a path
+///
+mongodb::update merge_patch(const std::string& path, const nlohmann::json& patch)
+{
+    mongodb::update changes{};
+
+    if (!patch.is_object()) {
+        changes.set(to_bson(nlohmann::json{{path, patch}}));
+        return changes;
+    }
+
+    auto j_set = nlohmann::json::object();
+    std::vector<std::string> unset{};
+
+    collect_patch(path, patch, j_set, unset);
+
+    changes.set(to_bson(j_set));
+
+    for (const auto& field : unset) {
+        changes.unset(field);
+    }
+
+    return changes;
+}
+
 void urldecode(char *dst, const char *src)
 {
     char a, b;
@@ -3,8 +3,11 @@
 ///
 #pragma once
 
+#include <bsoncxx/document/value.hpp>
+#include <bsoncxx/document/view.hpp>
 #include <nlohmann/json.hpp>
 #include "../mongodb/document.h"
+#include "../mongodb/update.h"
 
 namespace ops
 {
@@ -12,17 +15,26 @@ namespace util
 {
 namespace json
 {
-    template <typename T>
-    nlohmann::json extract(const mongodb::document<T>& doc)
+    nlohmann::json from_bson(bsoncxx::document::view view);
+    bsoncxx::document::value to_bson(const nlohmann::json& j);
+
+    mongodb::update merge_patch(const std::string& path, const nlohmann::json& patch);
+
+    inline nlohmann::json extract(bsoncxx::document::view view)
     {
-        nlohmann::json j;
-        doc.stream() >> j;
+        nlohmann::json j = from_bson(view);
 
         j.erase("_id");
 
         return j;
     }
 
+    template <typename T>
+    nlohmann::json extract(const mongodb::document<T>& doc)
+    {
+        return extract(doc.view());
+    }
+
     nlohmann::json from_urlencoded(const std::string& input);
 }
 }
@@ -0,0 +1,483 @@
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../http/metrics.h"
+
+namespace ops
+{
+namespace util
+{
+
+namespace
+{
+    const char* level_name(log_level level)
+    {
+        switch (level)
+        {
+        case log_level::debug:
+            return "debug";
+        case log_level::info:
+            return "info";
+        case log_level::notice:
+            return "notice";
+        case log_level::warning:
+            return "warning";
+        case log_level::error:
+        default:
+            return "error";
+        }
+    }
+
+    ///
+    /// Append a JSON string. Bytes which are not valid UTF-8 are copied as
+    /// they are rather than rejected, since a log line is better than none.
+    ///
+    void append_string(std::string& out, const std::string& s)
+    {
+        static const char hex[] = "0123456789abcdef";
+
+        out += '"';
+
+        for (const char c : s) {
+            switch (c)
+            {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out += "\\u00";
+                    out += hex[(c >> 4) & 0x0f];
+                    out += hex[c & 0x0f];
+                } else {
+                    out += c;
+                }
+            }
+        }
+
+        out += '"';
+    }
+
+    void append_time(std::string& out, std::chrono::system_clock::time_point time)
+    {
+        using namespace std::chrono;
+
+        const auto t = system_clock::to_time_t(time);
+        const auto ms = duration_cast<milliseconds>(time.time_since_epoch()).count() % 1000;
+
+        std::tm tm{};
+        ::gmtime_r(&t, &tm);
+
+        char buffer[32];
+        const auto n = std::strftime(buffer, sizeof buffer, "%Y-%m-%dT%H:%M:%S", &tm);
+        std::snprintf(buffer + n, sizeof buffer - n, ".%03dZ", static_cast<int>(ms));
+
+        out += '"';
+        out += buffer;
+        out += '"';
+    }
+
+    void write_all(int fd, const std::string& data)
+    {
+        const char* p = data.data();
+        std::size_t size = data.size();
+
+        while (size > 0) {
+            const ssize_t n = ::write(fd, p, size);
+
+            if (n < 0) {
+                if (EINTR == errno) {
+                    continue;
+                }
+                // Nowhere left to report the error
+                return;
+            }
+
+            p += n;
+            size -= static_cast<std::size_t>(n);
+        }
+    }
+}
+
+///
+/// \class log_field
+///
+/// \brief A named value attached to a log record
+///
+
+log_field::log_field(const char* k, std::string v) : key{k}, value{std::move(v)}
+{
+}
+
+log_field::log_field(const char* k, const char* v) : key{k}, value{std::string{v}}
+{
+}
+
+log_field::log_field(const char* k, double v) : key{k}, value{v}
+{
+}
+
+log_field::log_field(const char* k, bool v) : key{k}, value{v}
+{
+}
+
+///
+/// \class logger
+///
+/// \brief Asynchronous writer of structured log records, one JSON object per
+///        line
+///
+/// Each thread which logs gets a ring buffer of its own, which it fills
+/// without taking any lock. A background thread drains the rings every
+/// logger::Interval and writes the records in a single system call per
+/// round, so a burst of requests never waits on the output. When a thread
+/// logs faster than the writer drains, records which do not fit are dropped
+/// and counted, and the writer logs how many were lost.
+///
+/// Records from different threads are not strictly ordered in the output;
+/// each carries the time at which it was logged.
+///
+///     ops::util::log::info("session started", {{"session", session_id}});
+///
+
+///
+/// \returns the logger singleton instance
+///
+logger& logger::instance()
+{
+    static logger instance{};
+    return instance;
+}
+
+///
+/// \returns the level with the given name, e.g., "warning"
+///
+/// \throws std::invalid_argument if there is no such level
+///
+log_level logger::level(const std::string& name)
+{
+    for (const auto l : {log_level::debug, log_level::info, log_level::notice,
+                         log_level::warning, log_level::error})
+    {
+        if (name == level_name(l)) {
+            return l;
+        }
+    }
+
+    throw std::invalid_argument{"no such log level: " + name};
+}
+
+logger::logger()
+  : _level{static_cast<int>(log_level::info)},
+    _fd{STDOUT_FILENO},
+    _stopping{false},
+    _written{0},
+    _dropped{0}
+{
+    _thread = std::thread{&logger::run, this};
+}
+
+logger::~logger()
+{
+    stop();
+
+    if (STDOUT_FILENO != _fd) {
+        ::close(_fd);
+    }
+}
+
+///
+/// \brief Set the lowest level written, and the output.
+///
+void logger::configure(const log_options& opts)
+{
+    _level = static_cast<int>(opts.level);
+
+    int fd = STDOUT_FILENO;
+
+    if (!opts.file.empty()) {
+        fd = ::open(opts.file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+
+        if (fd < 0) {
+            log::error("can not open log file", {{"file", opts.file}});
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    if (STDOUT_FILENO != _fd) {
+        ::close(_fd);
+    }
+
+    _fd = fd;
+}
+
+///
+/// \brief Log a message.
+///
+/// \param level   the severity; the record is discarded if it is below the
+///                configured level
+/// \param message what happened
+/// \param fields  values which give the context, e.g., ids
+///
+void logger::write(log_level level, std::string message,
+                   std::initializer_list<log_field> fields)
+{
+    if (!enabled(level)) {
+        return;
+    }
+
+    record rec{level, std::chrono::system_clock::now(), std::move(message), fields};
+
+    if (_stopping) {
+        // Nothing drains the rings any more
+        std::string line{};
+        format(rec, line);
+
+        std::lock_guard<std::mutex> lock{_mutex};
+        write_all(_fd, line);
+        ++_written;
+        return;
+    }
+
+    auto& r = local();
+
+    const auto head = r.head.load(std::memory_order_relaxed);
+
+    if (head - r.tail.load(std::memory_order_acquire) >= RingSize) {
+        r.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    r.slots[head % RingSize] = std::move(rec);
+    r.head.store(head + 1, std::memory_order_release);
+}
+
+///
+/// \brief Write what is left in the rings and stop the writer thread. Later
+///        records are written directly.
+///
+void logger::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        if (_stopping) {
+            return;
+        }
+
+        _stopping = true;
+    }
+
+    _wake.notify_all();
+
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+
+    // A thread which saw the logger running may have queued a record after
+    // the writer's last round
+    std::string out{};
+    drain(out);
+
+    if (!out.empty()) {
+        std::lock_guard<std::mutex> lock{_mutex};
+        write_all(_fd, out);
+    }
+}
+
+///
+/// \returns the number of records written and dropped so far
+///
+logger::statistics logger::stats() const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    statistics s{_written.load(), _dropped};
+
+    for (const auto& r : _rings) {
+        s.dropped += r->dropped.load(std::memory_order_relaxed);
+    }
+
+    return s;
+}
+
+///
+/// \brief Write the record counters in the Prometheus text format, for a
+///        scrape.
+///
+void logger::collect(std::ostream& out) const
+{
+    using http::metrics;
+
+    const auto s = stats();
+
+    metrics::counter(out, "log_records_written_total",
+        "Log records written.", s.written);
+    metrics::counter(out, "log_records_dropped_total",
+        "Log records dropped because the writer fell behind.", s.dropped);
+}
+
+logger::ring& logger::local()
+{
+    thread_local owner o{};
+
+    if (!o.r) {
+        o.r = std::make_shared<ring>();
+
+        std::lock_guard<std::mutex> lock{_mutex};
+        _rings.push_back(o.r);
+    }
+
+    return *o.r;
+}
+
+logger::owner::~owner()
+{
+    if (r) {
+        r->orphaned = true;
+    }
+}
+
+void logger::run()
+{
+    std::string out{};
+    std::uint64_t reported = 0;
+
+    for (;;) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _wake.wait_for(lock, Interval, [this]() { return _stopping.load(); });
+            stopping = _stopping;
+        }
+
+        out.clear();
+
+        // Once stopping, loop until a round finds nothing, so that records
+        // logged during the last round are not lost
+        while (drain(out) && stopping) {
+        }
+
+        const auto dropped = stats().dropped;
+
+        if (dropped > reported) {
+            record rec{log_level::warning, std::chrono::system_clock::now(),
+                       "log records dropped", {{"count", dropped - reported}}};
+            format(rec, out);
+            reported = dropped;
+        }
+
+        if (!out.empty()) {
+            std::lock_guard<std::mutex> lock{_mutex};
+            write_all(_fd, out);
+        }
+
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+///
+/// \brief Format the records of all the rings, and forget the rings of
+///        threads which have exited once they are empty.
+///
+/// \returns true if any record was found
+///
+bool logger::drain(std::string& out)
+{
+    std::vector<std::shared_ptr<ring>> rings{};
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        rings = _rings;
+    }
+
+    std::uint64_t count = 0;
+
+    for (const auto& r : rings) {
+        // Read the flag first: once it is set, the owner writes no more
+        const bool orphaned = r->orphaned.load();
+
+        auto tail = r->tail.load(std::memory_order_relaxed);
+        const auto head = r->head.load(std::memory_order_acquire);
+
+        for (; tail != head; ++tail) {
+            auto& rec = r->slots[tail % RingSize];
+            format(rec, out);
+            rec.message.clear();
+            rec.fields.clear();
+            ++count;
+        }
+
+        r->tail.store(tail, std::memory_order_release);
+
+        if (orphaned) {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _dropped += r->dropped.load();
+            _rings.erase(std::remove(_rings.begin(), _rings.end(), r), _rings.end());
+        }
+    }
+
+    _written += count;
+
+    return count > 0;
+}
+
+void logger::format(const record& r, std::string& out)
+{
+    out += "{\"time\":";
+    append_time(out, r.time);
+    out += ",\"level\":\"";
+    out += level_name(r.level);
+    out += "\",\"msg\":";
+    append_string(out, r.message);
+
+    for (const auto& f : r.fields) {
+        out += ',';
+        append_string(out, f.key);
+        out += ':';
+
+        if (const auto* s = std::get_if<std::string>(&f.value)) {
+            append_string(out, *s);
+        } else if (const auto* i = std::get_if<std::int64_t>(&f.value)) {
+            out += std::to_string(*i);
+        } else if (const auto* u = std::get_if<std::uint64_t>(&f.value)) {
+            out += std::to_string(*u);
+        } else if (const auto* d = std::get_if<double>(&f.value)) {
+            if (std::isfinite(*d)) {
+                char buffer[32];
+                std::snprintf(buffer, sizeof buffer, "%.15g", *d);
+                out += buffer;
+            } else {
+                out += "null";
+            }
+        } else if (const auto* b = std::get_if<bool>(&f.value)) {
+            out += *b ? "true" : "false";
+        }
+    }
+
+    out += "}\n";
+}
+
+} // namespace util
+} // namespace ops
@@ -0,0 +1,185 @@
+///
+/// \file logger.h
+///
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace ops
+{
+namespace util
+{
+    enum class log_level
+    {
+        debug,
+        info,
+        notice,
+        warning,
+        error
+    };
+
+    struct log_options
+    {
+        log_level   level = log_level::info;
+        std::string file  = ""; // standard output if empty
+    };
+
+    class log_field
+    {
+    public:
+        using value_type = std::variant<std::string, std::int64_t, std::uint64_t, double, bool>;
+
+        log_field(const char* key, std::string value);
+        log_field(const char* key, const char* value);
+        log_field(const char* key, double value);
+        log_field(const char* key, bool value);
+
+        template <typename T,
+                  typename std::enable_if<std::is_integral<T>::value
+                                          && !std::is_same<T, bool>::value, int>::type = 0>
+        log_field(const char* key, T value);
+
+        const char* key;
+        value_type  value;
+    };
+
+    class logger
+    {
+    public:
+        // Records which each thread can hold before the writer catches up
+        static constexpr std::size_t RingSize = 1024;
+
+        // How often the writer looks for new records
+        static constexpr auto Interval = std::chrono::milliseconds{10};
+
+        struct statistics
+        {
+            std::uint64_t written;
+            std::uint64_t dropped;
+        };
+
+        static logger& instance();
+
+        static log_level level(const std::string& name);
+
+        ~logger();
+
+        logger(const logger&) = delete;
+        logger& operator=(const logger&) = delete;
+
+        void configure(const log_options& opts);
+
+        bool enabled(log_level level) const;
+
+        void write(log_level level, std::string message,
+                   std::initializer_list<log_field> fields = {});
+
+        void stop();
+
+        statistics stats() const;
+        void collect(std::ostream& out) const;
+
+    private:
+        struct record
+        {
+            log_level                             level;
+            std::chrono::system_clock::time_point time;
+            std::string                           message;
+            std::vector<log_field>                fields;
+        };
+
+        // Single producer, single consumer
+        struct ring
+        {
+            std::vector<record>        slots = std::vector<record>(RingSize);
+            std::atomic<std::size_t>   head{0};
+            std::atomic<std::size_t>   tail{0};
+            std::atomic<std::uint64_t> dropped{0};
+            std::atomic<bool>          orphaned{false};
+        };
+
+        struct owner
+        {
+            ~owner();
+
+            std::shared_ptr<ring> r;
+        };
+
+        logger();
+
+        ring& local();
+        void run();
+        bool drain(std::string& out);
+
+        static void format(const record& r, std::string& out);
+
+        std::atomic<int>                   _level;
+        int                                _fd;
+        mutable std::mutex                 _mutex;
+        std::condition_variable            _wake;
+        std::vector<std::shared_ptr<ring>> _rings;
+        std::atomic<bool>                  _stopping;
+        std::atomic<std::uint64_t>         _written;
+        std::uint64_t                      _dropped;
+        std::thread                        _thread;
+    };
+
+    template <typename T,
+              typename std::enable_if<std::is_integral<T>::value
+                                      && !std::is_same<T, bool>::value, int>::type>
+    log_field::log_field(const char* k, T v) : key{k}
+    {
+        if (std::is_signed<T>::value) {
+            value = static_cast<std::int64_t>(v);
+        } else {
+            value = static_cast<std::uint64_t>(v);
+        }
+    }
+
+    inline bool logger::enabled(log_level level) const
+    {
+        return static_cast<int>(level) >= _level.load(std::memory_order_relaxed);
+    }
+
+    namespace log
+    {
+        inline void debug(std::string message, std::initializer_list<log_field> fields = {})
+        {
+            logger::instance().write(log_level::debug, std::move(message), fields);
+        }
+
+        inline void info(std::string message, std::initializer_list<log_field> fields = {})
+        {
+            logger::instance().write(log_level::info, std::move(message), fields);
+        }
+
+        inline void notice(std::string message, std::initializer_list<log_field> fields = {})
+        {
+            logger::instance().write(log_level::notice, std::move(message), fields);
+        }
+
+        inline void warning(std::string message, std::initializer_list<log_field> fields = {})
+        {
+            logger::instance().write(log_level::warning, std::move(message), fields);
+        }
+
+        inline void error(std::string message, std::initializer_list<log_field> fields = {})
+        {
+            logger::instance().write(log_level::error, std::move(message), fields);
+        }
+    }
+}
+}
@@ -0,0 +1,120 @@
+#include "mapped_file.h"
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace ops
+{
+namespace util
+{
+
+///
+/// \class mapped_file
+///
+/// \brief A read-only file mapped into memory
+///
+/// The contents are paged in by the kernel on first access and shared with
+/// the page cache, so serving a file from the mapping does not copy it into
+/// a buffer of its own. The mapping stays valid while the object is alive,
+/// even if the file is renamed or unlinked in the meantime.
+///
+
+///
+/// \brief Map a file into memory.
+///
+/// \param path the file to map
+///
+/// \throws std::system_error if the file can not be opened or mapped; the
+///         error code is \a ENOENT if the file does not exist
+///
+mapped_file::mapped_file(const std::string& path)
+  : _data{nullptr},
+    _size{0}
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        throw std::system_error{errno, std::generic_category(), path};
+    }
+
+    struct stat st{};
+
+    if (::fstat(fd, &st) < 0) {
+        const int error = errno;
+        ::close(fd);
+        throw std::system_error{error, std::generic_category(), path};
+    }
+
+    _size = static_cast<std::size_t>(st.st_size);
+
+    if (_size > 0) {
+        _data = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (MAP_FAILED == _data) {
+            const int error = errno;
+            ::close(fd);
+            throw std::system_error{error, std::generic_category(), path};
+        }
+
+        ::madvise(_data, _size, MADV_SEQUENTIAL);
+    }
+
+    // The mapping keeps the file open
+    ::close(fd);
+
+    // A strong validator: media files are written once under a new name and
+    // never modified in place, so inode, size and modification time change
+    // whenever the contents do
+    char etag[64];
+    std::snprintf(etag, sizeof(etag), "\"%llx-%llx-%llx\"",
+                  static_cast<unsigned long long>(st.st_ino),
+                  static_cast<unsigned long long>(st.st_size),
+                  static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ULL
+                      + static_cast<unsigned long long>(st.st_mtim.tv_nsec));
+    _etag = etag;
+}
+
+mapped_file::~mapped_file()
+{
+    if (_data) {
+        ::munmap(_data, _size);
+    }
+}
+
+///
+/// \brief Ask the kernel to start reading the whole file into the page
+///        cache, so that the first request does not wait for the disk.
+///
+void mapped_file::prefetch() const
+{
+    if (_data) {
+        ::madvise(_data, _size, MADV_WILLNEED);
+    }
+}
+
+///
+/// \fn mapped_file::data
+///
+/// \returns a pointer to the first byte of the file, or a null pointer if the
+///          file is empty
+///
+
+///
+/// \fn mapped_file::size
+///
+/// \returns the size of the file in bytes
+///
+
+///
+/// \fn mapped_file::etag
+///
+/// \returns a strong entity tag for the contents of the file, including the
+///          double quotes
+///
+
+} // namespace util
+} // namespace ops
@@ -0,0 +1,51 @@
+///
+/// \file mapped_file.h
+///
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ops
+{
+namespace util
+{
+    class mapped_file
+    {
+    public:
+        explicit mapped_file(const std::string& path);
+        ~mapped_file();
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        const unsigned char* data() const;
+        std::size_t size() const;
+
+        const std::string& etag() const;
+
+        void prefetch() const;
+
+    private:
+        void*       _data;
+        std::size_t _size;
+        std::string _etag;
+    };
+
+    inline const unsigned char* mapped_file::data() const
+    {
+        return static_cast<const unsigned char*>(_data);
+    }
+
+    inline std::size_t mapped_file::size() const
+    {
+        return _size;
+    }
+
+    inline const std::string& mapped_file::etag() const
+    {
+        return _etag;
+    }
+}
+}
@@ -0,0 +1,294 @@
+#include "mp3_scanner.h"
+#include <algorithm>
+#include <cstring>
+
+namespace ops
+{
+namespace util
+{
+
+namespace
+{
+    // Bit rates in kbit/s by [MPEG-1][layer - 1][index], with MPEG-2 and 2.5
+    // sharing a table
+    constexpr std::uint16_t bitrates[2][3][16] = {
+        {   // MPEG-2, 2.5
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}
+        },
+        {   // MPEG-1
+            {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+            {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0}
+        }
+    };
+
+    // Sample rates in Hz by [version bits][index]
+    constexpr std::uint32_t sample_rates[4][3] = {
+        {11025, 12000, 8000},   // MPEG-2.5
+        {0, 0, 0},              // reserved
+        {22050, 24000, 16000},  // MPEG-2
+        {44100, 48000, 32000}   // MPEG-1
+    };
+}
+
+///
+/// \class mp3_scanner
+///
+/// \brief Incremental parser for the frame headers of an MPEG audio stream
+///
+/// Feed the stream in chunks of any size, e.g., while it is being uploaded.
+/// The scanner skips a leading ID3v2 tag, then walks from frame header to
+/// frame header without looking at the audio data, and resynchronizes byte
+/// by byte over anything which is not a frame of the same kind as the first
+/// one. The first frame is only accepted once the header of the frame after
+/// it has been found, so the scanner holds up to one frame of the stream
+/// until then, and at most ten bytes afterwards.
+///
+/// Besides the stream parameters, the scanner builds a seek index: entry
+/// \a k is the offset of the first frame which starts at or after
+/// `k * IndexInterval` milliseconds.
+///
+
+mp3_scanner::mp3_scanner()
+  : _position{0},
+    _skip{0},
+    _tag_checked{false},
+    _first{0, 0, 0, 0, 0, 0},
+    _frames{0},
+    _samples{0},
+    _frame_bytes{0},
+    _end{0}
+{
+    _pending.reserve(10);
+}
+
+///
+/// \brief Scan the next part of the stream.
+///
+void mp3_scanner::feed(const unsigned char* data, std::size_t size)
+{
+    while (size > 0) {
+        if (_skip > 0) {
+            const auto n = static_cast<std::size_t>(std::min<std::uint64_t>(_skip, size));
+            _skip -= n;
+            _position += n;
+            data += n;
+            size -= n;
+            continue;
+        }
+
+        _pending.push_back(*data++);
+        --size;
+
+        parse();
+    }
+}
+
+///
+/// \returns the average bit rate in kbit/s
+///
+std::uint32_t mp3_scanner::bitrate() const
+{
+    const auto ms = duration();
+
+    return ms > 0 ? static_cast<std::uint32_t>(_frame_bytes * 8 / ms) : 0;
+}
+
+///
+/// \returns the play time of the frames seen so far, in milliseconds
+///
+std::uint64_t mp3_scanner::duration() const
+{
+    return _first.sample_rate > 0 ? _samples * 1000 / _first.sample_rate : 0;
+}
+
+///
+/// \brief Decode a 4 byte frame header.
+///
+bool mp3_scanner::decode(const unsigned char* h, frame& f)
+{
+    if (0xff != h[0] || 0xe0 != (h[1] & 0xe0)) {
+        return false;
+    }
+
+    const unsigned version = (h[1] >> 3) & 0x03;
+    const unsigned layer   = 4 - ((h[1] >> 1) & 0x03);
+    const unsigned rate    = h[2] >> 4;
+    const unsigned sr      = (h[2] >> 2) & 0x03;
+    const unsigned padding = (h[2] >> 1) & 0x01;
+
+    if (1 == version || 4 == layer || 0 == rate || 15 == rate || 3 == sr) {
+        return false;
+    }
+
+    const bool mpeg1 = 3 == version;
+    const std::uint32_t bps = 1000u * bitrates[mpeg1 ? 1 : 0][layer - 1][rate];
+
+    f.version     = static_cast<std::uint8_t>(version);
+    f.layer       = static_cast<std::uint8_t>(layer);
+    f.sample_rate = sample_rates[version][sr];
+    f.channels    = 3 == (h[3] >> 6) ? 1 : 2;
+
+    if (1 == layer) {
+        f.samples = 384;
+        f.length  = (12 * bps / f.sample_rate + padding) * 4;
+    } else if (2 == layer || mpeg1) {
+        f.samples = 1152;
+        f.length  = 144 * bps / f.sample_rate + padding;
+    } else {
+        f.samples = 576;
+        f.length  = 72 * bps / f.sample_rate + padding;
+    }
+
+    return f.length > 4;
+}
+
+///
+/// \brief Recognize the frame which encoders put at the start of a stream to
+///        describe it, with a Xing, Info or VBRI tag instead of audio.
+///
+/// The tag holds the frame count and the duration of the whole stream, so
+/// the frame must not be copied into another stream.
+///
+/// \param data the stream, from the start of a frame
+/// \param size the bytes available at \a data
+///
+/// \returns the length of the frame if it is such a frame, and 0 otherwise
+///
+std::size_t mp3_scanner::info_frame(const unsigned char* data, std::size_t size)
+{
+    frame f{};
+
+    if (size < 4 || !decode(data, f) || f.length > size) {
+        return 0;
+    }
+
+    // The Xing tag follows the side information, whose size depends on the
+    // version and the channels; the VBRI tag is at a fixed offset
+    const bool mpeg1 = 3 == f.version;
+    const std::size_t xing = 2 == f.channels ? (mpeg1 ? 36 : 21) : (mpeg1 ? 21 : 13);
+    const std::size_t vbri = 36;
+
+    const auto tag_at = [data, &f](std::size_t offset, const char* tag) {
+        return offset + 4 <= f.length && 0 == std::memcmp(data + offset, tag, 4);
+    };
+
+    if (tag_at(xing, "Xing") || tag_at(xing, "Info") || tag_at(vbri, "VBRI")) {
+        return f.length;
+    }
+
+    return 0;
+}
+
+void mp3_scanner::parse()
+{
+    static constexpr unsigned char id3[] = {'I', 'D', '3'};
+
+    if (!_tag_checked) {
+        const auto n = std::min<std::size_t>(_pending.size(), 3);
+
+        if (!std::equal(_pending.begin(), _pending.begin() + n, id3)) {
+            _tag_checked = true;
+        } else if (_pending.size() < 10) {
+            return;
+        } else {
+            // ID3v2: a 10 byte header, a syncsafe size, and an optional footer
+            const std::uint64_t size = (std::uint64_t{_pending[6] & 0x7fu} << 21)
+                | (std::uint64_t{_pending[7] & 0x7fu} << 14)
+                | (std::uint64_t{_pending[8] & 0x7fu} << 7)
+                | std::uint64_t{_pending[9] & 0x7fu};
+            const bool footer = 0 != (_pending[5] & 0x10);
+
+            consume(10);
+            _skip = size + (footer ? 10 : 0);
+            _tag_checked = true;
+            return;
+        }
+    }
+
+    const auto same_kind = [](const frame& a, const frame& b) {
+        return a.version == b.version && a.layer == b.layer && a.sample_rate == b.sample_rate;
+    };
+
+    while (_pending.size() >= 4) {
+        frame f{};
+
+        if (!decode(_pending.data(), f) || (_frames > 0 && !same_kind(f, _first))) {
+            consume(1);
+            continue;
+        }
+
+        if (0 == _frames) {
+            // Four bytes can look like a header by chance: only lock on if
+            // the next header is where this one says, and is of the same kind
+            if (_pending.size() < f.length + 4) {
+                return;
+            }
+
+            frame next{};
+
+            if (!decode(_pending.data() + f.length, next) || !same_kind(f, next)) {
+                consume(1);
+                continue;
+            }
+
+            _first = f;
+        }
+
+        while (_samples * 1000 >= std::uint64_t{_index.size()} * IndexInterval * f.sample_rate) {
+            _index.push_back(_position);
+        }
+
+        ++_frames;
+        _samples += f.samples;
+        _frame_bytes += f.length;
+        _end = _position + f.length;
+
+        const auto n = std::min<std::size_t>(_pending.size(), f.length);
+        _skip = f.length - n;
+        consume(n);
+    }
+}
+
+void mp3_scanner::consume(std::size_t n)
+{
+    _pending.erase(_pending.begin(), _pending.begin() + n);
+    _position += n;
+}
+
+///
+/// \fn mp3_scanner::valid
+///
+/// \returns true if at least one frame was found
+///
+
+///
+/// \fn mp3_scanner::layer
+///
+/// \returns the MPEG audio layer, 1 to 3, of the stream
+///
+
+///
+/// \fn mp3_scanner::first_frame
+///
+/// \returns the offset of the first frame, i.e., the size of any tag before
+///          the audio
+///
+
+///
+/// \fn mp3_scanner::end
+///
+/// \returns the offset just past the last frame seen, which excludes a
+///          trailing tag
+///
+
+///
+/// \fn mp3_scanner::index
+///
+/// \returns the byte offsets of the frames at every IndexInterval
+///
+
+} // namespace util
+} // namespace ops
@@ -0,0 +1,108 @@
+///
+/// \file mp3_scanner.h
+///
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ops
+{
+namespace util
+{
+    class mp3_scanner
+    {
+    public:
+        // Time between two entries of the seek index
+        static constexpr std::uint32_t IndexInterval = 1000; // ms
+
+        mp3_scanner();
+
+        void feed(const unsigned char* data, std::size_t size);
+
+        bool valid() const;
+
+        std::uint32_t sample_rate() const;
+        std::uint32_t channels() const;
+        std::uint32_t layer() const;
+        std::uint32_t bitrate() const;
+        std::uint64_t frames() const;
+        std::uint64_t duration() const;
+
+        std::uint64_t first_frame() const;
+        std::uint64_t end() const;
+
+        const std::vector<std::uint64_t>& index() const;
+
+        static std::size_t info_frame(const unsigned char* data, std::size_t size);
+
+    private:
+        struct frame
+        {
+            std::uint8_t  version;
+            std::uint8_t  layer;
+            std::uint32_t sample_rate;
+            std::uint32_t samples;
+            std::uint32_t length;
+            std::uint32_t channels;
+        };
+
+        static bool decode(const unsigned char* h, frame& f);
+
+        void parse();
+        void consume(std::size_t n);
+
+        std::vector<unsigned char> _pending;
+        std::uint64_t              _position;
+        std::uint64_t              _skip;
+        bool                       _tag_checked;
+        frame                      _first;
+        std::uint64_t              _frames;
+        std::uint64_t              _samples;
+        std::uint64_t              _frame_bytes;
+        std::uint64_t              _end;
+        std::vector<std::uint64_t> _index;
+    };
+
+    inline bool mp3_scanner::valid() const
+    {
+        return _frames > 0;
+    }
+
+    inline std::uint32_t mp3_scanner::sample_rate() const
+    {
+        return _first.sample_rate;
+    }
+
+    inline std::uint32_t mp3_scanner::channels() const
+    {
+        return _first.channels;
+    }
+
+    inline std::uint32_t mp3_scanner::layer() const
+    {
+        return _first.layer;
+    }
+
+    inline std::uint64_t mp3_scanner::frames() const
+    {
+        return _frames;
+    }
+
+    inline std::uint64_t mp3_scanner::first_frame() const
+    {
+        return _index.empty() ? 0 : _index.front();
+    }
+
+    inline std::uint64_t mp3_scanner::end() const
+    {
+        return _end;
+    }
+
+    inline const std::vector<std::uint64_t>& mp3_scanner::index() const
+    {
+        return _index;
+    }
+}
+}
@@ -0,0 +1,93 @@
+///
+/// \file setting.h
+///
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "logger.h"
+
+namespace ops
+{
+namespace util
+{
+    ///
+    /// \brief Parse a numeric setting, such as the value of an environment
+    ///        variable.
+    ///
+    /// A malformed or out of range value is logged as an error, and the
+    /// default is used instead, so that a typo in the configuration does not
+    /// keep the server from starting.
+    ///
+    /// \code
+    /// const auto seconds = ops::util::setting<int>(
+    ///     "SHUTDOWN_TIMEOUT", dotenv::getenv("SHUTDOWN_TIMEOUT"), 30, 0);
+    /// \endcode
+    ///
+    /// \param name  the name of the setting, for the log
+    /// \param value the value to parse, or an empty string if it is not set
+    /// \param def   the value to use if \a value is empty or invalid
+    /// \param min   the smallest valid value
+    /// \param max   the largest valid value
+    ///
+    /// \returns the parsed value, or \a def
+    ///
+    template <typename T>
+    T setting(const char* name,
+              const std::string& value,
+              const T def,
+              const T min = std::numeric_limits<T>::lowest(),
+              const T max = std::numeric_limits<T>::max())
+    {
+        static_assert(std::is_arithmetic<T>::value, "numeric settings only");
+
+        if (value.empty()) {
+            return def;
+        }
+
+        try {
+            std::size_t end = 0;
+            T result{};
+
+            if constexpr (std::is_floating_point<T>::value) {
+                const auto n = std::stold(value, &end);
+                if (n < min || n > max) {
+                    throw std::out_of_range{value};
+                }
+                result = static_cast<T>(n);
+            } else if constexpr (std::is_signed<T>::value) {
+                const auto n = std::stoll(value, &end);
+                if (n < static_cast<long long>(min) || n > static_cast<long long>(max)) {
+                    throw std::out_of_range{value};
+                }
+                result = static_cast<T>(n);
+            } else {
+                // std::stoull accepts, and negates, a leading minus
+                if (std::string::npos != value.find('-')) {
+                    throw std::out_of_range{value};
+                }
+                const auto n = std::stoull(value, &end);
+                if (n < static_cast<unsigned long long>(min)
+                    || n > static_cast<unsigned long long>(max))
+                {
+                    throw std::out_of_range{value};
+                }
+                result = static_cast<T>(n);
+            }
+
+            if (end != value.size()) {
+                throw std::invalid_argument{value};
+            }
+
+            return result;
+        } catch (const std::exception&) {
+            log::error(std::string{"invalid "} + name + ", using the default",
+                {{"value", value}, {"default", def}});
+            return def;
+        }
+    }
+}
+}
@@ -0,0 +1,75 @@
+#include "sha256.h"
+#include <openssl/evp.h>
+#include <stdexcept>
+
+namespace ops
+{
+namespace util
+{
+
+///
+/// \class sha256
+///
+/// \brief Incremental SHA-256 digest, for hashing data which arrives in
+///        chunks
+///
+/// \code
+/// ops::util::sha256 hash{};
+/// hash.update(chunk.data(), chunk.size());
+/// // ...
+/// const std::string digest = hash.hex_digest();
+/// \endcode
+///
+
+sha256::sha256()
+  : _ctx{EVP_MD_CTX_new()}
+{
+    if (!_ctx || 1 != EVP_DigestInit_ex(_ctx, EVP_sha256(), nullptr)) {
+        EVP_MD_CTX_free(_ctx);
+        throw std::runtime_error{"can not initialize SHA-256 digest"};
+    }
+}
+
+sha256::~sha256()
+{
+    EVP_MD_CTX_free(_ctx);
+}
+
+///
+/// \brief Add data to the digest.
+///
+void sha256::update(const void* data, std::size_t size)
+{
+    if (1 != EVP_DigestUpdate(_ctx, data, size)) {
+        throw std::runtime_error{"SHA-256 update failed"};
+    }
+}
+
+///
+/// \brief Finish the digest. No more data may be added afterwards.
+///
+/// \returns the digest as 64 lowercase hexadecimal digits
+///
+std::string sha256::hex_digest()
+{
+    static constexpr char digits[] = "0123456789abcdef";
+
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int size = 0;
+
+    if (1 != EVP_DigestFinal_ex(_ctx, md, &size)) {
+        throw std::runtime_error{"SHA-256 finalization failed"};
+    }
+
+    std::string hex(2 * size, '0');
+
+    for (unsigned int i = 0; i < size; ++i) {
+        hex[2 * i]     = digits[md[i] >> 4];
+        hex[2 * i + 1] = digits[md[i] & 0x0f];
+    }
+
+    return hex;
+}
+
+} // namespace util
+} // namespace ops
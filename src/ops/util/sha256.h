@@ -0,0 +1,32 @@
+///
+/// \file sha256.h
+///
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+namespace ops
+{
+namespace util
+{
+    class sha256
+    {
+    public:
+        sha256();
+        ~sha256();
+
+        sha256(const sha256&) = delete;
+        sha256& operator=(const sha256&) = delete;
+
+        void update(const void* data, std::size_t size);
+
+        std::string hex_digest();
+
+    private:
+        EVP_MD_CTX* _ctx;
+    };
+}
+}
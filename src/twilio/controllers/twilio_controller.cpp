@@ -2,6 +2,7 @@
 #include <bsoncxx/builder/basic/document.hpp>
 #include "../../ops/util/json.h"
 #include "../../ops/mongodb/counter.h"
+#include "../../ops/util/logger.h"
 #include "../models/session.h"
 
 namespace twilio
@@ -63,8 +64,7 @@ void controller::post_voice(ops::http::request& request)
         // Register a new session
         ops::mongodb::document<twilio::session>::create(model.builder().extract());
 
-        std::cout << "post_voice: " << std::endl;
-        std::cout << j_body.dump() << std::endl;
+        ops::util::log::debug("twilio voice", {{"session", session_id}, {"body", j_body.dump()}});
 
         request.send_response();
     });
@@ -107,8 +107,7 @@ void controller::post_event(ops::http::request& request)
 {
     request.with_body([this, &request](const std::string& body)
     {
-        std::cout << "post_event: " << std::endl;
-        std::cout << body << std::endl;
+        ops::util::log::debug("twilio event", {{"body", body}});
 
         request.send_response();
     });
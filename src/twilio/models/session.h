@@ -4,6 +4,7 @@
 #pragma once
 
 #include <nlohmann/json.hpp>
+#include "../../ops/mongodb/index.h"
 #include "../../ops/mongodb/model.h"
 
 namespace twilio
@@ -13,6 +14,10 @@ namespace twilio
     public:
         static auto constexpr collection = "twilioSession";
 
+        static constexpr ops::mongodb::index indexes[] = {
+            {"id_1", R"({"id": 1})", true}
+        };
+
         explicit session(const nlohmann::json& j);
 
     private:
@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "../src/ops/mongodb/counter.h"
+
+using ops::mongodb::id_allocator;
+
+namespace
+{
+    constexpr std::uint64_t Increment   = 100;
+    constexpr std::uint64_t ThreadBlock = 10;
+
+    ///
+    /// Stands in for the counter collection: reserves \a count ids and
+    /// returns the previous count.
+    ///
+    struct counting_source
+    {
+        std::atomic<std::uint64_t> count{0};
+        std::atomic<std::uint64_t> calls{0};
+
+        std::uint64_t operator()(std::uint64_t n)
+        {
+            ++calls;
+            return count.fetch_add(n);
+        }
+    };
+
+    ///
+    /// Wait for a background refill to reach the source.
+    ///
+    void wait_for(const std::atomic<std::uint64_t>& value, std::uint64_t expected)
+    {
+        for (int i = 0; i < 1000 && value.load() < expected; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+    }
+}
+
+TEST(id_allocator, unique_across_threads_and_ranges)
+{
+    constexpr std::size_t Threads = 8;
+    constexpr std::size_t PerThread = 5000;
+
+    counting_source source{};
+    id_allocator allocator{[&source](std::uint64_t n) { return source(n); },
+                           Increment, ThreadBlock};
+
+    std::vector<std::vector<std::uint64_t>> ids(Threads);
+    std::vector<std::thread> threads{};
+
+    for (std::size_t t = 0; t < Threads; ++t) {
+        threads.emplace_back([&allocator, &ids, t]() {
+            for (std::size_t i = 0; i < PerThread; ++i) {
+                ids[t].push_back(allocator.next());
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::set<std::uint64_t> all{};
+
+    for (const auto& thread_ids : ids) {
+        for (const auto id : thread_ids) {
+            EXPECT_GT(id, 0u);
+            EXPECT_LE(id, source.count.load());
+            all.insert(id);
+        }
+    }
+
+    // Hundreds of ranges were used, and no id was handed out twice
+    EXPECT_EQ(Threads * PerThread, all.size());
+    EXPECT_GE(source.calls.load(), Threads * PerThread / Increment);
+}
+
+TEST(id_allocator, one_refill_per_range)
+{
+    constexpr std::size_t Threads = 4;
+    constexpr std::size_t PerThread = 2500;
+
+    counting_source source{};
+    id_allocator allocator{[&source](std::uint64_t n) { return source(n); },
+                           Increment, ThreadBlock};
+
+    std::vector<std::vector<std::uint64_t>> ids(Threads);
+    std::vector<std::thread> threads{};
+
+    for (std::size_t t = 0; t < Threads; ++t) {
+        threads.emplace_back([&allocator, &ids, t]() {
+            for (std::size_t i = 0; i < PerThread; ++i) {
+                ids[t].push_back(allocator.next());
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Thread blocks are aligned on the start of their range, so the block
+    // which crosses the refill mark starts on it, and its first id is
+    // handed out by the thread which claimed it
+    std::set<std::uint64_t> all{};
+    for (const auto& thread_ids : ids) {
+        all.insert(thread_ids.begin(), thread_ids.end());
+    }
+
+    std::uint64_t marks = 0;
+    for (std::uint64_t start = 1; start <= source.count.load(); start += Increment) {
+        if (all.count(start + Increment - Increment / 5)) {
+            ++marks;
+        }
+    }
+
+    // The first range, plus one refill for each range whose mark was passed
+    wait_for(source.calls, marks + 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+
+    EXPECT_GT(marks, 0u);
+    EXPECT_EQ(marks + 1, source.calls.load());
+}
+
+TEST(id_allocator, failed_refill_is_rethrown_once)
+{
+    constexpr std::size_t Threads = 4;
+
+    counting_source source{};
+    std::promise<void> release{};
+    auto released = release.get_future().share();
+
+    // The refill of the first range blocks until released, then fails
+    id_allocator allocator{
+        [&source, released](std::uint64_t n) {
+            if (1 == source.calls.load()) {
+                ++source.calls;
+                released.wait();
+                throw std::runtime_error{"unavailable"};
+            }
+            return source(n);
+        },
+        Increment, ThreadBlock};
+
+    for (std::uint64_t i = 1; i <= Increment; ++i) {
+        ASSERT_EQ(i, allocator.next());
+    }
+
+    std::atomic<int> failures{0};
+    std::vector<std::uint64_t> ids(Threads, 0);
+    std::vector<std::thread> threads{};
+
+    // Every thread runs out of ids and waits for the refill
+    for (std::size_t t = 0; t < Threads; ++t) {
+        threads.emplace_back([&allocator, &failures, &ids, t]() {
+            try {
+                ids[t] = allocator.next();
+            } catch (const std::runtime_error&) {
+                ++failures;
+            }
+        });
+    }
+
+    release.set_value();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(1, failures.load());
+
+    // The others, and the next caller, get ids from a new range
+    ids.push_back(allocator.next());
+
+    std::set<std::uint64_t> handed_out{};
+    for (const auto id : ids) {
+        if (0 != id) {
+            EXPECT_GT(id, Increment);
+            EXPECT_LE(id, 2 * Increment);
+            handed_out.insert(id);
+        }
+    }
+
+    EXPECT_EQ(Threads, handed_out.size());
+}
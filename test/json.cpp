@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/json.hpp>
+#include <bsoncxx/types.hpp>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include "../src/ops/util/json.h"
+
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::builder::basic::make_array;
+using bsoncxx::builder::basic::make_document;
+using ops::util::json::from_bson;
+using ops::util::json::to_bson;
+
+namespace
+{
+    constexpr std::uint8_t Bytes[] = {0x00, 0x01, 0xfe, 0xff};
+
+    ///
+    /// The conversion used before from_bson.
+    ///
+    nlohmann::json legacy(bsoncxx::document::view view)
+    {
+        return nlohmann::json::parse(bsoncxx::to_json(view));
+    }
+
+    ///
+    /// Check that \a view comes back from JSON unchanged, byte for byte,
+    /// i.e., with the same types. nlohmann::json sorts the members of
+    /// objects, so the keys of \a view must be sorted.
+    ///
+    void expect_round_trip(bsoncxx::document::view view)
+    {
+        const auto back = to_bson(from_bson(view));
+
+        EXPECT_EQ(bsoncxx::to_json(view), bsoncxx::to_json(back.view()));
+        EXPECT_TRUE(back.view() == view);
+    }
+
+    ///
+    /// A document with one field of each type handled by from_element, and
+    /// of the types left to bsoncxx::to_json.
+    ///
+    bsoncxx::document::value every_type()
+    {
+        return make_document(
+            kvp("array", make_array(1, "two", make_document(kvp("three", 3)), make_array())),
+            kvp("before_epoch", bsoncxx::types::b_date{std::chrono::milliseconds{-86400000}}),
+            kvp("binary", bsoncxx::types::b_binary{
+                bsoncxx::binary_sub_type::k_binary, sizeof(Bytes), Bytes}),
+            kvp("bool", true),
+            kvp("code", bsoncxx::types::b_code{"function() { return 1; }"}),
+            kvp("date", bsoncxx::types::b_date{std::chrono::milliseconds{1563400000123}}),
+            kvp("decimal128", bsoncxx::types::b_decimal128{bsoncxx::decimal128{"1234.5678"}}),
+            kvp("document", make_document(kvp("nested", make_document(kvp("a", 1))))),
+            kvp("double", bsoncxx::types::b_double{0.1}),
+            kvp("int32", bsoncxx::types::b_int32{std::numeric_limits<std::int32_t>::min()}),
+            kvp("int64", bsoncxx::types::b_int64{std::numeric_limits<std::int64_t>::max()}),
+            kvp("max_key", bsoncxx::types::b_maxkey{}),
+            kvp("min_key", bsoncxx::types::b_minkey{}),
+            kvp("null", bsoncxx::types::b_null{}),
+            kvp("oid", bsoncxx::oid{"5d2f8a7c3e9b2a0012345678"}),
+            kvp("regex", bsoncxx::types::b_regex{"^a.*z$", "i"}),
+            kvp("timestamp", bsoncxx::types::b_timestamp{7, 1563400000}),
+            kvp("undefined", bsoncxx::types::b_undefined{}),
+            kvp("utf8", "caf\xc3\xa9 \"quoted\" \\ \n"),
+            kvp("whole", bsoncxx::types::b_double{2.0}));
+    }
+}
+
+TEST(json, int32_boundaries_round_trip)
+{
+    for (const std::int32_t value : {std::numeric_limits<std::int32_t>::min(),
+                                     -1, 0, 1,
+                                     std::numeric_limits<std::int32_t>::max()})
+    {
+        SCOPED_TRACE(value);
+
+        const auto doc = make_document(kvp("v", bsoncxx::types::b_int32{value}));
+
+        EXPECT_EQ(nlohmann::json(value), from_bson(doc.view())["v"]);
+        expect_round_trip(doc.view());
+    }
+}
+
+TEST(json, int64_boundaries_round_trip)
+{
+    constexpr std::int64_t Int32Min = std::numeric_limits<std::int32_t>::min();
+    constexpr std::int64_t Int32Max = std::numeric_limits<std::int32_t>::max();
+
+    for (const std::int64_t value : {std::numeric_limits<std::int64_t>::min(),
+                                     Int32Min - 1,
+                                     Int32Max + 1,
+                                     std::numeric_limits<std::int64_t>::max()})
+    {
+        SCOPED_TRACE(value);
+
+        const auto doc = make_document(kvp("v", bsoncxx::types::b_int64{value}));
+
+        EXPECT_EQ(nlohmann::json(value), from_bson(doc.view())["v"]);
+        expect_round_trip(doc.view());
+    }
+}
+
+TEST(json, small_int64_comes_back_as_int32)
+{
+    // As with bsoncxx::from_json, the narrowest integer type is used
+    const auto doc = make_document(kvp("v", bsoncxx::types::b_int64{42}));
+    const auto back = to_bson(from_bson(doc.view()));
+
+    EXPECT_EQ(bsoncxx::type::k_int32, back.view()["v"].type());
+    EXPECT_EQ(42, back.view()["v"].get_int32().value);
+}
+
+TEST(json, unsigned_beyond_int64_is_a_double)
+{
+    const nlohmann::json j{{"v", std::numeric_limits<std::uint64_t>::max()}};
+    const auto doc = to_bson(j);
+
+    EXPECT_EQ(bsoncxx::type::k_double, doc.view()["v"].type());
+}
+
+TEST(json, double_round_trips)
+{
+    for (const double value : {0.0, -0.5, 0.1, 2.0, 1e300,
+                               std::numeric_limits<double>::min(),
+                               std::numeric_limits<double>::max()})
+    {
+        SCOPED_TRACE(value);
+
+        const auto doc = make_document(kvp("v", bsoncxx::types::b_double{value}));
+
+        EXPECT_EQ(value, from_bson(doc.view())["v"].get<double>());
+        expect_round_trip(doc.view());
+    }
+}
+
+TEST(json, extended_types_round_trip)
+{
+    const auto doc = make_document(
+        kvp("before_epoch", bsoncxx::types::b_date{std::chrono::milliseconds{-86400000}}),
+        kvp("date", bsoncxx::types::b_date{std::chrono::milliseconds{1563400000123}}),
+        kvp("decimal128", bsoncxx::types::b_decimal128{bsoncxx::decimal128{"-0.000001E+10"}}),
+        kvp("oid", bsoncxx::oid{"5d2f8a7c3e9b2a0012345678"}),
+        kvp("timestamp", bsoncxx::types::b_timestamp{
+            std::numeric_limits<std::uint32_t>::max(), std::numeric_limits<std::uint32_t>::max()}));
+
+    const auto j = from_bson(doc.view());
+
+    EXPECT_EQ("5d2f8a7c3e9b2a0012345678", j["oid"]["$oid"]);
+    EXPECT_EQ(1563400000123, j["date"]["$date"]);
+    EXPECT_EQ(std::numeric_limits<std::uint32_t>::max(), j["timestamp"]["$timestamp"]["t"]);
+    expect_round_trip(doc.view());
+}
+
+TEST(json, slow_path_types_round_trip)
+{
+    const auto doc = make_document(
+        kvp("binary", bsoncxx::types::b_binary{
+            bsoncxx::binary_sub_type::k_binary, sizeof(Bytes), Bytes}),
+        kvp("code", bsoncxx::types::b_code{"function() { return 1; }"}),
+        kvp("max_key", bsoncxx::types::b_maxkey{}),
+        kvp("min_key", bsoncxx::types::b_minkey{}),
+        kvp("regex", bsoncxx::types::b_regex{"^a.*z$", "i"}),
+        kvp("undefined", bsoncxx::types::b_undefined{}));
+
+    expect_round_trip(doc.view());
+
+    // Inside arrays and nested documents too
+    const auto nested = make_document(
+        kvp("a", make_array(doc.view())),
+        kvp("d", make_document(kvp("inner", doc.view()))));
+
+    expect_round_trip(nested.view());
+}
+
+TEST(json, from_bson_matches_legacy_to_json)
+{
+    const auto doc = every_type();
+
+    EXPECT_EQ(legacy(doc.view()), from_bson(doc.view()));
+    expect_round_trip(doc.view());
+}
+
+TEST(json, dollar_keys_which_are_not_extended_json)
+{
+    // A plain object which only looks like extended JSON stays an object
+    const nlohmann::json j{{"v", {{"$oid", 42}}}, {"w", {{"$regex", "a"}, {"other", 1}}}};
+    const auto doc = to_bson(j);
+
+    EXPECT_EQ(bsoncxx::type::k_document, doc.view()["v"].type());
+    EXPECT_EQ(bsoncxx::type::k_document, doc.view()["w"].type());
+    EXPECT_EQ(j, from_bson(doc.view()));
+}
+
+TEST(json, to_bson_requires_an_object)
+{
+    EXPECT_THROW(to_bson(nlohmann::json::array()), std::invalid_argument);
+    EXPECT_THROW(to_bson(nlohmann::json(1)), std::invalid_argument);
+}
@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+#include "../src/ops/util/mp3_scanner.h"
+
+using ops::util::mp3_scanner;
+
+namespace
+{
+    // MPEG-1 layer III, 128 kbit/s, 44.1 kHz, joint stereo, no padding
+    constexpr unsigned char Header[] = {0xff, 0xfb, 0x90, 0x64};
+    constexpr std::size_t   FrameLength = 417;
+    constexpr std::size_t   Frames = 100;
+    constexpr std::size_t   TagSize = 300;
+
+    std::vector<unsigned char> frames(std::size_t count)
+    {
+        std::vector<unsigned char> data{};
+
+        for (std::size_t i = 0; i < count; ++i) {
+            data.insert(data.end(), std::begin(Header), std::end(Header));
+            data.resize(data.size() + FrameLength - sizeof(Header), 0);
+        }
+
+        return data;
+    }
+
+    ///
+    /// An ID3v2 tag, whose content looks like a frame header, followed by
+    /// the frames.
+    ///
+    std::vector<unsigned char> fixture()
+    {
+        std::vector<unsigned char> data{'I', 'D', '3', 4, 0, 0, 0, 0,
+                                        static_cast<unsigned char>(TagSize >> 7),
+                                        static_cast<unsigned char>(TagSize & 0x7f)};
+
+        data.insert(data.end(), std::begin(Header), std::end(Header));
+        data.resize(10 + TagSize, 0);
+
+        const auto audio = frames(Frames);
+        data.insert(data.end(), audio.begin(), audio.end());
+
+        return data;
+    }
+
+    mp3_scanner scan(const std::vector<unsigned char>& data, std::size_t chunk)
+    {
+        mp3_scanner scanner{};
+
+        for (std::size_t offset = 0; offset < data.size(); offset += chunk) {
+            scanner.feed(data.data() + offset, std::min(chunk, data.size() - offset));
+        }
+
+        return scanner;
+    }
+}
+
+TEST(mp3_scanner, fixture_in_any_chunk_size)
+{
+    const auto data = fixture();
+
+    for (std::size_t chunk : {1, 3, 7, 4096}) {
+        SCOPED_TRACE(chunk);
+
+        const auto scanner = scan(data, chunk);
+
+        EXPECT_TRUE(scanner.valid());
+        EXPECT_EQ(Frames, scanner.frames());
+        EXPECT_EQ(44100u, scanner.sample_rate());
+        EXPECT_EQ(2u, scanner.channels());
+        EXPECT_EQ(3u, scanner.layer());
+        EXPECT_EQ(Frames * 1152 * 1000 / 44100, scanner.duration());
+        EXPECT_EQ(10 + TagSize, scanner.first_frame());
+        EXPECT_EQ(data.size(), scanner.end());
+
+        // 2.6 s of audio, so entries at 0, 1 and 2 s
+        ASSERT_EQ(3u, scanner.index().size());
+        EXPECT_EQ(10 + TagSize, scanner.index()[0]);
+        // 1 s is reached after ceil(44100 / 1152) = 39 frames
+        EXPECT_EQ(10 + TagSize + 39 * FrameLength, scanner.index()[1]);
+    }
+}
+
+TEST(mp3_scanner, false_sync_before_the_audio)
+{
+    // A lone header which is not followed by another one where it says
+    std::vector<unsigned char> data(std::begin(Header), std::end(Header));
+    data.resize(24, 0);
+
+    const auto audio = frames(Frames);
+    data.insert(data.end(), audio.begin(), audio.end());
+
+    const auto scanner = scan(data, 7);
+
+    EXPECT_EQ(Frames, scanner.frames());
+    EXPECT_EQ(24u, scanner.first_frame());
+    EXPECT_EQ(data.size(), scanner.end());
+}
+
+TEST(mp3_scanner, single_header_is_not_a_stream)
+{
+    std::vector<unsigned char> data(std::begin(Header), std::end(Header));
+    data.resize(FrameLength, 0);
+
+    EXPECT_FALSE(scan(data, 4096).valid());
+}
+
+TEST(mp3_scanner, not_audio)
+{
+    const std::vector<unsigned char> data(5000, 0x42);
+
+    EXPECT_FALSE(scan(data, 4096).valid());
+}
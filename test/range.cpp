@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include "../src/ops/http/range.h"
+
+using ops::http::byte_range;
+using ops::http::etag_matches;
+using ops::http::parse_range;
+
+namespace
+{
+    struct parsed
+    {
+        byte_range  result;
+        std::size_t first;
+        std::size_t length;
+    };
+
+    parsed parse(const std::string& header, std::size_t size)
+    {
+        parsed p{byte_range::none, 0, 0};
+        p.result = parse_range(header, size, p.first, p.length);
+
+        return p;
+    }
+}
+
+TEST(parse_range, closed_range)
+{
+    const auto p = parse("bytes=0-499", 1000);
+
+    EXPECT_EQ(byte_range::satisfiable, p.result);
+    EXPECT_EQ(0u, p.first);
+    EXPECT_EQ(500u, p.length);
+}
+
+TEST(parse_range, single_byte)
+{
+    const auto p = parse("bytes=999-999", 1000);
+
+    EXPECT_EQ(byte_range::satisfiable, p.result);
+    EXPECT_EQ(999u, p.first);
+    EXPECT_EQ(1u, p.length);
+}
+
+TEST(parse_range, open_range_runs_to_the_end)
+{
+    const auto p = parse("bytes=200-", 1000);
+
+    EXPECT_EQ(byte_range::satisfiable, p.result);
+    EXPECT_EQ(200u, p.first);
+    EXPECT_EQ(800u, p.length);
+}
+
+TEST(parse_range, end_is_clamped_to_the_size)
+{
+    const auto p = parse("bytes=900-5000", 1000);
+
+    EXPECT_EQ(byte_range::satisfiable, p.result);
+    EXPECT_EQ(900u, p.first);
+    EXPECT_EQ(100u, p.length);
+}
+
+TEST(parse_range, huge_end_is_clamped_to_the_size)
+{
+    const auto p = parse("bytes=0-99999999999999999999999", 1000);
+
+    EXPECT_EQ(byte_range::satisfiable, p.result);
+    EXPECT_EQ(0u, p.first);
+    EXPECT_EQ(1000u, p.length);
+}
+
+TEST(parse_range, suffix_range)
+{
+    const auto p = parse("bytes=-100", 1000);
+
+    EXPECT_EQ(byte_range::satisfiable, p.result);
+    EXPECT_EQ(900u, p.first);
+    EXPECT_EQ(100u, p.length);
+}
+
+TEST(parse_range, suffix_longer_than_the_file)
+{
+    const auto p = parse("bytes=-5000", 1000);
+
+    EXPECT_EQ(byte_range::satisfiable, p.result);
+    EXPECT_EQ(0u, p.first);
+    EXPECT_EQ(1000u, p.length);
+}
+
+TEST(parse_range, whitespace_is_allowed)
+{
+    const auto p = parse("bytes= 10 - 19 ", 1000);
+
+    EXPECT_EQ(byte_range::satisfiable, p.result);
+    EXPECT_EQ(10u, p.first);
+    EXPECT_EQ(10u, p.length);
+}
+
+TEST(parse_range, start_beyond_the_end)
+{
+    EXPECT_EQ(byte_range::unsatisfiable, parse("bytes=1000-", 1000).result);
+    EXPECT_EQ(byte_range::unsatisfiable, parse("bytes=2000-3000", 1000).result);
+}
+
+TEST(parse_range, empty_suffix)
+{
+    EXPECT_EQ(byte_range::unsatisfiable, parse("bytes=-0", 1000).result);
+}
+
+TEST(parse_range, empty_file)
+{
+    EXPECT_EQ(byte_range::unsatisfiable, parse("bytes=0-", 0).result);
+    EXPECT_EQ(byte_range::unsatisfiable, parse("bytes=-10", 0).result);
+}
+
+TEST(parse_range, ignored_forms)
+{
+    EXPECT_EQ(byte_range::none, parse("", 1000).result);
+    EXPECT_EQ(byte_range::none, parse("items=0-10", 1000).result);
+    EXPECT_EQ(byte_range::none, parse("bytes=0-10,20-30", 1000).result);
+    EXPECT_EQ(byte_range::none, parse("bytes=10", 1000).result);
+    EXPECT_EQ(byte_range::none, parse("bytes=-", 1000).result);
+    EXPECT_EQ(byte_range::none, parse("bytes=a-b", 1000).result);
+    EXPECT_EQ(byte_range::none, parse("bytes=-1-5", 1000).result);
+    EXPECT_EQ(byte_range::none, parse("bytes=500-100", 1000).result);
+}
+
+TEST(etag_matches, exact)
+{
+    EXPECT_TRUE(etag_matches("\"abc\"", "\"abc\""));
+    EXPECT_FALSE(etag_matches("\"abd\"", "\"abc\""));
+}
+
+TEST(etag_matches, empty_header)
+{
+    EXPECT_FALSE(etag_matches("", "\"abc\""));
+}
+
+TEST(etag_matches, weak_tags_compare_equal)
+{
+    EXPECT_TRUE(etag_matches("W/\"abc\"", "\"abc\""));
+}
+
+TEST(etag_matches, list)
+{
+    EXPECT_TRUE(etag_matches("\"x\", \"abc\" ,\"y\"", "\"abc\""));
+    EXPECT_FALSE(etag_matches("\"x\", \"y\"", "\"abc\""));
+}
+
+TEST(etag_matches, any)
+{
+    EXPECT_TRUE(etag_matches("*", "\"abc\""));
+    EXPECT_TRUE(etag_matches("\"x\", *", "\"abc\""));
+}
+
+TEST(etag_matches, tags_are_quoted)
+{
+    EXPECT_FALSE(etag_matches("abc", "\"abc\""));
+}
@@ -0,0 +1,314 @@
+#include <gtest/gtest.h>
+#include <boost/regex.hpp>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../src/ops/http/router.h"
+
+using ops::http::router;
+
+namespace
+{
+    struct route
+    {
+        std::string method;
+        std::string pattern;
+    };
+
+    std::vector<route> resource(const std::string& name)
+    {
+        const std::string collection{"^/" + name + "$"};
+        const std::string item{"^/" + name + "/([0-9a-f]+)$"};
+
+        return {{"GET", collection}, {"POST", collection},
+                {"GET", item}, {"PUT", item}, {"PATCH", item}, {"DELETE", item}};
+    }
+
+    ///
+    /// The routes of the application, in the order in which they are
+    /// registered by http::server, rest::server::add_controller and the
+    /// controllers and adapters installed in main.
+    ///
+    std::vector<route> route_table()
+    {
+        std::vector<route> routes{{"GET", "^/metrics$"}};
+
+        const auto add = [&routes](std::vector<route> more) {
+            routes.insert(routes.end(), more.begin(), more.end());
+        };
+
+        add(resource("campaigns"));
+        add({{"POST", "^/campaigns/([0-9a-f]+)/features$"},
+             {"PATCH", "^/campaigns/([0-9a-f]+)/features/([0-9a-f]+)$"},
+             {"POST", "^/campaigns/([0-9a-f]+)/features/([0-9a-f]+)/adapters$"},
+             {"POST", "^/campaigns/([0-9a-f]+)/languages$"}});
+        add(resource("languages"));
+        add(resource("content"));
+        add({{"POST", "^/content/([0-9a-f]+)/reps$"}});
+        add(resource("media"));
+        add({{"GET", "^/media/blobs/([0-9a-f]+)$"},
+             {"GET", "^/media/concat/([0-9a-f]+)$"}});
+        add(resource("audience"));
+        add(resource("country"));
+        add({{"POST", "^/nexmo/ivr/s/([0-9a-f]+)/n/([0-9]+)$"},
+             {"POST", "^/nexmo/event$"},
+             {"POST", "^/nexmo/answer/c/([0-9a-f]+)/f/([0-9a-f]+)$"},
+             {"POST", "^/twilio/voice$"},
+             {"POST", "^/twilio/event$"}});
+
+        return routes;
+    }
+
+    struct result
+    {
+        bool                     found;
+        std::size_t              route;
+        std::vector<std::string> captures;
+
+        bool operator==(const result& other) const
+        {
+            return found == other.found
+                && (!found || (route == other.route && captures == other.captures));
+        }
+    };
+
+    ///
+    /// Dispatches the way http::server did before the router: the first
+    /// route, in registration order, whose regular expression is found in
+    /// the path.
+    ///
+    class regex_scan
+    {
+    public:
+        explicit regex_scan(const std::vector<route>& routes)
+        {
+            for (const auto& r : routes) {
+                _routes.emplace_back(r.method, boost::regex{r.pattern});
+            }
+        }
+
+        result find(const std::string& method, const std::string& path) const
+        {
+            boost::smatch match{};
+
+            for (std::size_t i = 0; i < _routes.size(); ++i) {
+                if (method == _routes[i].first
+                    && boost::regex_search(path, match, _routes[i].second))
+                {
+                    result r{true, i, {}};
+                    for (std::size_t j = 0; j < match.size(); ++j) {
+                        r.captures.emplace_back(match.str(j));
+                    }
+                    return r;
+                }
+            }
+
+            return result{false, 0, {}};
+        }
+
+    private:
+        std::vector<std::pair<std::string, boost::regex>> _routes;
+    };
+
+    result find(const router& r, const std::string& method, const std::string& path)
+    {
+        result res{false, 0, {}};
+        res.found = r.find(method, path, res.route, res.captures);
+
+        return res;
+    }
+
+    ///
+    /// \returns \a pattern as a path, with every capture replaced by
+    ///          \a value
+    ///
+    std::string instantiate(std::string pattern, const std::string& value)
+    {
+        pattern = pattern.substr(1, pattern.size() - 2);
+
+        for (const std::string capture : {"([0-9a-f]+)", "([0-9]+)"}) {
+            for (auto pos = pattern.find(capture);
+                 std::string::npos != pos;
+                 pos = pattern.find(capture, pos + value.size()))
+            {
+                pattern.replace(pos, capture.size(), value);
+            }
+        }
+
+        return pattern;
+    }
+
+    const std::vector<std::string> Methods{"GET", "POST", "PUT", "PATCH", "DELETE", "HEAD"};
+
+    // Capture values which are digits, hex, and neither
+    const std::vector<std::string> Values{
+        "0", "42", "007", "abc", "5d2f8a7c3e9b", "0d41a7c3e9b2",
+        "ABC", "5D2F8A7C3E9B", "aBc", "g", "0x1", "-1", "", " 1", "a.b"
+    };
+
+    void expect_same(const router& r,
+                     const regex_scan& scan,
+                     const std::string& method,
+                     const std::string& path)
+    {
+        SCOPED_TRACE(method + " " + path);
+
+        const auto expected = scan.find(method, path);
+        const auto actual = find(r, method, path);
+
+        EXPECT_EQ(expected.found, actual.found);
+        EXPECT_TRUE(expected == actual);
+    }
+}
+
+TEST(router, route_table_compiles)
+{
+    router r{};
+    const auto routes = route_table();
+
+    for (std::size_t i = 0; i < routes.size(); ++i) {
+        SCOPED_TRACE(routes[i].pattern);
+        EXPECT_TRUE(r.add(routes[i].method, routes[i].pattern, i));
+    }
+}
+
+TEST(router, dispatches_like_the_regex_scan)
+{
+    router r{};
+    const auto routes = route_table();
+    const regex_scan scan{routes};
+
+    for (std::size_t i = 0; i < routes.size(); ++i) {
+        r.add(routes[i].method, routes[i].pattern, i);
+    }
+
+    std::set<std::size_t> reached{};
+
+    for (const auto& rt : routes) {
+        for (const auto& value : Values) {
+            const auto path = instantiate(rt.pattern, value);
+
+            for (const auto& method : Methods) {
+                expect_same(r, scan, method, path);
+
+                const auto expected = scan.find(method, path);
+                if (expected.found) {
+                    reached.insert(expected.route);
+                }
+            }
+        }
+    }
+
+    // Every route is reached by some path
+    EXPECT_EQ(routes.size(), reached.size());
+}
+
+TEST(router, edge_cases_behave_like_the_regex_scan)
+{
+    router r{};
+    const auto routes = route_table();
+    const regex_scan scan{routes};
+
+    for (std::size_t i = 0; i < routes.size(); ++i) {
+        r.add(routes[i].method, routes[i].pattern, i);
+    }
+
+    const std::vector<std::string> paths{
+        // Trailing slashes and empty segments
+        "/campaigns/", "/campaigns//", "//campaigns", "/campaigns//abc",
+        "/campaigns/abc/", "/campaigns/abc//features", "/", "//", "",
+        "campaigns", "/nexmo/event/", "/nexmo//event",
+        // Uppercase hex
+        "/campaigns/ABC", "/campaigns/Abc/features", "/media/blobs/DEADBEEF",
+        // Digits where hex is captured, and hex where digits are
+        "/campaigns/123", "/nexmo/ivr/s/123/n/456", "/nexmo/ivr/s/abc/n/def",
+        "/nexmo/ivr/s/abc/n/12a", "/nexmo/ivr/s/abc/n/",
+        // Literals which are also valid captures, and prefixes of routes
+        "/media/blobs", "/media/concat", "/media/beef", "/media/blobs/abc/x",
+        "/campaigns/abc/features/def/adapters/x", "/metrics/x", "/METRICS"
+    };
+
+    for (const auto& path : paths) {
+        for (const auto& method : Methods) {
+            expect_same(r, scan, method, path);
+        }
+    }
+}
+
+TEST(router, newlines_are_not_matched)
+{
+    // Unlike the router, boost::regex matches `^` and `$` at line breaks,
+    // which the path can only contain if they were sent as %0A. This is the
+    // one known difference, and the router's behavior is the intended one.
+    router r{};
+    const auto routes = route_table();
+    const regex_scan scan{routes};
+
+    for (std::size_t i = 0; i < routes.size(); ++i) {
+        r.add(routes[i].method, routes[i].pattern, i);
+    }
+
+    for (const std::string path : {"/nexmo/event\n", "/campaigns/abc\n", "/x\n/metrics"}) {
+        SCOPED_TRACE(path);
+        EXPECT_TRUE(scan.find("POST", path).found || scan.find("GET", path).found);
+        EXPECT_FALSE(find(r, "POST", path).found);
+        EXPECT_FALSE(find(r, "GET", path).found);
+    }
+}
+
+TEST(router, captures_follow_the_full_path)
+{
+    router r{};
+    r.add("POST", "^/nexmo/ivr/s/([0-9a-f]+)/n/([0-9]+)$", 7);
+
+    const auto res = find(r, "POST", "/nexmo/ivr/s/5d2f8a7c3e9b/n/12");
+
+    ASSERT_TRUE(res.found);
+    EXPECT_EQ(7u, res.route);
+    EXPECT_TRUE((std::vector<std::string>{"/nexmo/ivr/s/5d2f8a7c3e9b/n/12", "5d2f8a7c3e9b", "12"})
+                == res.captures);
+}
+
+TEST(router, first_registered_handler_wins)
+{
+    router r{};
+    EXPECT_TRUE(r.add("GET", "^/campaigns/([0-9a-f]+)$", 1));
+    EXPECT_TRUE(r.add("GET", "^/campaigns/([0-9a-f]+)$", 2));
+
+    const auto res = find(r, "GET", "/campaigns/abc");
+
+    ASSERT_TRUE(res.found);
+    EXPECT_EQ(1u, res.route);
+}
+
+TEST(router, rejects_unsupported_patterns)
+{
+    router r{};
+
+    for (const std::string pattern : {
+             "/campaigns",                    // not anchored
+             "^/campaigns",
+             "/campaigns$",
+             "^campaigns$",                   // relative
+             "^$",
+             "^/campaigns/?$",                // other regular expression syntax
+             "^/campaigns/(.*)$",
+             "^/campaigns/([0-9A-F]+)$",
+             "^/campaigns/([a-z]+)$",
+             "^/campaigns/[0-9a-f]+$",
+             "^/campaigns|languages$",
+             "^/camp.igns$",
+             "^/campaigns/([0-9a-f]+)/(features|languages)$",
+             "^/media/(blobs)$",
+             "^/a\\/b$"})
+    {
+        SCOPED_TRACE(pattern);
+        EXPECT_FALSE(r.add("GET", pattern, 0));
+    }
+
+    // Nothing was added by the rejected patterns
+    for (const std::string path : {"/campaigns", "/campaigns/abc", "/media/blobs"}) {
+        EXPECT_FALSE(find(r, "GET", path).found);
+    }
+}